@@ -181,17 +181,11 @@ std::vector<float> ClipEncoder::encodeImage(const cv::Mat& image) {
 }
 
 std::vector<std::vector<float>> ClipEncoder::encodeImageBatch(const std::vector<cv::Mat>& images) {
-    if (images.empty()) {
+    std::vector<float> flatFeatures = encodeImageBatchFlat(images);
+    if (flatFeatures.empty()) {
         return {};
     }
 
-    // 预处理图像批次
-    std::vector<float> imageData = imagePreprocessor_->preprocessBatch(images);
-    std::vector<int64_t> inputShape = imagePreprocessor_->getBatchInputShape(images.size());
-
-    // 运行推理
-    std::vector<float> flatFeatures = runVisualInference(imageData, inputShape);
-
     // 重塑为批次格式
     std::vector<std::vector<float>> batchFeatures;
     batchFeatures.reserve(images.size());
@@ -205,6 +199,19 @@ std::vector<std::vector<float>> ClipEncoder::encodeImageBatch(const std::vector<
     return batchFeatures;
 }
 
+std::vector<float> ClipEncoder::encodeImageBatchFlat(const std::vector<cv::Mat>& images) {
+    if (images.empty()) {
+        return {};
+    }
+
+    // 预处理图像批次
+    std::vector<float> imageData = imagePreprocessor_->preprocessBatch(images);
+    std::vector<int64_t> inputShape = imagePreprocessor_->getBatchInputShape(images.size());
+
+    // 运行推理（输出已按样本归一化）
+    return runVisualInference(imageData, inputShape);
+}
+
 std::vector<float> ClipEncoder::runVisualInference(const std::vector<float>& imageData,
                                                    const std::vector<int64_t>& inputShape) {
     if (!visualSession_) {
@@ -278,20 +285,11 @@ std::vector<float> ClipEncoder::encodeText(const std::string& text) {
 }
 
 std::vector<std::vector<float>> ClipEncoder::encodeTextBatch(const std::vector<std::string>& texts) {
-    if (!textSession_ || !textTokenizer_) {
-        throw std::runtime_error("Text encoder not initialized");
-    }
-
-    if (texts.empty()) {
+    std::vector<float> flatFeatures = encodeTextBatchFlat(texts);
+    if (flatFeatures.empty()) {
         return {};
     }
 
-    // 批量分词
-    std::vector<int64_t> allTokens = textTokenizer_->encodeBatch(texts);
-
-    // 运行推理
-    std::vector<float> flatFeatures = runTextInference(allTokens);
-
     // 重塑为批次格式
     std::vector<std::vector<float>> batchFeatures;
     batchFeatures.reserve(texts.size());
@@ -305,6 +303,22 @@ std::vector<std::vector<float>> ClipEncoder::encodeTextBatch(const std::vector<s
     return batchFeatures;
 }
 
+std::vector<float> ClipEncoder::encodeTextBatchFlat(const std::vector<std::string>& texts) {
+    if (!textSession_ || !textTokenizer_) {
+        throw std::runtime_error("Text encoder not initialized");
+    }
+
+    if (texts.empty()) {
+        return {};
+    }
+
+    // 批量分词
+    std::vector<int64_t> allTokens = textTokenizer_->encodeBatch(texts);
+
+    // 运行推理
+    return runTextInference(allTokens);
+}
+
 std::vector<float> ClipEncoder::runTextInference(const std::vector<int64_t>& textTokens) {
     if (!textSession_) {
         throw std::runtime_error("Text encoder not initialized");
@@ -57,6 +57,13 @@ public:
      */
     std::vector<std::vector<float>> encodeImageBatch(const std::vector<cv::Mat>& images);
 
+    /**
+     * @brief 批量编码图像，返回连续存储的特征矩阵（不拆分为逐行向量）
+     * @param images 图像矩阵列表
+     * @return batch_size x embeddingDim 行主序特征，可直接传给 FaissIndex 的指针接口
+     */
+    std::vector<float> encodeImageBatchFlat(const std::vector<cv::Mat>& images);
+
     // ==================== 文本编码 ====================
 
     /**
@@ -73,6 +80,13 @@ public:
      */
     std::vector<std::vector<float>> encodeTextBatch(const std::vector<std::string>& texts);
 
+    /**
+     * @brief 批量编码文本，返回连续存储的特征矩阵
+     * @param texts 文本列表
+     * @return batch_size x embeddingDim 行主序特征
+     */
+    std::vector<float> encodeTextBatchFlat(const std::vector<std::string>& texts);
+
     // ==================== 相似度计算 ====================
 
     /**
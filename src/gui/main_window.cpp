@@ -401,15 +401,24 @@ void MainWindow::onRebuildIndex() {
 
     try {
         bool success = dbManager_->rebuildIndex(
-            [&progress](int current, int total) {
+            [this, &progress](int current, int total) {
                 progress.setMaximum(total);
                 progress.setValue(current);
                 QApplication::processEvents();
+                if (progress.wasCanceled()) {
+                    dbManager_->cancelRebuild();
+                }
             }
         );
 
+        const bool canceled = progress.wasCanceled();
         progress.close();
 
+        if (canceled) {
+            // 取消时原索引保持不变
+            return;
+        }
+
         if (success) {
             QMessageBox::information(
                 this,
@@ -437,6 +446,7 @@ void MainWindow::onRebuildIndex() {
 void MainWindow::onDatabaseStats() {
     int64_t totalCount = dbManager_->totalCount();
     size_t indexSize = dbManager_->faissIndex().size();
+    auto memory = dbManager_->faissIndex().memoryUsage();
     auto categories = dbManager_->getAllCategories();
 
     QString stats = QString(
@@ -444,12 +454,17 @@ void MainWindow::onDatabaseStats() {
         "==================\n\n"
         "%2\n"
         "%3\n"
-        "%4\n\n"
-        "%5\n"
-        "%6"
+        "%4\n"
+        "%5\n\n"
+        "%6\n"
+        "%7"
     ).arg(TR("Database Statistics"))
      .arg(TR("Total Images: %1").arg(totalCount))
      .arg(TR("Index Size: %1").arg(indexSize))
+     .arg(TR("Index Memory: %1 MB (%2 bytes/vector, %3 MB mapped)")
+          .arg(memory.heapBytes / (1024.0 * 1024.0), 0, 'f', 1)
+          .arg(memory.bytesPerVector())
+          .arg(memory.mappedBytes / (1024.0 * 1024.0), 0, 'f', 1))
      .arg(TR("Categories: %1").arg(categories.size()))
      .arg(TR("Database Path: %1").arg(QString::fromStdString(dbManager_->getDbPath())))
      .arg(TR("Index Path: %1").arg(QString::fromStdString(dbManager_->getIndexPath())));
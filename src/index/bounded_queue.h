@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 有界阻塞队列（多生产者、多消费者）
+ *
+ * 用于流水线各阶段之间传递数据：队列满时生产者阻塞，下游处理慢时上游自动降速，
+ * 内存占用以容量为上限。close() 后不再接受新元素，消费者取完剩余元素后退出。
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1)
+        , closed_(false)
+    {
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief 放入元素（队列满时阻塞）
+     * @return 队列已关闭时返回 false（元素未放入）
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 取出元素（队列空时阻塞）
+     * @return 队列已关闭且取空时返回 false
+     */
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 关闭队列，唤醒所有等待的生产者与消费者
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+private:
+    const size_t capacity_;               // 容量上限
+    std::mutex mutex_;
+    std::condition_variable notFull_;     // 有空位
+    std::condition_variable notEmpty_;    // 有元素
+    std::deque<T> items_;
+    bool closed_;                         // 是否已关闭
+};
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,150 @@
+#include "content_hash.h"
+#include "file_utils.h"
+#include <opencv2/opencv.hpp>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+// 每次读取的字节数
+constexpr size_t kReadChunkBytes = 1 << 20;
+// 感知哈希中置位数低于该值或高于 64 减该值时视为低信息量
+constexpr int kMinHashBits = 4;
+
+constexpr uint64_t kHashPrime = 0x9e3779b97f4a7c15ULL;
+
+uint64_t rotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+uint64_t mixWord(uint64_t hash, uint64_t word) {
+    hash ^= word * 0xbf58476d1ce4e5b9ULL;
+    return rotateLeft(hash, 27) * kHashPrime;
+}
+
+/**
+ * @brief 最终混洗（splitmix64 终结函数）
+ */
+uint64_t finalize(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief 由灰度图计算 dHash：缩小为 9x8 后逐行比较相邻像素
+ */
+uint64_t differenceHash(const cv::Mat& gray) {
+    cv::Mat small;
+    cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; ++y) {
+        const unsigned char* row = small.ptr<unsigned char>(y);
+        for (int x = 0; x < 8; ++x) {
+            hash = (hash << 1) | (row[x] < row[x + 1] ? 1u : 0u);
+        }
+    }
+    return hash;
+}
+
+int popCount(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    int count = 0;
+    while (x) {
+        x &= x - 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+} // namespace
+
+uint64_t hashFileContent(const std::string& path) {
+    std::FILE* file = openFile(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    // 按 8 字节字处理，尾部不足 8 字节补零
+    std::vector<unsigned char> buffer(kReadChunkBytes);
+    uint64_t hash = kHashPrime;
+    uint64_t length = 0;
+    size_t read = 0;
+    while ((read = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= read; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, sizeof(word));
+            hash = mixWord(hash, word);
+        }
+        if (i < read) {
+            uint64_t word = 0;
+            std::memcpy(&word, buffer.data() + i, read - i);
+            hash = mixWord(hash, word);
+        }
+        length += read;
+    }
+    const bool failed = std::ferror(file) != 0;
+    std::fclose(file);
+    if (failed) {
+        return 0;
+    }
+
+    // 0 保留表示失败
+    const uint64_t result = finalize(hash ^ length);
+    return result != 0 ? result : 1;
+}
+
+uint64_t perceptualHash(const std::string& path) {
+    cv::Mat image = cv::imread(path, cv::IMREAD_REDUCED_GRAYSCALE_8);
+    if (image.empty()) {
+        return 0;
+    }
+    return differenceHash(image);
+}
+
+uint64_t perceptualHash(const cv::Mat& image) {
+    if (image.empty()) {
+        return 0;
+    }
+
+    cv::Mat gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    } else if (image.channels() == 4) {
+        cv::cvtColor(image, gray, cv::COLOR_BGRA2GRAY);
+    } else {
+        gray = image;
+    }
+
+    // 与 IMREAD_REDUCED_GRAYSCALE_8 一样先缩小到 1/8，两种路径的哈希可互相比较
+    if (gray.cols >= 72 && gray.rows >= 64) {
+        cv::Mat reduced;
+        cv::resize(gray, reduced, cv::Size(gray.cols / 8, gray.rows / 8), 0, 0, cv::INTER_AREA);
+        return differenceHash(reduced);
+    }
+    return differenceHash(gray);
+}
+
+bool isLowInformationHash(uint64_t hash) {
+    const int bits = popCount(hash);
+    return bits < kMinHashBits || bits > 64 - kMinHashBits;
+}
+
+int hammingDistance(uint64_t a, uint64_t b) {
+    return popCount(a ^ b);
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace cv {
+class Mat;
+}
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 文件内容哈希（64位非加密哈希，含文件长度，仅用于查重）
+ * @param path 文件路径（UTF-8）
+ * @return 哈希值，读取失败返回 0
+ */
+uint64_t hashFileContent(const std::string& path);
+
+/**
+ * @brief 图像感知哈希（dHash：缩小为 9x8 灰度图后比较相邻像素）
+ *
+ * 对重新编码、缩放、轻微调色不敏感，汉明距离小即视觉上近似。
+ * 以降采样方式解码（JPEG 按 1/8 比例解码），开销远小于完整解码。
+ * @param path 图像路径
+ * @return 哈希值，解码失败返回 0
+ */
+uint64_t perceptualHash(const std::string& path);
+
+/**
+ * @brief 由已解码的图像计算感知哈希（先按 1/8 面积缩小，与按路径的结果一致）
+ * @param image BGR / BGRA / 灰度图像
+ * @return 哈希值，图像为空返回 0
+ */
+uint64_t perceptualHash(const cv::Mat& image);
+
+/**
+ * @brief 感知哈希是否信息量过低（纯色、渐变等图像的哈希几乎全 0 或全 1，不宜用于查重）
+ */
+bool isLowInformationHash(uint64_t hash);
+
+/**
+ * @brief 两个哈希的汉明距离
+ */
+int hammingDistance(uint64_t a, uint64_t b);
+
+} // namespace index
+} // namespace vindex
@@ -1,16 +1,117 @@
 #include "database_manager.h"
+#include "bounded_queue.h"
+#include "content_hash.h"
+#include "duplicate_finder.h"
+#include "image_header.h"
+#include "index_builder.h"
+#include "index_tuner.h"
 #include "../core/clip_encoder.h"
 #include <opencv2/opencv.hpp>
 #include <filesystem>
 #include <algorithm>
 #include <chrono>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
 
 namespace vindex {
 namespace index {
 
+namespace {
+
+/**
+ * @brief 导入流水线中的一张图像
+ */
+struct PendingImage {
+    enum class State {
+        Ready,        // 已解码，待推理 / 写入
+        Duplicate,    // 与库中或本次导入中的图像重复，跳过
+        Failed        // 读取、解码或推理失败
+    };
+
+    std::string path;
+    State state;
+    cv::Mat image;                 // 解码后的图像（推理后释放）
+    int width;
+    int height;
+    uint64_t fileHash;
+    uint64_t phash;
+    std::vector<float> features;   // 特征向量（推理后填入）
+
+    PendingImage()
+        : state(State::Failed), width(0), height(0), fileHash(0), phash(0) {}
+};
+
+// 图像记录的列（与 readRecord 的读取顺序一致）
+constexpr const char* kRecordColumns =
+    "id, file_path, file_name, category, description, add_time, width, height";
+
+// 图像记录缓存的默认容量
+constexpr size_t kRecordCacheCapacity = 4096;
+
+// 批量取记录时单条语句的最大ID数（低于 SQLite 的默认参数上限 999）
+constexpr size_t kMaxIdsPerStatement = 512;
+
+/**
+ * @brief 按 kRecordColumns 的列顺序读取当前行
+ */
+ImageRecord readRecord(sqlite3_stmt* stmt) {
+    ImageRecord record;
+    record.id = sqlite3_column_int64(stmt, 0);
+    const unsigned char* pathPtr = sqlite3_column_text(stmt, 1);
+    const unsigned char* namePtr = sqlite3_column_text(stmt, 2);
+    record.filePath = pathPtr ? reinterpret_cast<const char*>(pathPtr) : "";
+    record.fileName = namePtr ? reinterpret_cast<const char*>(namePtr) : "";
+
+    const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+    record.category = category ? category : "";
+
+    const char* desc = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+    record.description = desc ? desc : "";
+
+    record.addTime = sqlite3_column_int64(stmt, 5);
+    record.width = sqlite3_column_int(stmt, 6);
+    record.height = sqlite3_column_int(stmt, 7);
+    return record;
+}
+
+} // namespace
+
+/**
+ * @brief 独占使用一条缓存语句：构造时加锁，离开作用域时复位语句、清除绑定并解锁
+ *
+ * 可隐式转换为 sqlite3_stmt*；语句编译失败时为 nullptr
+ */
+class DatabaseManager::StatementLease {
+public:
+    explicit StatementLease(CachedStatement* cached) : cached_(cached) {
+        if (cached_) {
+            cached_->mutex.lock();
+        }
+    }
+
+    ~StatementLease() {
+        if (cached_) {
+            sqlite3_reset(cached_->stmt);
+            sqlite3_clear_bindings(cached_->stmt);
+            cached_->mutex.unlock();
+        }
+    }
+
+    StatementLease(const StatementLease&) = delete;
+    StatementLease& operator=(const StatementLease&) = delete;
+
+    operator sqlite3_stmt*() const { return cached_ ? cached_->stmt : nullptr; }
+
+private:
+    CachedStatement* cached_;
+};
+
 const std::vector<std::string> DatabaseManager::supportedFormats_ = {
     ".jpg", ".jpeg", ".png", ".bmp", ".tiff", ".tif", ".webp"
 };
@@ -23,10 +124,17 @@ DatabaseManager::DatabaseManager(const std::string& dbPath,
     , dbPath_(dbPath)
     , indexPath_(indexPath.empty() ? dbPath + ".index" : indexPath)
     , encoder_(nullptr)
+    , categoryFiltersGeneration_(0)
+    , rebuildCancelled_(false)
+    , perceptualHashesLoaded_(false)
+    , recordCache_(kRecordCacheCapacity)
 {
 }
 
 DatabaseManager::~DatabaseManager() {
+    for (auto& entry : statements_) {
+        sqlite3_finalize(entry.second->stmt);
+    }
     if (db_) {
         sqlite3_close(db_);
     }
@@ -34,12 +142,20 @@ DatabaseManager::~DatabaseManager() {
 
 bool DatabaseManager::initialize() {
     // 打开SQLite数据库
-    int rc = sqlite3_open(dbPath_.c_str(), &db_);
+    // 串行化模式：连接可被多个线程使用（各自持有不同的语句）
+    int rc = sqlite3_open_v2(dbPath_.c_str(), &db_,
+                             SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX,
+                             nullptr);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to open database: " << sqlite3_errmsg(db_) << std::endl;
         return false;
     }
 
+    if (!applyStorageOptions()) {
+        std::cerr << "Failed to configure database" << std::endl;
+        return false;
+    }
+
     // 创建表结构
     const char* createTableSql = R"(
         CREATE TABLE IF NOT EXISTS images (
@@ -50,12 +166,22 @@ bool DatabaseManager::initialize() {
             description TEXT,
             add_time INTEGER NOT NULL,
             width INTEGER,
-            height INTEGER
+            height INTEGER,
+            file_hash INTEGER,
+            phash INTEGER
         );
 
         CREATE INDEX IF NOT EXISTS idx_category ON images(category);
         CREATE INDEX IF NOT EXISTS idx_file_name ON images(file_name);
         CREATE INDEX IF NOT EXISTS idx_add_time ON images(add_time);
+
+        CREATE TABLE IF NOT EXISTS duplicate_clusters (
+            image_id INTEGER PRIMARY KEY,
+            cluster_id INTEGER NOT NULL,
+            score REAL
+        );
+
+        CREATE INDEX IF NOT EXISTS idx_duplicate_cluster ON duplicate_clusters(cluster_id);
     )";
 
     if (!executeSql(createTableSql)) {
@@ -63,9 +189,29 @@ bool DatabaseManager::initialize() {
         return false;
     }
 
+    // 旧数据库追加查重列（已有记录的哈希为空，不参与查重）
+    if (!ensureColumn("images", "file_hash", "INTEGER") ||
+        !ensureColumn("images", "phash", "INTEGER") ||
+        !executeSql("CREATE INDEX IF NOT EXISTS idx_file_hash ON images(file_hash)")) {
+        std::cerr << "Failed to upgrade tables" << std::endl;
+        return false;
+    }
+
+    // 读取自动调优的配置：默认搜索参数立即生效，索引类型用于新建或重建的索引
+    FaissIndex::IndexConfig tuned = faissIndex_.config();
+    if (IndexTuner::loadConfig(IndexTuner::tuningPath(indexPath_), tuned)) {
+        faissIndex_.reset(tuned);
+    }
+
+    // 挂载全精度向量存储（用于压缩索引的精排）
+    faissIndex_.attachVectorStore(indexPath_ + ".vec");
+
     // 尝试加载已有索引
     loadIndex();
 
+    // 挂载增量日志：回放上次保存之后的增删，之后的写入先记日志
+    faissIndex_.attachDeltaLog(indexPath_ + ".wal");
+
     return true;
 }
 
@@ -73,6 +219,31 @@ void DatabaseManager::setEncoder(core::ClipEncoder* encoder) {
     encoder_ = encoder;
 }
 
+void DatabaseManager::setIndexConfig(const FaissIndex::IndexConfig& config) {
+    faissIndex_.reset(config);
+}
+
+void DatabaseManager::setDedupOptions(const DedupOptions& options) {
+    // 感知哈希索引按最大距离分段，距离变化后下次查重时重新加载
+    if (options.maxHammingDistance != dedupOptions_.maxHammingDistance) {
+        perceptualHashes_.reset(options.maxHammingDistance);
+        perceptualHashesLoaded_ = false;
+    }
+    dedupOptions_ = options;
+}
+
+void DatabaseManager::setImportOptions(const ImportOptions& options) {
+    importOptions_ = options;
+}
+
+void DatabaseManager::setStorageOptions(const StorageOptions& options) {
+    storageOptions_ = options;
+}
+
+void DatabaseManager::setRecordCacheCapacity(size_t capacity) {
+    recordCache_.setCapacity(capacity);
+}
+
 // ==================== 图库管理 ====================
 
 int64_t DatabaseManager::addImage(const std::string& imagePath,
@@ -88,19 +259,74 @@ int64_t DatabaseManager::addImage(const std::string& imagePath,
         return -1;
     }
 
+    // 入库查重：先比较文件内容哈希，完全相同的文件无需解码
+    uint64_t fileHash = 0;
+    uint64_t phash = 0;
+    if (dedupOptions_.enabled) {
+        fileHash = hashFileContent(imagePath);
+        int64_t existing = findDuplicateByHash(fileHash, 0);
+        if (existing >= 0) {
+            std::cout << "Skipping duplicate of image " << existing << ": " << imagePath << std::endl;
+            return existing;
+        }
+    }
+
+    // 只解码一次：感知哈希、特征提取与尺寸共用同一图像
+    cv::Mat image = cv::imread(imagePath, cv::IMREAD_COLOR);
+    if (image.empty()) {
+        std::cerr << "Failed to decode image: " << imagePath << std::endl;
+        return -1;
+    }
+
+    // 视觉上近似的图像命中时跳过特征提取
+    if (dedupOptions_.enabled && dedupOptions_.maxHammingDistance >= 0) {
+        phash = perceptualHash(image);
+        int64_t existing = findDuplicateByHash(0, phash);
+        if (existing >= 0) {
+            std::cout << "Skipping duplicate of image " << existing << ": " << imagePath << std::endl;
+            return existing;
+        }
+    }
+
     // 提取特征
     std::vector<float> features;
     try {
-        features = extractFeatures(imagePath);
+        features = extractFeatures(image);
     } catch (const std::exception& e) {
         std::cerr << "Failed to extract features: " << e.what() << std::endl;
         return -1;
     }
 
-    // 获取图像尺寸
-    int width = 0, height = 0;
-    getImageSize(imagePath, width, height);
+    // 特征相似度查重（可选）
+    if (dedupOptions_.embeddingThreshold > 0.0f) {
+        auto similar = faissIndex_.rangeSearch(features, dedupOptions_.embeddingThreshold, 1);
+        if (!similar.empty()) {
+            std::cout << "Skipping near-duplicate of image " << similar.front().id
+                      << " (score " << similar.front().score << "): " << imagePath << std::endl;
+            return similar.front().id;
+        }
+    }
 
+    int64_t imageId = insertRecord(imagePath, category, description, image.cols, image.rows,
+                                   fileHash, phash);
+    if (imageId < 0) {
+        return -1;
+    }
+
+    // 添加到FAISS索引；增量日志写入失败时撤销记录，避免出现没有向量的图像
+    if (faissIndex_.add(features, imageId) < 0) {
+        discardRecord(imageId);
+        return -1;
+    }
+
+    return imageId;
+}
+
+int64_t DatabaseManager::insertRecord(const std::string& imagePath,
+                                      const std::string& category,
+                                      const std::string& description,
+                                      int width, int height,
+                                      uint64_t fileHash, uint64_t phash) {
     // 获取文件名
     std::string fileName = fs::path(imagePath).filename().string();
 
@@ -110,15 +336,12 @@ int64_t DatabaseManager::addImage(const std::string& imagePath,
         now.time_since_epoch()).count();
 
     // 插入数据库
-    sqlite3_stmt* stmt;
-    const char* sql = R"(
-        INSERT INTO images (file_path, file_name, category, description, add_time, width, height)
-        VALUES (?, ?, ?, ?, ?, ?, ?)
-    )";
-
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db_) << std::endl;
+    StatementLease stmt(cachedStatement(R"(
+        INSERT INTO images (file_path, file_name, category, description, add_time, width, height,
+                            file_hash, phash)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+    )"));
+    if (!stmt) {
         return -1;
     }
 
@@ -129,11 +352,19 @@ int64_t DatabaseManager::addImage(const std::string& imagePath,
     sqlite3_bind_int64(stmt, 5, timestamp);
     sqlite3_bind_int(stmt, 6, width);
     sqlite3_bind_int(stmt, 7, height);
+    // 哈希按位存为有符号64位整数
+    if (fileHash != 0) {
+        sqlite3_bind_int64(stmt, 8, static_cast<sqlite3_int64>(fileHash));
+    } else {
+        sqlite3_bind_null(stmt, 8);
+    }
+    if (phash != 0) {
+        sqlite3_bind_int64(stmt, 9, static_cast<sqlite3_int64>(phash));
+    } else {
+        sqlite3_bind_null(stmt, 9);
+    }
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
         std::cerr << "Failed to insert record: " << sqlite3_errmsg(db_) << std::endl;
         return -1;
     }
@@ -141,21 +372,54 @@ int64_t DatabaseManager::addImage(const std::string& imagePath,
     // 获取插入的ID
     int64_t imageId = sqlite3_last_insert_rowid(db_);
 
-    // 添加到FAISS索引
-    faissIndex_.add(features, imageId);
+    if (perceptualHashesLoaded_ && phash != 0 && !isLowInformationHash(phash)) {
+        perceptualHashes_.insert(imageId, phash);
+    }
+
+    // 该分类的过滤缓存失效（删除无需失效：已删除的ID不会出现在索引结果中）
+    {
+        std::lock_guard<std::mutex> lock(categoryFiltersMutex_);
+        categoryFilters_.erase(category);
+        categoryFiltersGeneration_++;
+    }
 
     return imageId;
 }
 
+void DatabaseManager::discardRecord(int64_t id) {
+    StatementLease stmt(cachedStatement("DELETE FROM images WHERE id = ?"));
+    if (stmt) {
+        sqlite3_bind_int64(stmt, 1, id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Failed to discard image record " << id << ": "
+                      << sqlite3_errmsg(db_) << std::endl;
+        }
+    }
+    perceptualHashes_.erase(id);
+    recordCache_.erase(id);
+}
+
 size_t DatabaseManager::addImageBatch(const std::vector<std::string>& imagePaths,
                                      const std::string& category) {
     size_t successCount = 0;
 
+    // 每 transactionRows 张合并为一个事务，避免每行一次提交
+    const size_t rowsPerTransaction = std::max<size_t>(storageOptions_.transactionRows, 1);
+    size_t pendingRows = 0;
+    beginTransaction();
     for (const auto& path : imagePaths) {
         if (addImage(path, category) >= 0) {
             successCount++;
         }
+        if (++pendingRows >= rowsPerTransaction) {
+            commitTransaction();
+            beginTransaction();
+            pendingRows = 0;
+        }
     }
+    commitTransaction();
+
+    faissIndex_.syncDeltaLog();
 
     return successCount;
 }
@@ -164,58 +428,330 @@ size_t DatabaseManager::importFolder(const std::string& folderPath,
                                     bool recursive,
                                     std::function<void(int, int)> progress) {
     auto imageFiles = scanImageFiles(folderPath, recursive);
-    int total = imageFiles.size();
+    const int total = static_cast<int>(imageFiles.size());
+    if (imageFiles.empty()) {
+        return 0;
+    }
+    if (!encoder_) {
+        std::cerr << "Encoder not set" << std::endl;
+        return 0;
+    }
+
+    const size_t batchSize = std::max<size_t>(importOptions_.batchSize, 1);
+    const size_t decodeThreads = importOptions_.decodeThreads > 0
+        ? static_cast<size_t>(importOptions_.decodeThreads)
+        : std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+    const size_t dimension = static_cast<size_t>(faissIndex_.dimension());
+
+    BoundedQueue<PendingImage> decoded(std::max(importOptions_.queueCapacity, batchSize));
+    BoundedQueue<std::vector<PendingImage>> encoded(2);
+
+    // 解码线程查重与写入线程共用数据库连接和感知哈希表；
+    // 已通过查重但尚未写入的哈希也要参与比较，以发现本次导入内部的重复
+    std::mutex dbMutex;
+    std::unordered_set<uint64_t> pendingFileHashes;
+    PerceptualHashIndex pendingPhashes(dedupOptions_.maxHammingDistance);
+    int64_t pendingPhashId = 0;
+
+    // 第一级：读文件、查重、解码（多线程）
+    std::atomic<size_t> nextFile(0);
+    std::atomic<size_t> runningDecoders(decodeThreads);
+    auto decodeLoop = [&]() {
+        for (size_t i = nextFile++; i < imageFiles.size(); i = nextFile++) {
+            PendingImage item;
+            item.path = imageFiles[i];
+            try {
+                // 完全相同的文件在解码前跳过；感知哈希由解码结果计算，不再单独解码
+                bool duplicate = false;
+                if (dedupOptions_.enabled) {
+                    item.fileHash = hashFileContent(item.path);
+                    std::lock_guard<std::mutex> lock(dbMutex);
+                    duplicate = findDuplicateByHash(item.fileHash, 0) >= 0 ||
+                        (item.fileHash != 0 && pendingFileHashes.count(item.fileHash) > 0);
+                }
+
+                if (!duplicate) {
+                    item.image = cv::imread(item.path, cv::IMREAD_COLOR);
+                }
+                if (!duplicate && item.image.empty()) {
+                    std::cerr << "Failed to decode image: " << item.path << std::endl;
+                } else if (!duplicate && dedupOptions_.enabled) {
+                    if (dedupOptions_.maxHammingDistance >= 0) {
+                        item.phash = perceptualHash(item.image);
+                    }
+
+                    // 并发解码的相同文件都可能通过第一次检查，这里再比较一次文件哈希
+                    std::lock_guard<std::mutex> lock(dbMutex);
+                    duplicate = findDuplicateByHash(0, item.phash) >= 0 ||
+                        (item.fileHash != 0 && pendingFileHashes.count(item.fileHash) > 0);
+                    if (!duplicate && item.phash != 0 && !isLowInformationHash(item.phash)) {
+                        duplicate = pendingPhashes.findNearest(
+                            item.phash, dedupOptions_.maxHammingDistance) >= 0;
+                    }
+                    if (!duplicate) {
+                        if (item.fileHash != 0) {
+                            pendingFileHashes.insert(item.fileHash);
+                        }
+                        if (item.phash != 0 && !isLowInformationHash(item.phash)) {
+                            pendingPhashes.insert(pendingPhashId++, item.phash);
+                        }
+                    }
+                }
+
+                if (duplicate) {
+                    std::cout << "Skipping duplicate: " << item.path << std::endl;
+                    item.state = PendingImage::State::Duplicate;
+                    item.image.release();
+                } else if (!item.image.empty()) {
+                    item.width = item.image.cols;
+                    item.height = item.image.rows;
+                    item.state = PendingImage::State::Ready;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to read " << item.path << ": " << e.what() << std::endl;
+                item.state = PendingImage::State::Failed;
+                item.image.release();
+            }
+
+            if (!decoded.push(std::move(item))) {
+                break;
+            }
+        }
+        // 最后一个解码线程退出时通知下游
+        if (--runningDecoders == 0) {
+            decoded.close();
+        }
+    };
+
+    // 第二级：按批推理（单线程，ONNX Runtime 内部已多线程）
+    auto encodeBatch = [&](std::vector<PendingImage>& batch) {
+        std::vector<cv::Mat> images;
+        std::vector<size_t> slots;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i].state == PendingImage::State::Ready) {
+                images.push_back(batch[i].image);
+                slots.push_back(i);
+            }
+        }
+        if (images.empty()) {
+            return;
+        }
+
+        std::vector<float> features;
+        try {
+            features = encoder_->encodeImageBatchFlat(images);
+        } catch (const std::exception& e) {
+            std::cerr << "Batch inference failed, encoding one by one: " << e.what() << std::endl;
+        }
+
+        for (size_t j = 0; j < slots.size(); ++j) {
+            PendingImage& item = batch[slots[j]];
+            if (features.size() == slots.size() * dimension) {
+                item.features.assign(features.begin() + j * dimension,
+                                     features.begin() + (j + 1) * dimension);
+            } else {
+                // 整批失败时逐张编码，只丢弃出错的图像
+                try {
+                    item.features = encoder_->encodeImage(item.image);
+                } catch (const std::exception& e) {
+                    std::cerr << "Failed to extract features for " << item.path << ": "
+                              << e.what() << std::endl;
+                }
+            }
+            if (item.features.size() != dimension) {
+                item.state = PendingImage::State::Failed;
+            }
+            item.image.release();
+        }
+    };
+
+    auto encodeLoop = [&]() {
+        try {
+            std::vector<PendingImage> batch;
+            PendingImage item;
+            bool more = true;
+            while (more) {
+                more = decoded.pop(item);
+                if (more) {
+                    batch.push_back(std::move(item));
+                }
+                if (batch.size() >= batchSize || (!more && !batch.empty())) {
+                    encodeBatch(batch);
+                    if (!encoded.push(std::move(batch))) {
+                        break;
+                    }
+                    batch.clear();
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Import inference stage failed: " << e.what() << std::endl;
+            decoded.close();
+        }
+        encoded.close();
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(decodeThreads + 1);
+    for (size_t t = 0; t < decodeThreads; ++t) {
+        workers.emplace_back(decodeLoop);
+    }
+    workers.emplace_back(encodeLoop);
+
+    auto stopWorkers = [&]() {
+        decoded.close();
+        encoded.close();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    };
+
+    // 第三级：按批写入（调用线程），每 transactionRows 行提交一次
+    const size_t rowsPerTransaction = std::max<size_t>(storageOptions_.transactionRows, 1);
+    size_t pendingRows = 0;
     int current = 0;
     size_t successCount = 0;
+    try {
+        std::vector<PendingImage> batch;
+        std::vector<float> vectors;
+        std::vector<int64_t> ids;
+        while (encoded.pop(batch)) {
+            vectors.clear();
+            ids.clear();
+            {
+                std::lock_guard<std::mutex> lock(dbMutex);
+                beginTransaction();
+                for (PendingImage& item : batch) {
+                    if (item.state == PendingImage::State::Duplicate) {
+                        successCount++;
+                        continue;
+                    }
+                    if (item.state != PendingImage::State::Ready) {
+                        continue;
+                    }
+
+                    // 特征相似度查重需看到本批中已写入的图像，逐张加入索引
+                    const bool embeddingDedup = dedupOptions_.embeddingThreshold > 0.0f;
+                    if (embeddingDedup &&
+                        !faissIndex_.rangeSearch(item.features,
+                                                 dedupOptions_.embeddingThreshold, 1).empty()) {
+                        std::cout << "Skipping near-duplicate: " << item.path << std::endl;
+                        successCount++;
+                        continue;
+                    }
+
+                    int64_t imageId = insertRecord(item.path, "", "", item.width, item.height,
+                                                   item.fileHash, item.phash);
+                    if (imageId < 0) {
+                        continue;
+                    }
+                    if (embeddingDedup) {
+                        if (faissIndex_.add(item.features, imageId) < 0) {
+                            discardRecord(imageId);
+                            continue;
+                        }
+                    } else {
+                        vectors.insert(vectors.end(), item.features.begin(), item.features.end());
+                        ids.push_back(imageId);
+                    }
+                    successCount++;
+                    pendingRows++;
+                }
+                if (pendingRows >= rowsPerTransaction) {
+                    commitTransaction();
+                    pendingRows = 0;
+                }
+            }
 
-    for (const auto& imagePath : imageFiles) {
-        if (addImage(imagePath) >= 0) {
-            successCount++;
-        }
+            if (!ids.empty()) {
+                std::vector<int64_t> assigned;
+                if (!faissIndex_.addBatch(vectors.data(), ids.size(), assigned, ids.data())) {
+                    // 解码线程在 dbMutex 下查询感知哈希，撤销记录同样持锁
+                    std::lock_guard<std::mutex> lock(dbMutex);
+                    for (int64_t id : ids) {
+                        discardRecord(id);
+                    }
+                    successCount -= ids.size();
+                }
+            }
 
-        current++;
-        if (progress) {
-            progress(current, total);
+            current += static_cast<int>(batch.size());
+            if (progress) {
+                progress(current, total);
+            }
+        }
+        commitTransaction();
+    } catch (...) {
+        // 撤销未提交的记录，避免出现没有向量的记录（已加入索引的孤立向量在搜索时被跳过）
+        if (!sqlite3_get_autocommit(db_)) {
+            executeSql("ROLLBACK");
         }
+        stopWorkers();
+        throw;
     }
+    stopWorkers();
+
+    std::cout << "Imported " << successCount << " of " << total << " images using "
+              << decodeThreads << " decode thread(s)" << std::endl;
+
+    // 导入结束后写增量检查点（只写出新封存的段），同时清空增量日志
+    saveIndex();
 
     return successCount;
 }
 
 bool DatabaseManager::removeImage(int64_t id) {
     // 从数据库删除
-    sqlite3_stmt* stmt;
-    const char* sql = "DELETE FROM images WHERE id = ?";
-
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    StatementLease stmt(cachedStatement("DELETE FROM images WHERE id = ?"));
+    if (!stmt) {
         return false;
     }
 
     sqlite3_bind_int64(stmt, 1, id);
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
         return false;
     }
+    recordCache_.erase(id);
 
     // 从FAISS索引删除
     faissIndex_.remove(id);
+    perceptualHashes_.erase(id);
 
     return true;
 }
 
 size_t DatabaseManager::removeImageBatch(const std::vector<int64_t>& ids) {
-    size_t successCount = 0;
+    if (ids.empty()) {
+        return 0;
+    }
+
+    // 复用同一条预编译语句，并在单个事务内删除
+    StatementLease stmt(cachedStatement("DELETE FROM images WHERE id = ?"));
+    if (!stmt) {
+        return 0;
+    }
+
+    beginTransaction();
 
+    std::vector<int64_t> removed;
+    removed.reserve(ids.size());
     for (int64_t id : ids) {
-        if (removeImage(id)) {
-            successCount++;
+        sqlite3_bind_int64(stmt, 1, id);
+        const int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+
+        if (rc == SQLITE_DONE) {
+            removed.push_back(id);
+            perceptualHashes_.erase(id);
+            recordCache_.erase(id);
         }
     }
 
-    return successCount;
+    commitTransaction();
+
+    // 从FAISS索引批量删除（只标记删除位图，一次发布快照）
+    faissIndex_.removeBatch(removed);
+
+    return removed.size();
 }
 
 bool DatabaseManager::updateImage(int64_t id,
@@ -241,9 +777,8 @@ bool DatabaseManager::updateImage(int64_t id,
     }
     sql += " WHERE id = ?";
 
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    StatementLease stmt(cachedStatement(sql));
+    if (!stmt) {
         return false;
     }
 
@@ -256,57 +791,58 @@ bool DatabaseManager::updateImage(int64_t id,
     }
     sqlite3_bind_int64(stmt, bindIndex, id);
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    // 写入之后再使缓存失效（无论成功与否，下次读取以数据库为准）：
+    // 写入前已开始读取的读者读到的旧记录不会再放回缓存
+    const bool updated = sqlite3_step(stmt) == SQLITE_DONE;
+    recordCache_.erase(id);
+    if (!updated) {
+        return false;
+    }
 
-    return rc == SQLITE_DONE;
+    // 旧分类未知，分类过滤缓存全部失效
+    if (!category.empty()) {
+        std::lock_guard<std::mutex> lock(categoryFiltersMutex_);
+        categoryFilters_.clear();
+        categoryFiltersGeneration_++;
+    }
+    return true;
 }
 
 // ==================== 查询 ====================
 
 ImageRecord DatabaseManager::getById(int64_t id) {
     ImageRecord record;
+    if (recordCache_.get(id, record)) {
+        return record;
+    }
+    const uint64_t cacheVersion = recordCache_.version();
 
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT * FROM images WHERE id = ?";
-
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    StatementLease stmt(cachedStatement(
+        std::string("SELECT ") + kRecordColumns + " FROM images WHERE id = ?"));
+    if (!stmt) {
         return record;
     }
 
     sqlite3_bind_int64(stmt, 1, id);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        record.id = sqlite3_column_int64(stmt, 0);
-        const unsigned char* pathPtr = sqlite3_column_text(stmt, 1);
-        const unsigned char* namePtr = sqlite3_column_text(stmt, 2);
-        record.filePath = pathPtr ? reinterpret_cast<const char*>(pathPtr) : "";
-        record.fileName = namePtr ? reinterpret_cast<const char*>(namePtr) : "";
-
-        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        record.category = category ? category : "";
-
-        const char* desc = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        record.description = desc ? desc : "";
-
-        record.addTime = sqlite3_column_int64(stmt, 5);
-        record.width = sqlite3_column_int(stmt, 6);
-        record.height = sqlite3_column_int(stmt, 7);
+        record = readRecord(stmt);
+        recordCache_.put(record.id, record, cacheVersion);
     }
 
-    sqlite3_finalize(stmt);
     return record;
 }
 
 std::vector<ImageRecord> DatabaseManager::getByIds(const std::vector<int64_t>& ids) {
+    std::unordered_map<int64_t, ImageRecord> fetched = fetchRecords(ids);
+
+    // 按输入顺序输出（如搜索结果的分数顺序）
     std::vector<ImageRecord> records;
     records.reserve(ids.size());
-
     for (int64_t id : ids) {
-        ImageRecord record = getById(id);
-        if (record.id >= 0) {
-            records.push_back(record);
+        auto it = fetched.find(id);
+        if (it != fetched.end()) {
+            records.push_back(it->second);
         }
     }
 
@@ -316,11 +852,10 @@ std::vector<ImageRecord> DatabaseManager::getByIds(const std::vector<int64_t>& i
 std::vector<ImageRecord> DatabaseManager::listAll(int offset, int limit) {
     std::vector<ImageRecord> records;
 
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT * FROM images ORDER BY add_time DESC LIMIT ? OFFSET ?";
-
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    StatementLease stmt(cachedStatement(
+        std::string("SELECT ") + kRecordColumns +
+        " FROM images ORDER BY add_time DESC LIMIT ? OFFSET ?"));
+    if (!stmt) {
         return records;
     }
 
@@ -328,27 +863,9 @@ std::vector<ImageRecord> DatabaseManager::listAll(int offset, int limit) {
     sqlite3_bind_int(stmt, 2, offset);
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        ImageRecord record;
-        record.id = sqlite3_column_int64(stmt, 0);
-        const unsigned char* pathPtr = sqlite3_column_text(stmt, 1);
-        const unsigned char* namePtr = sqlite3_column_text(stmt, 2);
-        record.filePath = pathPtr ? reinterpret_cast<const char*>(pathPtr) : "";
-        record.fileName = namePtr ? reinterpret_cast<const char*>(namePtr) : "";
-
-        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        record.category = category ? category : "";
-
-        const char* desc = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        record.description = desc ? desc : "";
-
-        record.addTime = sqlite3_column_int64(stmt, 5);
-        record.width = sqlite3_column_int(stmt, 6);
-        record.height = sqlite3_column_int(stmt, 7);
-
-        records.push_back(record);
+        records.push_back(readRecord(stmt));
     }
 
-    sqlite3_finalize(stmt);
     return records;
 }
 
@@ -357,11 +874,10 @@ std::vector<ImageRecord> DatabaseManager::getByCategory(const std::string& categ
                                                        int limit) {
     std::vector<ImageRecord> records;
 
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT * FROM images WHERE category = ? ORDER BY add_time DESC LIMIT ? OFFSET ?";
-
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    StatementLease stmt(cachedStatement(
+        std::string("SELECT ") + kRecordColumns +
+        " FROM images WHERE category = ? ORDER BY add_time DESC LIMIT ? OFFSET ?"));
+    if (!stmt) {
         return records;
     }
 
@@ -370,27 +886,9 @@ std::vector<ImageRecord> DatabaseManager::getByCategory(const std::string& categ
     sqlite3_bind_int(stmt, 3, offset);
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        ImageRecord record;
-        record.id = sqlite3_column_int64(stmt, 0);
-        const unsigned char* pathPtr = sqlite3_column_text(stmt, 1);
-        const unsigned char* namePtr = sqlite3_column_text(stmt, 2);
-        record.filePath = pathPtr ? reinterpret_cast<const char*>(pathPtr) : "";
-        record.fileName = namePtr ? reinterpret_cast<const char*>(namePtr) : "";
-
-        const char* categoryPtr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        record.category = categoryPtr ? categoryPtr : "";
-
-        const char* desc = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        record.description = desc ? desc : "";
-
-        record.addTime = sqlite3_column_int64(stmt, 5);
-        record.width = sqlite3_column_int(stmt, 6);
-        record.height = sqlite3_column_int(stmt, 7);
-
-        records.push_back(record);
+        records.push_back(readRecord(stmt));
     }
 
-    sqlite3_finalize(stmt);
     return records;
 }
 
@@ -399,11 +897,10 @@ std::vector<ImageRecord> DatabaseManager::searchByFileName(const std::string& ke
                                                           int limit) {
     std::vector<ImageRecord> records;
 
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT * FROM images WHERE file_name LIKE ? ORDER BY add_time DESC LIMIT ? OFFSET ?";
-
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    StatementLease stmt(cachedStatement(
+        std::string("SELECT ") + kRecordColumns +
+        " FROM images WHERE file_name LIKE ? ORDER BY add_time DESC LIMIT ? OFFSET ?"));
+    if (!stmt) {
         return records;
     }
 
@@ -413,27 +910,9 @@ std::vector<ImageRecord> DatabaseManager::searchByFileName(const std::string& ke
     sqlite3_bind_int(stmt, 3, offset);
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        ImageRecord record;
-        record.id = sqlite3_column_int64(stmt, 0);
-        const unsigned char* pathPtr = sqlite3_column_text(stmt, 1);
-        const unsigned char* namePtr = sqlite3_column_text(stmt, 2);
-        record.filePath = pathPtr ? reinterpret_cast<const char*>(pathPtr) : "";
-        record.fileName = namePtr ? reinterpret_cast<const char*>(namePtr) : "";
-
-        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        record.category = category ? category : "";
-
-        const char* desc = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        record.description = desc ? desc : "";
-
-        record.addTime = sqlite3_column_int64(stmt, 5);
-        record.width = sqlite3_column_int(stmt, 6);
-        record.height = sqlite3_column_int(stmt, 7);
-
-        records.push_back(record);
+        records.push_back(readRecord(stmt));
     }
 
-    sqlite3_finalize(stmt);
     return records;
 }
 
@@ -482,32 +961,22 @@ std::vector<std::string> DatabaseManager::getAllCategories() {
 std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::searchByImage(
     const std::string& queryImagePath,
     int topK,
-    float threshold) {
+    float threshold,
+    const SearchFilter& filter,
+    float diversity) {
 
     // 提取查询图像特征
     std::vector<float> queryFeatures = extractFeatures(queryImagePath);
 
-    // FAISS搜索
-    auto searchResults = faissIndex_.search(queryFeatures, topK, threshold);
-
-    // 获取图像记录
-    std::vector<SearchResultWithRecord> results;
-    results.reserve(searchResults.size());
-
-    for (const auto& result : searchResults) {
-        ImageRecord record = getById(result.id);
-        if (record.id >= 0) {
-            results.emplace_back(record, result.score);
-        }
-    }
-
-    return results;
+    return searchWithFilter(queryFeatures, topK, threshold, filter, diversity);
 }
 
 std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::searchByText(
     const std::string& queryText,
     int topK,
-    float threshold) {
+    float threshold,
+    const SearchFilter& filter,
+    float diversity) {
 
     if (!encoder_) {
         throw std::runtime_error("Encoder not set");
@@ -516,61 +985,564 @@ std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::searchByTe
     // 编码文本
     std::vector<float> queryFeatures = encoder_->encodeText(queryText);
 
+    return searchWithFilter(queryFeatures, topK, threshold, filter, diversity);
+}
+
+std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::searchWithFilter(
+    const std::vector<float>& queryFeatures,
+    int topK,
+    float threshold,
+    const SearchFilter& filter,
+    float diversity) {
+
+    // 过滤条件编译为ID集合，在 FAISS 内部限定搜索范围（而非取回后再过滤）
+    FaissIndex::SearchParams params;
+    params.filter = compileFilter(filter);
+    if (params.filter && params.filter->empty()) {
+        return {};
+    }
+    if (diversity > 0.0f && diversity < 1.0f) {
+        params.mmrLambda = 1.0f - diversity;
+    }
+
     // FAISS搜索
-    auto searchResults = faissIndex_.search(queryFeatures, topK, threshold);
+    auto searchResults = faissIndex_.search(queryFeatures, topK, threshold, params);
+
+    return attachRecords(searchResults);
+}
+
+std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::searchById(
+    int64_t id,
+    int topK,
+    float threshold,
+    const SearchFilter& filter,
+    float diversity) {
+
+    std::vector<float> queryFeatures = faissIndex_.getVector(id);
+    if (queryFeatures.empty()) {
+        std::cerr << "No vector stored for image " << id << std::endl;
+        return {};
+    }
+
+    // 查询图像本身总是最相似的结果，多取一个再剔除
+    auto results = searchWithFilter(queryFeatures, topK + 1, threshold, filter, diversity);
+    results.erase(std::remove_if(results.begin(), results.end(),
+                                 [id](const SearchResultWithRecord& result) {
+                                     return result.record.id == id;
+                                 }),
+                  results.end());
+    if (results.size() > static_cast<size_t>(std::max(topK, 0))) {
+        results.erase(results.begin() + std::max(topK, 0), results.end());
+    }
+    return results;
+}
+
+std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::rangeSearch(
+    const std::vector<float>& queryFeatures,
+    float minScore,
+    int maxResults,
+    const SearchFilter& filter) {
+
+    FaissIndex::SearchParams params;
+    params.filter = compileFilter(filter);
+    if (params.filter && params.filter->empty()) {
+        return {};
+    }
+
+    // FAISS范围搜索：按阈值取回，不需要猜测 topK
+    auto searchResults = faissIndex_.rangeSearch(queryFeatures, minScore, maxResults, params);
+
+    return attachRecords(searchResults);
+}
+
+std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::rangeSearchByImage(
+    const std::string& queryImagePath,
+    float minScore,
+    int maxResults,
+    const SearchFilter& filter) {
+
+    // 提取查询图像特征
+    std::vector<float> queryFeatures = extractFeatures(queryImagePath);
+
+    return rangeSearch(queryFeatures, minScore, maxResults, filter);
+}
+
+std::vector<DatabaseManager::SearchResultWithRecord> DatabaseManager::attachRecords(
+    const std::vector<FaissIndex::SearchResult>& searchResults) {
 
-    // 获取图像记录
     std::vector<SearchResultWithRecord> results;
-    results.reserve(searchResults.size());
 
+    // 一次取回全部命中的图像记录，再按索引结果的顺序拼接
+    std::vector<int64_t> ids;
+    ids.reserve(searchResults.size());
+    for (const auto& result : searchResults) {
+        ids.push_back(result.id);
+    }
+    std::unordered_map<int64_t, ImageRecord> records = fetchRecords(ids);
+
+    results.reserve(searchResults.size());
     for (const auto& result : searchResults) {
-        ImageRecord record = getById(result.id);
-        if (record.id >= 0) {
-            results.emplace_back(record, result.score);
+        auto it = records.find(result.id);
+        if (it != records.end()) {
+            results.emplace_back(it->second, result.score);
         }
     }
 
     return results;
 }
 
-// ==================== 索引管理 ====================
+std::unordered_map<int64_t, ImageRecord> DatabaseManager::fetchRecords(
+    const std::vector<int64_t>& ids) {
 
-bool DatabaseManager::rebuildIndex(std::function<void(int, int)> progress) {
-    if (!encoder_) {
-        std::cerr << "Encoder not set" << std::endl;
-        return false;
+    std::unordered_map<int64_t, ImageRecord> records;
+    records.reserve(ids.size());
+
+    // 缓存命中的记录无需查询数据库
+    std::vector<int64_t> unique;
+    unique.reserve(ids.size());
+    ImageRecord cached;
+    for (int64_t id : ids) {
+        if (records.count(id) > 0) {
+            continue;
+        }
+        if (recordCache_.get(id, cached)) {
+            records.emplace(id, cached);
+        } else {
+            unique.push_back(id);
+        }
+    }
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    const uint64_t cacheVersion = recordCache_.version();
+
+    for (size_t offset = 0; offset < unique.size(); offset += kMaxIdsPerStatement) {
+        const size_t count = std::min(kMaxIdsPerStatement, unique.size() - offset);
+
+        // 参数个数取不小于 count 的 2 的幂，多出的位置重复最后一个ID，
+        // 缓存中只需保留少数几种长度的语句
+        size_t params = 1;
+        while (params < count) {
+            params *= 2;
+        }
+        std::string sql = std::string("SELECT ") + kRecordColumns + " FROM images WHERE id IN (?";
+        for (size_t i = 1; i < params; ++i) {
+            sql += ",?";
+        }
+        sql += ")";
+
+        StatementLease stmt(cachedStatement(sql));
+        if (!stmt) {
+            break;
+        }
+
+        for (size_t i = 0; i < params; ++i) {
+            const int64_t id = unique[offset + std::min(i, count - 1)];
+            sqlite3_bind_int64(stmt, static_cast<int>(i + 1), id);
+        }
+
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ImageRecord record = readRecord(stmt);
+            recordCache_.put(record.id, record, cacheVersion);
+            records.emplace(record.id, std::move(record));
+        }
+    }
+
+    return records;
+}
+
+std::shared_ptr<const IdFilter> DatabaseManager::compileFilter(const SearchFilter& filter) {
+    if (filter.empty()) {
+        return nullptr;
+    }
+
+    const bool categoryOnly = !filter.category.empty() &&
+                              filter.addedAfter == 0 && filter.addedBefore == 0 &&
+                              filter.minWidth == 0 && filter.maxWidth == 0 &&
+                              filter.minHeight == 0 && filter.maxHeight == 0;
+    uint64_t generation = 0;
+    if (categoryOnly) {
+        std::lock_guard<std::mutex> lock(categoryFiltersMutex_);
+        auto it = categoryFilters_.find(filter.category);
+        if (it != categoryFilters_.end()) {
+            return it->second;
+        }
+        generation = categoryFiltersGeneration_;
+    }
+
+    // 按条件拼接查询（category / add_time / width / height 上均可走索引或顺序扫描）
+    std::string sql = "SELECT id FROM images WHERE 1 = 1";
+    if (!filter.category.empty()) {
+        sql += " AND category = ?";
+    }
+    if (filter.addedAfter != 0) {
+        sql += " AND add_time >= ?";
+    }
+    if (filter.addedBefore != 0) {
+        sql += " AND add_time < ?";
+    }
+    if (filter.minWidth != 0) {
+        sql += " AND width >= ?";
+    }
+    if (filter.maxWidth != 0) {
+        sql += " AND width <= ?";
+    }
+    if (filter.minHeight != 0) {
+        sql += " AND height >= ?";
+    }
+    if (filter.maxHeight != 0) {
+        sql += " AND height <= ?";
+    }
+
+    sqlite3_stmt* stmt;
+    int rc = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        std::cerr << "Failed to compile search filter: " << sqlite3_errmsg(db_) << std::endl;
+        return std::make_shared<const IdFilter>();
+    }
+
+    int bindIndex = 1;
+    if (!filter.category.empty()) {
+        sqlite3_bind_text(stmt, bindIndex++, filter.category.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    if (filter.addedAfter != 0) {
+        sqlite3_bind_int64(stmt, bindIndex++, filter.addedAfter);
+    }
+    if (filter.addedBefore != 0) {
+        sqlite3_bind_int64(stmt, bindIndex++, filter.addedBefore);
+    }
+    if (filter.minWidth != 0) {
+        sqlite3_bind_int(stmt, bindIndex++, filter.minWidth);
+    }
+    if (filter.maxWidth != 0) {
+        sqlite3_bind_int(stmt, bindIndex++, filter.maxWidth);
+    }
+    if (filter.minHeight != 0) {
+        sqlite3_bind_int(stmt, bindIndex++, filter.minHeight);
+    }
+    if (filter.maxHeight != 0) {
+        sqlite3_bind_int(stmt, bindIndex++, filter.maxHeight);
+    }
+
+    std::vector<int64_t> ids;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    auto compiled = std::make_shared<const IdFilter>(std::move(ids));
+    if (categoryOnly) {
+        // 查询期间有写入使缓存失效时，查到的集合可能缺少新图像，只用于本次搜索
+        std::lock_guard<std::mutex> lock(categoryFiltersMutex_);
+        if (categoryFiltersGeneration_ == generation) {
+            categoryFilters_[filter.category] = compiled;
+        }
+    }
+    return compiled;
+}
+
+// ==================== 近重复检测 ====================
+
+int DatabaseManager::findDuplicates(float threshold, std::function<void(int, int)> progress) {
+    rebuildCancelled_ = false;
+
+    DuplicateFinder finder(faissIndex_, DuplicateFinder::Options(threshold));
+    auto clusters = finder.find([this, &finder, &progress](size_t done, size_t total) {
+        if (rebuildCancelled_) {
+            finder.cancel();
+        }
+        if (progress) {
+            progress(static_cast<int>(done), static_cast<int>(total));
+        }
+    });
+    if (finder.isCancelled() || finder.isFailed()) {
+        return -1;
+    }
+
+    // 整体替换上次结果；分组ID取组内最小的图像ID
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO duplicate_clusters (image_id, cluster_id, score) VALUES (?, ?, ?)";
+
+    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return -1;
+    }
+
+    sqlite3_exec(db_, "BEGIN", nullptr, nullptr, nullptr);
+    sqlite3_exec(db_, "DELETE FROM duplicate_clusters", nullptr, nullptr, nullptr);
+
+    bool ok = true;
+    for (const auto& cluster : clusters) {
+        for (size_t i = 0; i < cluster.size() && ok; ++i) {
+            sqlite3_bind_int64(stmt, 1, cluster.ids[i]);
+            sqlite3_bind_int64(stmt, 2, cluster.ids.front());
+            sqlite3_bind_double(stmt, 3, cluster.scores[i]);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    if (!ok) {
+        std::cerr << "Failed to store duplicate clusters: " << sqlite3_errmsg(db_) << std::endl;
+        sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+        return -1;
+    }
+    sqlite3_exec(db_, "COMMIT", nullptr, nullptr, nullptr);
+
+    return static_cast<int>(clusters.size());
+}
+
+std::vector<std::vector<ImageRecord>> DatabaseManager::getDuplicateClusters() {
+    std::vector<std::vector<ImageRecord>> clusters;
+
+    // 关联 images 表：已删除的图像自然排除
+    sqlite3_stmt* stmt;
+    const char* sql = R"(
+        SELECT d.cluster_id, d.image_id FROM duplicate_clusters d
+        JOIN images i ON i.id = d.image_id
+        ORDER BY d.cluster_id, d.image_id
+    )";
+
+    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return clusters;
+    }
+
+    std::vector<std::vector<int64_t>> clusterIds;
+    int64_t currentCluster = -1;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const int64_t clusterId = sqlite3_column_int64(stmt, 0);
+        if (clusterIds.empty() || clusterId != currentCluster) {
+            clusterIds.emplace_back();
+            currentCluster = clusterId;
+        }
+        clusterIds.back().push_back(sqlite3_column_int64(stmt, 1));
+    }
+
+    sqlite3_finalize(stmt);
+
+    for (const auto& ids : clusterIds) {
+        // 删除后只剩一张的分组不再算重复
+        if (ids.size() >= 2) {
+            clusters.push_back(getByIds(ids));
+        }
     }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const std::vector<ImageRecord>& a, const std::vector<ImageRecord>& b) {
+                         return a.size() > b.size();
+                     });
+
+    return clusters;
+}
+
+std::vector<ImageRecord> DatabaseManager::getDuplicatesOf(int64_t id) {
+    std::vector<int64_t> ids;
+
+    sqlite3_stmt* stmt;
+    const char* sql = R"(
+        SELECT d2.image_id FROM duplicate_clusters d1
+        JOIN duplicate_clusters d2 ON d2.cluster_id = d1.cluster_id
+        JOIN images i ON i.id = d2.image_id
+        WHERE d1.image_id = ? AND d2.image_id != ?
+        ORDER BY d2.score DESC
+    )";
+
+    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return {};
+    }
+
+    sqlite3_bind_int64(stmt, 1, id);
+    sqlite3_bind_int64(stmt, 2, id);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int64(stmt, 0));
+    }
+
+    sqlite3_finalize(stmt);
+
+    return getByIds(ids);
+}
 
-    // 清空现有索引
-    faissIndex_.clear();
+// ==================== 索引管理 ====================
+
+bool DatabaseManager::rebuildIndex(std::function<void(int, int)> progress, bool reencode) {
+    rebuildCancelled_ = false;
+
+    // 读取记录之前开始记录写入：构建期间的增删在换入新索引后重放，不会丢失
+    faissIndex_.beginRebuild();
 
     // 获取所有图像记录
     auto allRecords = listAll(0, totalCount());
-    int total = allRecords.size();
-    int current = 0;
+    const int total = static_cast<int>(allRecords.size());
+    const int dimension = faissIndex_.dimension();
 
+    // 已存的全精度向量直接取回到构建缓冲中（量化索引解码出的近似值不用于重建）
+    std::vector<int64_t> ids;
+    ids.reserve(allRecords.size());
     for (const auto& record : allRecords) {
-        try {
-            // 提取特征
-            std::vector<float> features = extractFeatures(record.filePath);
+        ids.push_back(record.id);
+    }
+    std::vector<float> vectors;
+    std::vector<char> found;
+    size_t reused = 0;
+    if (reencode) {
+        vectors.assign(ids.size() * dimension, 0.0f);
+        found.assign(ids.size(), 0);
+    } else {
+        reused = faissIndex_.getVectors(ids, vectors, found, true);
+    }
+    if (reused < allRecords.size() && !encoder_) {
+        std::cerr << "Encoder not set" << std::endl;
+        faissIndex_.endRebuild();
+        return false;
+    }
 
-            // 添加到索引
-            faissIndex_.add(features, record.id);
+    // 进度分两段：特征收集占前一半，构建占后一半
+    // 缺失的向量就地编码；编码失败的行被后续行覆盖，缓冲始终只有一份 N x dimension
+    std::vector<std::tuple<int64_t, int, int>> missingSizes;
+    std::vector<char> encoded;
+    encoded.reserve(allRecords.size());
+    size_t kept = 0;
+    int current = 0;
+    for (size_t i = 0; i < allRecords.size(); ++i) {
+        if (rebuildCancelled_) {
+            std::cout << "Index rebuild cancelled" << std::endl;
+            faissIndex_.endRebuild();
+            return false;
+        }
+        const ImageRecord& record = allRecords[i];
+        float* dst = vectors.data() + kept * dimension;
+        bool ok = false;
+        if (found[i]) {
+            if (kept != i) {
+                std::copy(vectors.begin() + i * dimension, vectors.begin() + (i + 1) * dimension, dst);
+            }
+            ok = true;
+            // 复用向量的图像不再解码，缺失的尺寸从文件头补齐
+            if (record.width <= 0 || record.height <= 0) {
+                int width = 0, height = 0;
+                getImageSize(record.filePath, width, height);
+                if (width > 0 && height > 0) {
+                    missingSizes.push_back({record.id, width, height});
+                }
+            }
+        } else {
+            try {
+                // 提取特征
+                std::vector<float> features = extractFeatures(record.filePath);
+                std::copy(features.begin(), features.end(), dst);
+                ok = true;
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to rebuild index for " << record.filePath
+                         << ": " << e.what() << std::endl;
+            }
+        }
+        if (ok) {
+            ids[kept] = record.id;
+            encoded.push_back(found[i] ? 0 : 1);
+            kept++;
+        }
 
-            current++;
-            if (progress) {
-                progress(current, total);
+        current++;
+        if (progress) {
+            progress(current, total * 2);
+        }
+    }
+    vectors.resize(kept * dimension);
+    ids.resize(kept);
+    std::cout << "Rebuilding index from " << ids.size() << " vectors (" << reused
+              << " reused from the vector store)" << std::endl;
+    updateImageSizes(missingSizes);
+
+    // 后台线程训练与构建，当前线程轮询进度，保证回调始终在调用线程上执行
+    IndexBuilder builder(dimension, faissIndex_.config());
+    auto pending = std::async(std::launch::async, [&builder, &vectors, &ids]() {
+        return builder.build(vectors.data(), ids.data(), ids.size());
+    });
+    while (pending.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+        if (rebuildCancelled_) {
+            builder.cancel();
+        }
+        if (progress) {
+            progress(total + static_cast<int>(builder.done()), total * 2);
+        }
+    }
+
+    std::unique_ptr<FaissIndex> built = pending.get();
+    if (!built) {
+        std::cout << "Index rebuild cancelled, keeping the current index" << std::endl;
+        faissIndex_.endRebuild();
+        return false;
+    }
+
+    // 只有新编码的向量需要写入向量存储：就地前移到缓冲头部后交给 adopt
+    size_t fresh = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (encoded[i]) {
+            if (fresh != i) {
+                std::copy(vectors.begin() + i * dimension, vectors.begin() + (i + 1) * dimension,
+                          vectors.begin() + fresh * dimension);
+                ids[fresh] = ids[i];
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Failed to rebuild index for " << record.filePath
-                     << ": " << e.what() << std::endl;
+            fresh++;
         }
     }
 
+    // 换入新索引，重放构建期间的写入，再写检查点
+    if (!faissIndex_.adopt(*built, vectors.data(), ids.data(), fresh)) {
+        faissIndex_.endRebuild();
+        return false;
+    }
+    if (progress) {
+        progress(total * 2, total * 2);
+    }
+
     // 保存索引
     return saveIndex();
 }
 
+void DatabaseManager::cancelRebuild() {
+    rebuildCancelled_ = true;
+}
+
+bool DatabaseManager::autoTuneIndex(float recallTarget, int k,
+                                    std::function<void(int, int)> progress) {
+    rebuildCancelled_ = false;
+
+    IndexTuner::Options options(recallTarget, k);
+    std::vector<float> vectors;
+    std::vector<int64_t> ids;
+    const size_t n = faissIndex_.sampleVectors(options.maxVectors, vectors, ids);
+    if (n == 0) {
+        std::cerr << "No vectors available for index tuning" << std::endl;
+        return false;
+    }
+
+    IndexTuner tuner(faissIndex_.dimension(), faissIndex_.config(), options);
+    IndexTuner::Result result = tuner.tune(vectors.data(), n, faissIndex_.size(),
+        [this, &tuner, &progress](size_t done, size_t total) {
+            if (rebuildCancelled_) {
+                tuner.cancel();
+            }
+            if (progress) {
+                progress(static_cast<int>(done), static_cast<int>(total));
+            }
+        });
+    if (result.trials.empty()) {
+        return false;
+    }
+
+    if (!IndexTuner::saveResult(IndexTuner::tuningPath(indexPath_), result)) {
+        return false;
+    }
+
+    // 类型不变时只更新默认搜索参数；类型变化时按新配置重建
+    const bool typeChanged = result.config.type != faissIndex_.config().type;
+    faissIndex_.setConfig(result.config);
+    return typeChanged ? rebuildIndex(progress) : true;
+}
+
 bool DatabaseManager::saveIndex() {
     return faissIndex_.save(indexPath_);
 }
@@ -594,6 +1566,119 @@ bool DatabaseManager::executeSql(const std::string& sql) {
     return true;
 }
 
+bool DatabaseManager::applyStorageOptions() {
+    std::string pragmas;
+    if (storageOptions_.walMode) {
+        pragmas += "PRAGMA journal_mode = WAL;";
+    }
+    pragmas += "PRAGMA synchronous = " + std::to_string(storageOptions_.synchronous) + ";";
+    // 负值表示以 KB 为单位
+    pragmas += "PRAGMA cache_size = -" + std::to_string(storageOptions_.cacheSizeKb) + ";";
+    pragmas += "PRAGMA mmap_size = " + std::to_string(storageOptions_.mmapSize) + ";";
+    pragmas += "PRAGMA temp_store = MEMORY;";
+    return executeSql(pragmas);
+}
+
+DatabaseManager::CachedStatement* DatabaseManager::cachedStatement(const std::string& sql) {
+    std::lock_guard<std::mutex> lock(statementsMutex_);
+    auto it = statements_.find(sql);
+    if (it != statements_.end()) {
+        return it->second.get();
+    }
+
+    sqlite3_stmt* stmt = nullptr;
+    int rc = sqlite3_prepare_v3(db_, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db_) << std::endl;
+        return nullptr;
+    }
+    auto cached = std::make_unique<CachedStatement>(stmt);
+    CachedStatement* result = cached.get();
+    statements_.emplace(sql, std::move(cached));
+    return result;
+}
+
+void DatabaseManager::beginTransaction() {
+    if (sqlite3_get_autocommit(db_)) {
+        executeSql("BEGIN TRANSACTION");
+    }
+}
+
+void DatabaseManager::commitTransaction() {
+    if (!sqlite3_get_autocommit(db_)) {
+        executeSql("COMMIT");
+    }
+}
+
+bool DatabaseManager::ensureColumn(const std::string& table, const std::string& column,
+                                   const std::string& type) {
+    sqlite3_stmt* stmt;
+    const std::string sql = "PRAGMA table_info(" + table + ")";
+
+    int rc = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return false;
+    }
+
+    bool found = false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        if (name && column == name) {
+            found = true;
+            break;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+
+    return found || executeSql("ALTER TABLE " + table + " ADD COLUMN " + column + " " + type);
+}
+
+int64_t DatabaseManager::findDuplicateByHash(uint64_t fileHash, uint64_t phash) {
+    // 文件内容完全相同：走 file_hash 索引
+    if (fileHash != 0) {
+        StatementLease stmt(cachedStatement("SELECT id FROM images WHERE file_hash = ? LIMIT 1"));
+        if (stmt) {
+            sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(fileHash));
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                return sqlite3_column_int64(stmt, 0);
+            }
+        }
+    }
+
+    // 视觉上近似（重新编码、缩放）：分段索引只比较至少一段相同的候选
+    if (phash == 0 || isLowInformationHash(phash) || dedupOptions_.maxHammingDistance < 0) {
+        return -1;
+    }
+    loadPerceptualHashes();
+    return perceptualHashes_.findNearest(phash, dedupOptions_.maxHammingDistance);
+}
+
+void DatabaseManager::loadPerceptualHashes() {
+    if (perceptualHashesLoaded_) {
+        return;
+    }
+    perceptualHashes_.reset(dedupOptions_.maxHammingDistance);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT id, phash FROM images WHERE phash IS NOT NULL";
+
+    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const uint64_t phash = static_cast<uint64_t>(sqlite3_column_int64(stmt, 1));
+        if (!isLowInformationHash(phash)) {
+            perceptualHashes_.insert(sqlite3_column_int64(stmt, 0), phash);
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    perceptualHashesLoaded_ = true;
+}
+
 std::vector<float> DatabaseManager::extractFeatures(const std::string& imagePath) {
     if (!encoder_) {
         throw std::runtime_error("Encoder not set");
@@ -602,7 +1687,42 @@ std::vector<float> DatabaseManager::extractFeatures(const std::string& imagePath
     return encoder_->encodeImage(imagePath);
 }
 
+std::vector<float> DatabaseManager::extractFeatures(const cv::Mat& image) {
+    if (!encoder_) {
+        throw std::runtime_error("Encoder not set");
+    }
+
+    return encoder_->encodeImage(image);
+}
+
+void DatabaseManager::updateImageSizes(const std::vector<std::tuple<int64_t, int, int>>& sizes) {
+    if (sizes.empty()) {
+        return;
+    }
+
+    StatementLease stmt(cachedStatement("UPDATE images SET width = ?, height = ? WHERE id = ?"));
+    if (!stmt) {
+        return;
+    }
+
+    beginTransaction();
+    for (const auto& size : sizes) {
+        sqlite3_bind_int(stmt, 1, std::get<1>(size));
+        sqlite3_bind_int(stmt, 2, std::get<2>(size));
+        sqlite3_bind_int64(stmt, 3, std::get<0>(size));
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        recordCache_.erase(std::get<0>(size));
+    }
+    commitTransaction();
+}
+
 void DatabaseManager::getImageSize(const std::string& imagePath, int& width, int& height) {
+    // 优先只读文件头，无法识别时才解码
+    if (readImageSize(imagePath, width, height)) {
+        return;
+    }
+
     cv::Mat image = cv::imread(imagePath);
     if (!image.empty()) {
         width = image.cols;
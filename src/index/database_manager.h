@@ -1,11 +1,21 @@
 #pragma once
 
 #include <sqlite3.h>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <functional>
+#include <tuple>
+#include <unordered_map>
 #include "faiss_index.h"
+#include "lru_cache.h"
+#include "phash_index.h"
+
+namespace cv {
+class Mat;
+}
 
 namespace vindex {
 
@@ -33,6 +43,76 @@ struct ImageRecord {
         : id(-1), addTime(0), width(0), height(0) {}
 };
 
+/**
+ * @brief 向量搜索的元数据过滤条件（各字段为空/0 表示不限）
+ */
+struct SearchFilter {
+    std::string category;     // 分类标签
+    int64_t addedAfter;       // 添加时间下界（含）
+    int64_t addedBefore;      // 添加时间上界（不含）
+    int minWidth;             // 最小宽度
+    int maxWidth;             // 最大宽度
+    int minHeight;            // 最小高度
+    int maxHeight;            // 最大高度
+
+    SearchFilter()
+        : addedAfter(0), addedBefore(0), minWidth(0), maxWidth(0), minHeight(0), maxHeight(0) {}
+
+    bool empty() const {
+        return category.empty() && addedAfter == 0 && addedBefore == 0 &&
+               minWidth == 0 && maxWidth == 0 && minHeight == 0 && maxHeight == 0;
+    }
+};
+
+/**
+ * @brief 入库查重选项
+ *
+ * 提取特征前先比较文件内容哈希与感知哈希，重新导入或复制的文件无需推理；
+ * 可选地在提取特征后再按特征相似度查重
+ */
+struct DedupOptions {
+    bool enabled;               // 是否按内容哈希查重
+    int maxHammingDistance;     // 感知哈希的最大汉明距离（<0 关闭感知哈希查重）
+    float embeddingThreshold;   // 特征相似度不低于该值时视为重复（0 = 关闭）
+
+    // 感知哈希近似会把不同图像判为重复并返回已有图像ID，默认关闭，只按文件内容查重
+    DedupOptions()
+        : enabled(true), maxHammingDistance(-1), embeddingThreshold(0.0f) {}
+};
+
+/**
+ * @brief SQLite 存储选项（需在 initialize() 之前设置）
+ *
+ * WAL 模式下提交只追加日志、读写互不阻塞，配合 NORMAL 同步级别
+ * 每次提交不再等待 fsync；批量入库按 transactionRows 行合并为一个事务
+ */
+struct StorageOptions {
+    bool walMode;               // 是否启用 WAL 日志模式
+    int synchronous;            // PRAGMA synchronous（0 = OFF，1 = NORMAL，2 = FULL）
+    int cacheSizeKb;            // 页缓存大小（KB）
+    int64_t mmapSize;           // 内存映射读取的字节数上限（0 = 关闭）
+    size_t transactionRows;     // 批量入库时每个事务写入的行数
+
+    StorageOptions()
+        : walMode(true), synchronous(1), cacheSizeKb(64 * 1024), mmapSize(256LL << 20)
+        , transactionRows(512) {}
+};
+
+/**
+ * @brief 批量导入流水线选项
+ *
+ * 导入分三级：多个解码线程（读文件、查重、解码）→ 推理线程（按批调用编码器）
+ * → 写入线程（按批写入 SQLite 与向量索引），各级之间为有界队列
+ */
+struct ImportOptions {
+    int decodeThreads;        // 解码线程数（0 = 处理器核数减一）
+    size_t batchSize;         // 每批推理与写入的图像数
+    size_t queueCapacity;     // 解码队列容量（限制已解码图像占用的内存）
+
+    ImportOptions()
+        : decodeThreads(0), batchSize(32), queueCapacity(128) {}
+};
+
 /**
  * @brief 图库数据库管理器
  *
@@ -40,9 +120,15 @@ struct ImageRecord {
  * - SQLite存储图像元数据
  * - FAISS存储图像特征向量
  * - 提供统一的增删改查接口
+ *
+ * 查询（搜索、按ID取记录、列表）可从多个线程并发调用：连接以串行化模式打开，
+ * 缓存语句与分类过滤缓存各自加锁。导入、删除、重建等写操作及选项设置需由
+ * 调用方串行化，不与其他写操作并发。
  */
 class DatabaseManager {
 public:
+    using RecordCacheStats = LruCache<int64_t, ImageRecord>::Stats;
+
     /**
      * @brief 构造函数
      * @param dbPath SQLite数据库路径
@@ -65,6 +151,38 @@ public:
      */
     void setEncoder(core::ClipEncoder* encoder);
 
+    /**
+     * @brief 设置向量索引类型（需在 initialize() 之前调用）
+     *
+     * 已有索引文件按文件中的类型加载，新配置在 rebuildIndex() 后生效
+     */
+    void setIndexConfig(const FaissIndex::IndexConfig& config);
+
+    /**
+     * @brief 设置入库查重选项
+     */
+    void setDedupOptions(const DedupOptions& options);
+
+    /**
+     * @brief 设置批量导入流水线选项
+     */
+    void setImportOptions(const ImportOptions& options);
+
+    /**
+     * @brief 设置 SQLite 存储选项（需在 initialize() 之前调用）
+     */
+    void setStorageOptions(const StorageOptions& options);
+
+    /**
+     * @brief 设置图像记录缓存容量（0 = 关闭缓存）
+     */
+    void setRecordCacheCapacity(size_t capacity);
+
+    /**
+     * @brief 图像记录缓存的命中统计
+     */
+    RecordCacheStats recordCacheStats() const { return recordCache_.stats(); }
+
     // ==================== 图库管理 ====================
 
     /**
@@ -72,7 +190,7 @@ public:
      * @param imagePath 图像文件路径
      * @param category 分类标签（可选）
      * @param description 描述（可选）
-     * @return 图像ID，失败返回-1
+     * @return 图像ID；与库中图像重复时不再入库，返回已有图像的ID；失败返回-1
      */
     int64_t addImage(const std::string& imagePath,
                     const std::string& category = "",
@@ -89,10 +207,13 @@ public:
 
     /**
      * @brief 从文件夹导入所有图像
+     *
+     * 按流水线并行解码、批量推理、批量写入（见 ImportOptions），
+     * 写入与进度回调在调用线程上执行
      * @param folderPath 文件夹路径
      * @param recursive 是否递归子文件夹
      * @param progress 进度回调 (current, total)
-     * @return 成功导入的数量
+     * @return 成功导入的数量（含跳过的重复图像）
      */
     size_t importFolder(const std::string& folderPath,
                        bool recursive = false,
@@ -126,12 +247,12 @@ public:
     // ==================== 查询 ====================
 
     /**
-     * @brief 根据ID查询图像记录
+     * @brief 根据ID查询图像记录（先查记录缓存）
      */
     ImageRecord getById(int64_t id);
 
     /**
-     * @brief 批量查询图像记录
+     * @brief 批量查询图像记录（按 IN 列表一次取回，按输入顺序返回，跳过不存在的ID）
      */
     std::vector<ImageRecord> getByIds(const std::vector<int64_t>& ids);
 
@@ -174,6 +295,8 @@ public:
      * @param queryImagePath 查询图像路径
      * @param topK 返回Top-K个结果
      * @param threshold 相似度阈值
+     * @param filter 元数据过滤条件（编译为ID集合后下推到 FAISS）
+     * @param diversity 结果多样性权重（0 = 关闭，越大越抑制相似结果，按 MMR 重排）
      * @return 搜索结果（图像记录 + 相似度分数）
      */
     struct SearchResultWithRecord {
@@ -187,28 +310,123 @@ public:
     std::vector<SearchResultWithRecord> searchByImage(
         const std::string& queryImagePath,
         int topK = 10,
-        float threshold = 0.0f);
+        float threshold = 0.0f,
+        const SearchFilter& filter = SearchFilter(),
+        float diversity = 0.0f);
 
     /**
      * @brief 文搜图
      * @param queryText 查询文本
      * @param topK 返回Top-K个结果
      * @param threshold 相似度阈值
+     * @param filter 元数据过滤条件
+     * @param diversity 结果多样性权重（0 = 关闭）
      * @return 搜索结果
      */
     std::vector<SearchResultWithRecord> searchByText(
         const std::string& queryText,
         int topK = 10,
-        float threshold = 0.0f);
+        float threshold = 0.0f,
+        const SearchFilter& filter = SearchFilter(),
+        float diversity = 0.0f);
+
+    /**
+     * @brief 以库内图像为查询搜索相似图像（直接取已存向量，无需解码与推理）
+     * @param id 查询图像ID
+     * @param topK 返回Top-K个结果（不含查询图像本身）
+     * @param threshold 相似度阈值
+     * @param filter 元数据过滤条件
+     * @param diversity 结果多样性权重（0 = 关闭）
+     * @return 搜索结果，ID不在索引中时返回空列表
+     */
+    std::vector<SearchResultWithRecord> searchById(
+        int64_t id,
+        int topK = 10,
+        float threshold = 0.0f,
+        const SearchFilter& filter = SearchFilter(),
+        float diversity = 0.0f);
+
+    /**
+     * @brief 范围搜索：返回相似度不低于 minScore 的全部图像（无需预估 topK）
+     * @param queryFeatures 查询特征向量
+     * @param minScore 最低相似度
+     * @param maxResults 最多返回数量（0 = 不限）
+     * @param filter 元数据过滤条件
+     * @return 搜索结果（按相似度降序）
+     */
+    std::vector<SearchResultWithRecord> rangeSearch(
+        const std::vector<float>& queryFeatures,
+        float minScore,
+        int maxResults = 0,
+        const SearchFilter& filter = SearchFilter());
+
+    /**
+     * @brief 以图像为查询的范围搜索（如查重、相似度告警）
+     * @param queryImagePath 查询图像路径
+     * @param minScore 最低相似度
+     * @param maxResults 最多返回数量（0 = 不限）
+     * @param filter 元数据过滤条件
+     * @return 搜索结果（按相似度降序）
+     */
+    std::vector<SearchResultWithRecord> rangeSearchByImage(
+        const std::string& queryImagePath,
+        float minScore,
+        int maxResults = 0,
+        const SearchFilter& filter = SearchFilter());
+
+    // ==================== 近重复检测 ====================
+
+    /**
+     * @brief 检测全库近重复图像并写入数据库（覆盖上次结果）
+     * @param threshold 相似度阈值（不低于该值视为重复）
+     * @param progress 进度回调 (current, total)
+     * @return 近重复分组数，失败或取消返回 -1
+     */
+    int findDuplicates(float threshold = 0.95f,
+                       std::function<void(int, int)> progress = nullptr);
+
+    /**
+     * @brief 获取上次检测出的近重复分组（已删除的图像不再出现）
+     * @return 每组的图像记录（组内按ID升序，组按成员数降序）
+     */
+    std::vector<std::vector<ImageRecord>> getDuplicateClusters();
+
+    /**
+     * @brief 获取与指定图像同组的近重复图像
+     */
+    std::vector<ImageRecord> getDuplicatesOf(int64_t id);
 
     // ==================== 索引管理 ====================
 
     /**
      * @brief 重建索引
+     *
+     * 向量优先取自向量存储，只对缺失的图像提取特征；再在后台线程上用 IndexBuilder
+     * 训练并构建新索引（单个段），完成后原子换入；重建期间现有索引继续提供搜索与写入，
+     * 期间的增删在换入后重放。取消时保持不变。
+     * @param progress 进度回调 (current, total)，在调用线程上执行
+     * @param reencode 忽略已存向量，全部重新提取特征（更换模型后使用）
+     * @return 是否重建成功（取消返回 false）
+     */
+    bool rebuildIndex(std::function<void(int, int)> progress = nullptr, bool reencode = false);
+
+    /**
+     * @brief 取消进行中的重建、调优或查重（可从进度回调或其他线程调用）
+     */
+    void cancelRebuild();
+
+    /**
+     * @brief 按目标召回率自动选择索引类型与搜索参数
+     *
+     * 从现有向量中采样调优（见 IndexTuner），结果保存到 <indexPath>.tune，
+     * 之后每次初始化时读取。默认搜索参数立即生效；选中的索引类型与当前不同时重建索引。
+     * @param recallTarget 目标 recall@k
+     * @param k 评估的 Top-K
      * @param progress 进度回调 (current, total)
-     * @return 是否重建成功
+     * @return 是否成功
      */
-    bool rebuildIndex(std::function<void(int, int)> progress = nullptr);
+    bool autoTuneIndex(float recallTarget = 0.95f, int k = 10,
+                       std::function<void(int, int)> progress = nullptr);
 
     /**
      * @brief 保存索引到文件
@@ -241,16 +459,97 @@ private:
      */
     bool executeSql(const std::string& sql);
 
+    /**
+     * @brief 按存储选项设置 PRAGMA（日志模式、同步级别、缓存与内存映射）
+     */
+    bool applyStorageOptions();
+
+    /**
+     * @brief 缓存的预编译语句
+     *
+     * 同一语句同一时刻只能由一个调用方绑定与执行，经 StatementLease 加锁使用
+     */
+    struct CachedStatement {
+        sqlite3_stmt* stmt;     // 预编译语句（归缓存所有，不可 finalize）
+        std::mutex mutex;       // 独占使用
+
+        explicit CachedStatement(sqlite3_stmt* stmt_) : stmt(stmt_) {}
+    };
+
+    class StatementLease;
+
+    /**
+     * @brief 取缓存的预编译语句（首次使用时编译）
+     *
+     * 返回值交给 StatementLease 加锁使用，离开作用域时复位
+     * @return 编译失败返回 nullptr
+     */
+    CachedStatement* cachedStatement(const std::string& sql);
+
+    /**
+     * @brief 开始写事务（已在事务中时不做任何事）
+     */
+    void beginTransaction();
+
+    /**
+     * @brief 提交当前写事务（不在事务中时不做任何事）
+     */
+    void commitTransaction();
+
+    /**
+     * @brief 表中缺少该列时追加（旧数据库升级）
+     */
+    bool ensureColumn(const std::string& table, const std::string& column,
+                      const std::string& type);
+
+    /**
+     * @brief 按内容哈希查找重复图像
+     * @param fileHash 文件内容哈希（0 表示无）
+     * @param phash 感知哈希（0 表示无）
+     * @return 重复图像的ID，未找到返回-1
+     */
+    int64_t findDuplicateByHash(uint64_t fileHash, uint64_t phash);
+
+    /**
+     * @brief 首次使用时从数据库读入感知哈希
+     */
+    void loadPerceptualHashes();
+
+    /**
+     * @brief 插入图像记录（不写向量索引）
+     * @return 新记录ID，失败返回-1
+     */
+    int64_t insertRecord(const std::string& imagePath,
+                         const std::string& category,
+                         const std::string& description,
+                         int width, int height,
+                         uint64_t fileHash, uint64_t phash);
+
+    /**
+     * @brief 撤销 insertRecord() 插入的记录（向量未能写入索引时调用）
+     */
+    void discardRecord(int64_t id);
+
     /**
      * @brief 提取图像特征
      */
     std::vector<float> extractFeatures(const std::string& imagePath);
 
     /**
-     * @brief 获取图像尺寸
+     * @brief 由已解码的图像提取特征
+     */
+    std::vector<float> extractFeatures(const cv::Mat& image);
+
+    /**
+     * @brief 获取图像尺寸（优先读文件头，无需解码）
      */
     void getImageSize(const std::string& imagePath, int& width, int& height);
 
+    /**
+     * @brief 批量写入图像尺寸 (id, width, height)，单个事务
+     */
+    void updateImageSizes(const std::vector<std::tuple<int64_t, int, int>>& sizes);
+
     /**
      * @brief 扫描文件夹中的图像文件
      */
@@ -262,12 +561,51 @@ private:
      */
     bool isSupportedImageFormat(const std::string& filePath);
 
+    /**
+     * @brief 将过滤条件编译为ID集合（仅分类条件时使用缓存）
+     * @return 无过滤条件时返回 nullptr
+     */
+    std::shared_ptr<const IdFilter> compileFilter(const SearchFilter& filter);
+
+    /**
+     * @brief 在过滤范围内搜索并取回图像记录（diversity 介于 0 和 1 之间时按 MMR 多样化）
+     */
+    std::vector<SearchResultWithRecord> searchWithFilter(const std::vector<float>& queryFeatures,
+                                                         int topK,
+                                                         float threshold,
+                                                         const SearchFilter& filter,
+                                                         float diversity = 0.0f);
+
+    /**
+     * @brief 按索引结果的顺序取回图像记录（跳过已不存在的记录）
+     */
+    std::vector<SearchResultWithRecord> attachRecords(
+        const std::vector<FaissIndex::SearchResult>& searchResults);
+
+    /**
+     * @brief 批量取回图像记录（先查记录缓存，其余按 WHERE id IN (...) 查询，每条语句最多 512 个ID）
+     * @return ID -> 记录（不存在的ID不出现）
+     */
+    std::unordered_map<int64_t, ImageRecord> fetchRecords(const std::vector<int64_t>& ids);
+
 private:
     sqlite3* db_;                              // SQLite数据库连接
     FaissIndex faissIndex_;                    // FAISS向量索引
     std::string dbPath_;                       // 数据库文件路径
     std::string indexPath_;                    // 索引文件路径
     core::ClipEncoder* encoder_;               // CLIP编码器（不拥有）
+    std::unordered_map<std::string, std::shared_ptr<const IdFilter>> categoryFilters_;  // 分类 -> ID集合缓存
+    std::mutex categoryFiltersMutex_;          // 保护 categoryFilters_ 与 categoryFiltersGeneration_
+    uint64_t categoryFiltersGeneration_;       // 分类过滤缓存失效次数（编译期间失效过则不写回）
+    std::atomic<bool> rebuildCancelled_;       // 重建取消请求
+    DedupOptions dedupOptions_;                // 入库查重选项
+    PerceptualHashIndex perceptualHashes_;     // 图像ID -> 感知哈希（分段索引，延迟加载）
+    bool perceptualHashesLoaded_;              // 感知哈希是否已加载
+    ImportOptions importOptions_;              // 批量导入流水线选项
+    StorageOptions storageOptions_;            // SQLite 存储选项
+    std::unordered_map<std::string, std::unique_ptr<CachedStatement>> statements_;  // SQL -> 预编译语句缓存
+    std::mutex statementsMutex_;               // 保护 statements_
+    LruCache<int64_t, ImageRecord> recordCache_;  // 图像记录 LRU 缓存（写入数据库后失效，按版本回填）
 
     static const std::vector<std::string> supportedFormats_;
 };
@@ -0,0 +1,332 @@
+#include "delta_log.h"
+#include "file_utils.h"
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+constexpr char kMagic[4] = {'V', 'X', 'W', 'L'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+
+constexpr uint32_t kRecordAdd = 1;
+constexpr uint32_t kRecordRemove = 2;
+
+struct LogHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t reserved;
+};
+static_assert(sizeof(LogHeader) == kHeaderSize, "unexpected header size");
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t count;
+};
+
+/**
+ * @brief FNV-1a 校验和（用于识别写了一半的尾部记录）
+ */
+uint32_t checksum(uint32_t hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+constexpr uint32_t kChecksumSeed = 2166136261u;
+
+} // namespace
+
+DeltaLog::DeltaLog(int dimension)
+    : dimension_(dimension)
+    , file_(nullptr)
+    , bytes_(0)
+{
+}
+
+DeltaLog::~DeltaLog() {
+    close();
+}
+
+bool DeltaLog::open(const std::string& path) {
+    close();
+    path_ = path;
+
+    std::error_code ec;
+    if (!fs::exists(fs::u8path(path), ec) || fs::file_size(fs::u8path(path), ec) < kHeaderSize) {
+        file_ = openFile(path, "w+b");
+        if (!file_) {
+            std::cerr << "Failed to create delta log: " << path << std::endl;
+            return false;
+        }
+        if (!writeHeader(file_)) {
+            close();
+            return false;
+        }
+        bytes_ = kHeaderSize;
+        return true;
+    }
+
+    file_ = openFile(path, "r+b");
+    if (!file_) {
+        std::cerr << "Failed to open delta log: " << path << std::endl;
+        return false;
+    }
+
+    LogHeader header;
+    if (std::fread(&header, sizeof(header), 1, file_) != 1 ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.dimension != static_cast<uint32_t>(dimension_)) {
+        std::cerr << "Invalid delta log or dimension mismatch: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    bytes_ = static_cast<size_t>(fs::file_size(fs::u8path(path), ec));
+    return true;
+}
+
+void DeltaLog::close() {
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+    bytes_ = 0;
+}
+
+int64_t DeltaLog::replay(const AddHandler& onAdd, const RemoveHandler& onRemove) {
+    if (!file_) {
+        return -1;
+    }
+
+    std::error_code ec;
+    const size_t fileBytes = static_cast<size_t>(fs::file_size(fs::u8path(path_), ec));
+    std::fseek(file_, static_cast<long>(kHeaderSize), SEEK_SET);
+    size_t goodBytes = kHeaderSize;
+    int64_t records = 0;
+
+    std::vector<int64_t> ids;
+    std::vector<float> vectors;
+    for (;;) {
+        RecordHeader record;
+        if (std::fread(&record, sizeof(record), 1, file_) != 1) {
+            break;
+        }
+        if (record.type != kRecordAdd && record.type != kRecordRemove) {
+            break;
+        }
+
+        const size_t n = record.count;
+        const size_t floats = record.type == kRecordAdd ? n * dimension_ : 0;
+        const size_t recordBytes =
+            sizeof(record) + n * sizeof(int64_t) + floats * sizeof(float) + sizeof(uint32_t);
+        if (goodBytes + recordBytes > fileBytes) {
+            break;
+        }
+
+        ids.resize(n);
+        if (std::fread(ids.data(), sizeof(int64_t), n, file_) != n) {
+            break;
+        }
+        vectors.resize(floats);
+        if (std::fread(vectors.data(), sizeof(float), floats, file_) != floats) {
+            break;
+        }
+
+        uint32_t stored = 0;
+        if (std::fread(&stored, sizeof(stored), 1, file_) != 1) {
+            break;
+        }
+        uint32_t hash = checksum(kChecksumSeed, &record, sizeof(record));
+        hash = checksum(hash, ids.data(), n * sizeof(int64_t));
+        hash = checksum(hash, vectors.data(), floats * sizeof(float));
+        if (hash != stored) {
+            break;
+        }
+
+        if (record.type == kRecordAdd) {
+            onAdd(ids.data(), vectors.data(), n);
+        } else {
+            onRemove(ids.data(), n);
+        }
+        goodBytes += recordBytes;
+        records++;
+    }
+
+    // 截掉崩溃时写了一半的尾部记录，后续追加从完整记录之后开始
+    bytes_ = goodBytes;
+    if (goodBytes < fileBytes) {
+        std::cerr << "Discarding torn tail of delta log: " << path_ << std::endl;
+        if (!discardTail()) {
+            return -1;
+        }
+    }
+    return records;
+}
+
+bool DeltaLog::appendAdd(const int64_t* ids, const float* vectors, size_t n) {
+    return appendRecord(kRecordAdd, ids, vectors, n);
+}
+
+bool DeltaLog::appendRemove(const int64_t* ids, size_t n) {
+    return appendRecord(kRecordRemove, ids, nullptr, n);
+}
+
+bool DeltaLog::sync() {
+    return file_ && syncFile(file_);
+}
+
+bool DeltaLog::truncate() {
+    if (!file_) {
+        return false;
+    }
+
+    std::fclose(file_);
+    file_ = openFile(path_, "w+b");
+    if (!file_) {
+        std::cerr << "Failed to truncate delta log: " << path_ << std::endl;
+        bytes_ = 0;
+        return false;
+    }
+    if (!writeHeader(file_)) {
+        close();
+        return false;
+    }
+    bytes_ = kHeaderSize;
+    return sync();
+}
+
+bool DeltaLog::rewrite(const int64_t* ids, const float* vectors, size_t n) {
+    if (!file_) {
+        return false;
+    }
+    if (n == 0) {
+        return truncate();
+    }
+
+    const std::string tmpPath = path_ + ".tmp";
+    std::FILE* tmp = openFile(tmpPath, "w+b");
+    if (!tmp) {
+        std::cerr << "Failed to rewrite delta log: " << tmpPath << std::endl;
+        return false;
+    }
+    const bool written = writeHeader(tmp) && writeRecord(tmp, kRecordAdd, ids, vectors, n);
+    std::fclose(tmp);
+    std::error_code ec;
+    if (!written) {
+        std::cerr << "Failed to rewrite delta log: " << tmpPath << std::endl;
+        fs::remove(fs::u8path(tmpPath), ec);
+        return false;
+    }
+    const size_t currentBytes = bytes_;
+    const size_t writtenBytes = kHeaderSize + recordBytes(kRecordAdd, n);
+
+    // 先关闭原日志再替换（Windows 不能覆盖已打开的文件）
+    std::fclose(file_);
+    file_ = nullptr;
+    const bool replaced = replaceFile(tmpPath, path_);
+    if (!replaced) {
+        fs::remove(fs::u8path(tmpPath), ec);
+    }
+
+    file_ = openFile(path_, "r+b");
+    if (!file_) {
+        std::cerr << "Failed to reopen delta log: " << path_ << std::endl;
+        bytes_ = 0;
+        return false;
+    }
+    bytes_ = replaced ? writtenBytes : currentBytes;
+    return replaced;
+}
+
+// ==================== 私有方法 ====================
+
+bool DeltaLog::writeHeader(std::FILE* file) const {
+    LogHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.dimension = static_cast<uint32_t>(dimension_);
+    header.reserved = 0;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fflush(file) != 0) {
+        std::cerr << "Failed to write delta log header: " << path_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DeltaLog::writeRecord(std::FILE* file, uint32_t type, const int64_t* ids,
+                           const float* vectors, size_t n) const {
+    RecordHeader record;
+    record.type = type;
+    record.count = static_cast<uint32_t>(n);
+    const size_t floats = type == kRecordAdd ? n * dimension_ : 0;
+
+    uint32_t hash = checksum(kChecksumSeed, &record, sizeof(record));
+    hash = checksum(hash, ids, n * sizeof(int64_t));
+    hash = checksum(hash, vectors, floats * sizeof(float));
+
+    return std::fwrite(&record, sizeof(record), 1, file) == 1 &&
+           std::fwrite(ids, sizeof(int64_t), n, file) == n &&
+           std::fwrite(vectors, sizeof(float), floats, file) == floats &&
+           std::fwrite(&hash, sizeof(hash), 1, file) == 1 &&
+           std::fflush(file) == 0;
+}
+
+size_t DeltaLog::recordBytes(uint32_t type, size_t n) const {
+    const size_t floats = type == kRecordAdd ? n * dimension_ : 0;
+    return sizeof(RecordHeader) + n * sizeof(int64_t) + floats * sizeof(float) + sizeof(uint32_t);
+}
+
+bool DeltaLog::appendRecord(uint32_t type, const int64_t* ids, const float* vectors, size_t n) {
+    if (!file_) {
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+
+    // 文件尾恒为最后一条完整记录之后（写失败时由 discardTail() 截回）
+    if (std::fseek(file_, 0, SEEK_END) != 0 || !writeRecord(file_, type, ids, vectors, n)) {
+        std::cerr << "Failed to append to delta log: " << path_ << std::endl;
+        discardTail();
+        return false;
+    }
+
+    bytes_ += recordBytes(type, n);
+    return true;
+}
+
+bool DeltaLog::discardTail() {
+    // 写了一半的记录若留在文件尾，之后追加的记录会排在它后面，回放时在它处停止而一并丢失
+    const size_t goodBytes = bytes_;
+    std::fclose(file_);   // 关闭时残留的缓冲可能再写出一部分，随后一并截掉
+    file_ = nullptr;
+
+    std::error_code ec;
+    fs::resize_file(fs::u8path(path_), goodBytes, ec);
+    if (!ec) {
+        file_ = openFile(path_, "r+b");
+    }
+    if (!file_) {
+        // 无法恢复到完整记录边界：关闭日志，之后的写入全部失败
+        std::cerr << "Failed to restore delta log, disabling further writes: " << path_ << std::endl;
+        bytes_ = 0;
+        return false;
+    }
+    bytes_ = goodBytes;
+    return true;
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 向量增量日志（预写日志）
+ *
+ * 记录上次保存索引之后的增删操作，加载索引后回放，保证崩溃后索引
+ * 与元数据库一致，无需频繁全量重写索引文件。
+ * 文件布局：16字节头部 + 记录序列，每条记录为
+ *   [类型 u32][数量 u32][ID × n][向量 × n × dimension（仅添加）][校验和 u32]
+ * 回放时遇到不完整或校验失败的记录即停止，并截掉该尾部。
+ */
+class DeltaLog {
+public:
+    using AddHandler = std::function<void(const int64_t* ids, const float* vectors, size_t n)>;
+    using RemoveHandler = std::function<void(const int64_t* ids, size_t n)>;
+
+    /**
+     * @brief 构造函数
+     * @param dimension 向量维度
+     */
+    explicit DeltaLog(int dimension);
+    ~DeltaLog();
+
+    DeltaLog(const DeltaLog&) = delete;
+    DeltaLog& operator=(const DeltaLog&) = delete;
+
+    /**
+     * @brief 打开日志文件（不存在时创建）
+     * @param path 日志文件路径
+     * @return 是否成功
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief 关闭日志
+     */
+    void close();
+
+    bool isOpen() const { return file_ != nullptr; }
+
+    /**
+     * @brief 按顺序回放日志中的记录
+     * @return 回放的记录数，打开失败返回 -1
+     */
+    int64_t replay(const AddHandler& onAdd, const RemoveHandler& onRemove);
+
+    /**
+     * @brief 追加添加记录（写入后刷出用户态缓冲，进程崩溃不丢失）
+     */
+    bool appendAdd(const int64_t* ids, const float* vectors, size_t n);
+
+    /**
+     * @brief 追加删除记录
+     */
+    bool appendRemove(const int64_t* ids, size_t n);
+
+    /**
+     * @brief 刷到磁盘（fsync），掉电后仍可回放
+     */
+    bool sync();
+
+    /**
+     * @brief 清空日志（索引已完整保存后调用）
+     */
+    bool truncate();
+
+    /**
+     * @brief 以一条添加记录重写日志（索引已保存、只剩增量缓冲未落入段时调用）
+     *
+     * 先写临时文件再原子替换，崩溃时保留完整的旧日志或新日志
+     * @param ids 增量缓冲中的ID
+     * @param vectors n x dimension 行主序向量
+     * @param n 向量数量（0 时等同于 truncate()）
+     * @return 是否成功（失败时原日志保持不变）
+     */
+    bool rewrite(const int64_t* ids, const float* vectors, size_t n);
+
+    /**
+     * @brief 日志文件字节数
+     */
+    size_t bytes() const { return bytes_; }
+
+    const std::string& path() const { return path_; }
+
+private:
+    bool writeHeader(std::FILE* file) const;
+    bool writeRecord(std::FILE* file, uint32_t type, const int64_t* ids,
+                     const float* vectors, size_t n) const;
+    size_t recordBytes(uint32_t type, size_t n) const;
+    bool appendRecord(uint32_t type, const int64_t* ids, const float* vectors, size_t n);
+
+    /**
+     * @brief 把文件截回 bytes_（最后一条完整记录之后）
+     * @return 失败时日志已关闭，之后的写入全部失败
+     */
+    bool discardTail();
+
+private:
+    int dimension_;       // 向量维度
+    std::string path_;    // 日志文件路径
+    std::FILE* file_;     // 日志文件（追加写）
+    size_t bytes_;        // 当前文件字节数
+};
+
+} // namespace index
+} // namespace vindex
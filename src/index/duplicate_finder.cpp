@@ -0,0 +1,176 @@
+#include "duplicate_finder.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+/**
+ * @brief 并查集（路径减半 + 按大小合并）
+ */
+struct DisjointSets {
+    std::vector<size_t> parent;
+    std::vector<size_t> size;
+
+    /**
+     * @brief 新增一个单元素集合，返回其下标
+     */
+    size_t add() {
+        parent.push_back(parent.size());
+        size.push_back(1);
+        return parent.size() - 1;
+    }
+
+    size_t find(size_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    void unite(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return;
+        }
+        if (size[a] < size[b]) {
+            std::swap(a, b);
+        }
+        parent[b] = a;
+        size[a] += size[b];
+    }
+};
+
+} // namespace
+
+DuplicateFinder::DuplicateFinder(const FaissIndex& index, const Options& options)
+    : index_(index)
+    , options_(options)
+    , cancelled_(false)
+    , failed_(false)
+{
+}
+
+std::vector<DuplicateFinder::Cluster> DuplicateFinder::find(const ProgressCallback& progress) {
+    failed_ = false;
+    const size_t total = index_.size();
+    if (total < 2) {
+        return {};
+    }
+
+    // 只常驻ID与并查集；向量按批从向量存储读取或由索引解码，不整体复制
+    std::vector<int64_t> ids;
+    std::unordered_map<int64_t, size_t> rowOf;
+    rowOf.reserve(total);
+    DisjointSets sets;
+    std::vector<float> best;
+    auto rowFor = [&](int64_t id) {
+        auto inserted = rowOf.emplace(id, ids.size());
+        if (inserted.second) {
+            ids.push_back(id);
+            sets.add();
+            best.push_back(-std::numeric_limits<float>::infinity());
+        }
+        return inserted.first->second;
+    };
+
+    const size_t batchSize = std::max<size_t>(options_.batchSize, 1);
+    size_t scanned = 0;
+    size_t edges = 0;
+
+    const bool completed = index_.scanVectors(batchSize, [&](const float* vectors,
+                                                             const int64_t* batchIds,
+                                                             size_t count) {
+        if (cancelled_) {
+            return false;
+        }
+
+        // 自身总在结果中，多取一个近邻
+        auto results = index_.searchBatch(vectors, count, options_.maxNeighbors + 1,
+                                          options_.threshold);
+
+        for (size_t q = 0; q < results.size(); ++q) {
+            const size_t i = rowFor(batchIds[q]);
+            for (const auto& result : results[q]) {
+                if (result.id == batchIds[q]) {
+                    continue;
+                }
+                const size_t j = rowFor(result.id);
+                sets.unite(i, j);
+                best[i] = std::max(best[i], result.score);
+                best[j] = std::max(best[j], result.score);
+                edges++;
+            }
+        }
+
+        scanned += count;
+        if (progress) {
+            progress(std::min(scanned, total), total);
+        }
+        return true;
+    });
+
+    if (!completed) {
+        failed_ = true;
+        std::cerr << "Duplicate detection failed: vectors could not be read" << std::endl;
+        return {};
+    }
+    if (cancelled_) {
+        std::cout << "Duplicate detection cancelled after " << scanned << " of " << total
+                  << " vectors" << std::endl;
+        return {};
+    }
+    const size_t n = ids.size();
+
+    // 连通分量即近重复分组（只保留至少两个成员的分量）
+    std::unordered_map<size_t, size_t> clusterOf;
+    std::vector<Cluster> clusters;
+    for (size_t i = 0; i < n; ++i) {
+        const size_t root = sets.find(i);
+        if (sets.size[root] < 2) {
+            continue;
+        }
+        auto inserted = clusterOf.emplace(root, clusters.size());
+        if (inserted.second) {
+            clusters.emplace_back();
+        }
+        Cluster& cluster = clusters[inserted.first->second];
+        cluster.ids.push_back(ids[i]);
+        cluster.scores.push_back(best[i]);
+    }
+
+    for (auto& cluster : clusters) {
+        // 按ID升序排列成员与分数
+        std::vector<size_t> order(cluster.ids.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&cluster](size_t a, size_t b) {
+            return cluster.ids[a] < cluster.ids[b];
+        });
+        Cluster sorted;
+        sorted.ids.reserve(order.size());
+        sorted.scores.reserve(order.size());
+        for (size_t k : order) {
+            sorted.ids.push_back(cluster.ids[k]);
+            sorted.scores.push_back(cluster.scores[k]);
+        }
+        cluster = std::move(sorted);
+    }
+    std::sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.size() != b.size() ? a.size() > b.size() : a.ids.front() < b.ids.front();
+    });
+
+    std::cout << "Found " << clusters.size() << " duplicate cluster(s) from " << edges
+              << " neighbor edge(s) among " << n << " vectors (threshold "
+              << options_.threshold << ")" << std::endl;
+    return clusters;
+}
+
+} // namespace index
+} // namespace vindex
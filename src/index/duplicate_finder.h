@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "faiss_index.h"
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 近重复检测（全库批量自搜索）
+ *
+ * 按批遍历索引中的向量，每批作为查询对索引自身做阈值近邻搜索，得到相似度
+ * 不低于阈值的近邻图；批内查询由 FAISS 的 OpenMP 并行、各段并发扫描，
+ * 最后用并查集求连通分量，每个分量即一组近重复图像。
+ *
+ * 向量按批取自向量存储或由索引解码（见 FaissIndex::scanVectors），常驻内存的
+ * 只有ID与并查集；任一向量无法读取时报错，不会静默跳过。
+ */
+class DuplicateFinder {
+public:
+    using ProgressCallback = std::function<void(size_t done, size_t total)>;
+
+    /**
+     * @brief 检测选项
+     */
+    struct Options {
+        float threshold;      // 相似度阈值（不低于该值视为重复）
+        int maxNeighbors;     // 每张图像最多考察的近邻数
+        size_t batchSize;     // 每批查询数
+
+        Options(float threshold_ = 0.95f)
+            : threshold(threshold_), maxNeighbors(32), batchSize(1024) {}
+    };
+
+    /**
+     * @brief 一组近重复图像
+     */
+    struct Cluster {
+        std::vector<int64_t> ids;     // 成员ID（升序，首个作为代表）
+        std::vector<float> scores;    // 各成员与组内其他成员的最高相似度
+
+        size_t size() const { return ids.size(); }
+    };
+
+    /**
+     * @brief 构造函数
+     * @param index 待检测的索引
+     * @param options 检测选项
+     */
+    explicit DuplicateFinder(const FaissIndex& index, const Options& options = Options());
+
+    /**
+     * @brief 执行检测
+     * @param progress 进度回调（每批完成后调用，可选）
+     * @return 近重复分组（按成员数降序），被取消或向量无法读取时返回空列表
+     */
+    std::vector<Cluster> find(const ProgressCallback& progress = nullptr);
+
+    /**
+     * @brief 请求取消（在当前批次结束后生效）
+     */
+    void cancel() { cancelled_ = true; }
+
+    bool isCancelled() const { return cancelled_; }
+
+    /**
+     * @brief 上次检测是否因向量无法读取而失败
+     */
+    bool isFailed() const { return failed_; }
+
+private:
+    const FaissIndex& index_;         // 待检测的索引
+    Options options_;                 // 检测选项
+    std::atomic<bool> cancelled_;     // 取消请求
+    bool failed_;                     // 上次检测失败
+};
+
+} // namespace index
+} // namespace vindex
@@ -1,304 +1,1501 @@
 #include "faiss_index.h"
+#include "file_utils.h"
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/index_factory.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/io.h>
+#include <faiss/utils/distances.h>
 #include <algorithm>
-#include <set>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <unordered_set>
 #include <iostream>
 
+namespace fs = std::filesystem;
+
 namespace vindex {
 namespace index {
 
-FaissIndex::FaissIndex(int dimension, bool useGPU)
-    : dimension_(dimension)
-    , nextId_(0)
-    , useGPU_(useGPU)
-{
-    // 创建基础L2索引（用于归一化向量，L2距离等价于余弦距离）
-    baseIndex_ = std::make_unique<faiss::IndexFlatL2>(dimension);
+namespace {
 
-    // 使用IDMap包装以支持自定义ID
-    index_ = std::make_unique<faiss::IndexIDMap>(baseIndex_.get());
+// FAISS 建议每个聚类中心至少 39 个训练样本
+constexpr size_t kMinPointsPerCentroid = 39;
+// PQ/SQ 子量化器的聚类中心数
+constexpr size_t kQuantizerCentroids = 256;
+// 训练采样的随机种子（保证可复现）
+constexpr unsigned kTrainSeed = 1234;
+// 增量缓冲每块的行数
+constexpr size_t kDeltaChunkRows = 1024;
+// 已训练索引的增量缓冲达到该行数时封存为段（段越小，段数与重复合并越多）
+constexpr size_t kDeltaSealRows = 65536;
+// 保存时增量缓冲不足该行数则不封存，留在增量日志中（避免频繁保存产生大量小段）
+constexpr size_t kSaveSealRows = 4096;
+// 删除位图每块的位数（写时复制的粒度）
+constexpr size_t kBitmapBlockBits = 65536;
+// 分层合并的扇入：同层积累该数量的段时合并为一个
+constexpr size_t kCompactionFanIn = 4;
+// 通用合并路径每批重新添加的行数
+constexpr size_t kMergeBatchRows = 4096;
+// 无法搬运编码的类型（HNSW 等）合并需重建，存活行超过该值的段不再参与分层合并
+constexpr size_t kMaxRebuildMergeRows = 1 << 20;
+// 检查点清单文件头
+constexpr char kManifestMagic[4] = {'V', 'X', 'M', 'F'};
+constexpr uint32_t kManifestVersion = 1;
+
+struct ManifestHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t segmentCount;
+    int64_t nextId;
+};
+
+/**
+ * @brief 段序号在进程内全局分配
+ *
+ * 另行构建的索引（如后台重建）换入后，其段文件名不会与已保存的段冲突
+ */
+std::atomic<uint64_t> gNextSegmentSeq{1};
+
+uint64_t allocateSegmentSeq() {
+    return gNextSegmentSeq.fetch_add(1);
 }
 
-FaissIndex::~FaissIndex() {
-    // IndexIDMap不拥有baseIndex_，需要手动管理
-    // unique_ptr会自动释放
+/**
+ * @brief 保证之后分配的段序号大于 seq（加载已保存的段后调用）
+ */
+void reserveSegmentSeq(uint64_t seq) {
+    uint64_t current = gNextSegmentSeq.load();
+    while (current <= seq && !gNextSegmentSeq.compare_exchange_weak(current, seq + 1)) {
+    }
 }
 
-// ==================== 索引管理 ====================
+// MMR 多样化默认取 topK 的该倍数作为候选
+constexpr int kMmrFetchFactor = 4;
+// 不支持范围搜索的索引类型以该 K 起步倍增
+constexpr int kRangeSearchInitialK = 64;
 
-bool FaissIndex::load(const std::string& indexPath) {
-    try {
-        // 读取索引文件
-        faiss::Index* loadedIndex = faiss::read_index(indexPath.c_str());
-
-        // 检查是否是IDMap类型
-        faiss::IndexIDMap* idMapIndex = dynamic_cast<faiss::IndexIDMap*>(loadedIndex);
-        if (!idMapIndex) {
-            delete loadedIndex;
-            std::cerr << "Error: Loaded index is not an IndexIDMap" << std::endl;
-            return false;
+// ID过滤集合不超过该数量时逐个计算距离，不走近似搜索（选择性过滤下近似搜索召回率低）
+constexpr size_t kFilterBruteForceIds = 4096;
+
+/**
+ * @brief 持有一次搜索所需的 FAISS 搜索参数
+ */
+struct FaissSearchParameters {
+    faiss::SearchParameters plain;
+    faiss::SearchParametersIVF ivf;
+    faiss::SearchParametersHNSW hnsw;
+    faiss::IndexRefineSearchParameters refine;
+    const faiss::SearchParameters* active = nullptr;
+    bool filtered = false;    // 选择器已下推到索引内核
+};
+
+/**
+ * @brief 行过滤选择器：跳过删除位图中置位的行，有ID过滤器时只保留集合内的行
+ *
+ * 搜索内部索引时 FAISS 传入的是行号，经段的 id_map 换算为ID后查询过滤器
+ */
+template <typename Bitmap>
+struct LiveRowSelector : faiss::IDSelector {
+    const Bitmap& deleted;
+    const faiss::idx_t* ids;
+    const IdFilter* filter;
+
+    LiveRowSelector(const Bitmap& deleted_, const faiss::idx_t* ids_, const IdFilter* filter_)
+        : deleted(deleted_), ids(ids_), filter(filter_) {}
+
+    bool is_member(faiss::idx_t row) const override {
+        return !deleted.test(static_cast<size_t>(row)) && (!filter || filter->contains(ids[row]));
+    }
+};
+
+/**
+ * @brief 将 SearchParams 翻译为对应索引类型的 FAISS 搜索参数
+ * @param sel 行选择器（可选），索引类型支持时下推到搜索内核
+ */
+void buildSearchParameters(const faiss::Index* base,
+                           const FaissIndex::SearchParams& params,
+                           const faiss::IDSelector* sel,
+                           FaissSearchParameters& out) {
+    if (params.nprobe <= 0 && params.efSearch <= 0 && params.refineFactor <= 0.0f && !sel) {
+        return;
+    }
+
+    // 精排包装下，nprobe / efSearch / 选择器作用于内部的压缩索引
+    auto* refine = dynamic_cast<const faiss::IndexRefine*>(base);
+    const faiss::Index* searched = refine ? refine->base_index : base;
+    faiss::SearchParameters* inner = nullptr;
+
+    if (auto* ivf = dynamic_cast<const faiss::IndexIVF*>(searched)) {
+        if (params.nprobe > 0 || params.efSearch > 0 || sel) {
+            out.ivf.nprobe = params.nprobe > 0 ? params.nprobe : ivf->nprobe;
+            // IVF 的粗量化器为 HNSW 时（如 "IVF65536_HNSW32,PQ64"），efSearch 作用于量化器
+            if (params.efSearch > 0 && dynamic_cast<const faiss::IndexHNSW*>(ivf->quantizer)) {
+                out.hnsw.efSearch = params.efSearch;
+                out.ivf.quantizer_params = &out.hnsw;
+            }
+            inner = &out.ivf;
+        }
+    } else if (auto* hnsw = dynamic_cast<const faiss::IndexHNSW*>(searched)) {
+        if (params.efSearch > 0 || sel) {
+            out.hnsw.efSearch = params.efSearch > 0 ? params.efSearch : hnsw->hnsw.efSearch;
+            inner = &out.hnsw;
         }
+    } else if (sel && dynamic_cast<const faiss::IndexFlat*>(searched)) {
+        inner = &out.plain;
+    }
 
-        // 检查维度是否匹配
-        if (idMapIndex->d != dimension_) {
-            delete loadedIndex;
-            std::cerr << "Error: Index dimension mismatch. Expected: "
-                     << dimension_ << ", Got: " << idMapIndex->d << std::endl;
-            return false;
+    // 其余类型（PQ / SQ 等扁平编码）不支持选择器，由调用方多取候选后过滤
+    if (sel && inner) {
+        inner->sel = const_cast<faiss::IDSelector*>(sel);
+        out.filtered = true;
+    }
+
+    if (refine) {
+        out.refine.k_factor = params.refineFactor > 0.0f ? params.refineFactor : refine->k_factor;
+        out.refine.base_index_params = inner;
+        out.active = &out.refine;
+    } else {
+        out.active = inner;
+    }
+}
+
+/**
+ * @brief 估算索引占用的字节数
+ * @param mapped 输出：其中来自文件映射（mmap 倒排表）的部分
+ */
+size_t estimateIndexBytes(const faiss::Index* index, bool invlistsMapped, size_t& mapped) {
+    if (!index) {
+        return 0;
+    }
+
+    if (auto* idMap = dynamic_cast<const faiss::IndexIDMap*>(index)) {
+        return idMap->id_map.size() * sizeof(faiss::idx_t) +
+               estimateIndexBytes(idMap->index, invlistsMapped, mapped);
+    }
+    if (auto* refine = dynamic_cast<const faiss::IndexRefine*>(index)) {
+        return estimateIndexBytes(refine->base_index, invlistsMapped, mapped) +
+               estimateIndexBytes(refine->refine_index, invlistsMapped, mapped);
+    }
+    if (auto* flatCodes = dynamic_cast<const faiss::IndexFlatCodes*>(index)) {
+        return flatCodes->codes.size();
+    }
+    if (auto* ivf = dynamic_cast<const faiss::IndexIVF*>(index)) {
+        size_t listBytes = 0;
+        if (ivf->invlists) {
+            for (size_t i = 0; i < ivf->invlists->nlist; ++i) {
+                listBytes += ivf->invlists->list_size(i) *
+                             (ivf->invlists->code_size + sizeof(faiss::idx_t));
+            }
+        }
+        if (invlistsMapped) {
+            mapped += listBytes;
         }
+        return listBytes + estimateIndexBytes(ivf->quantizer, invlistsMapped, mapped);
+    }
+    if (auto* hnsw = dynamic_cast<const faiss::IndexHNSW*>(index)) {
+        return hnsw->hnsw.neighbors.size() * sizeof(int) +
+               hnsw->hnsw.levels.size() * sizeof(int) +
+               hnsw->hnsw.offsets.size() * sizeof(size_t) +
+               estimateIndexBytes(hnsw->storage, invlistsMapped, mapped);
+    }
 
-        // IndexIDMap 默认拥有内部索引，避免 double-free：将所有权转移给 baseIndex_
-        auto* flatIndex = dynamic_cast<faiss::IndexFlatL2*>(idMapIndex->index);
-        if (!flatIndex) {
-            delete loadedIndex;
-            std::cerr << "Error: Loaded index base type is not IndexFlatL2" << std::endl;
-            return false;
+    // 未知类型：按原始 float 向量估算
+    return static_cast<size_t>(index->ntotal) * index->d * sizeof(float);
+}
+
+/**
+ * @brief 段搜索线程池：进程内共享，线程数固定
+ *
+ * 段数与并发查询数增加时任务排队，不新建线程
+ */
+class SegmentWorkers {
+public:
+    explicit SegmentWorkers(size_t count) : stopping_(false) {
+        for (size_t i = 0; i < count; ++i) {
+            threads_.emplace_back([this] { loop(); });
+        }
+    }
+
+    ~SegmentWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
         }
+        cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
 
-        // 由 baseIndex_ 管理内部索引生命周期，IndexIDMap 不再删除它
-        idMapIndex->own_fields = false;
-        baseIndex_.reset(flatIndex);
-        index_.reset(idMapIndex);
+    size_t size() const { return threads_.size(); }
 
-        // 更新nextId_（找到最大ID + 1）
-        nextId_ = 0;
-        idSet_.clear();
-        if (index_->ntotal > 0) {
-            // IndexIDMap 存储 id_map，直接读取以恢复 nextId_ 与集合
-            for (faiss::idx_t id : idMapIndex->id_map) {
-                idSet_.insert(static_cast<int64_t>(id));
-                nextId_ = std::max(nextId_, static_cast<int64_t>(id) + 1);
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void loop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
             }
+            task();
         }
+    }
 
-        std::cout << "Loaded index with " << size() << " vectors" << std::endl;
-        return true;
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_;
+};
 
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to load index: " << e.what() << std::endl;
-        return false;
-    }
+/**
+ * @brief 段搜索线程池（首次使用时创建，调用线程也参与搜索，故少开一个线程）
+ */
+SegmentWorkers& segmentWorkers() {
+    static SegmentWorkers workers(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return workers;
 }
 
-bool FaissIndex::save(const std::string& indexPath) const {
-    try {
-        faiss::write_index(index_.get(), indexPath.c_str());
-        std::cout << "Saved index with " << size() << " vectors to "
-                 << indexPath << std::endl;
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to save index: " << e.what() << std::endl;
-        return false;
+/**
+ * @brief 合并时能否直接搬运编码（扁平编码 / 倒排），否则需取回原始向量重建（HNSW 等）
+ */
+bool mergesByCodes(const faiss::Index* index) {
+    if (auto* refine = dynamic_cast<const faiss::IndexRefine*>(index)) {
+        index = refine->base_index;
     }
+    return dynamic_cast<const faiss::IndexFlatCodes*>(index) != nullptr ||
+           dynamic_cast<const faiss::IndexIVF*>(index) != nullptr;
 }
 
-void FaissIndex::clear() {
-    // 重新创建索引
-    baseIndex_ = std::make_unique<faiss::IndexFlatL2>(dimension_);
-    index_ = std::make_unique<faiss::IndexIDMap>(baseIndex_.get());
-    nextId_ = 0;
-    idSet_.clear();
+/**
+ * @brief 两个倒排索引的粗量化器是否相同（编码只能在同一组聚类中心之间搬运）
+ */
+bool sameQuantizer(const faiss::Index* a, const faiss::Index* b) {
+    if (a == b) {
+        return true;
+    }
+    if (auto* hnswA = dynamic_cast<const faiss::IndexHNSW*>(a)) {
+        auto* hnswB = dynamic_cast<const faiss::IndexHNSW*>(b);
+        return hnswB && sameQuantizer(hnswA->storage, hnswB->storage);
+    }
+    auto* flatA = dynamic_cast<const faiss::IndexFlatCodes*>(a);
+    auto* flatB = dynamic_cast<const faiss::IndexFlatCodes*>(b);
+    return flatA && flatB && flatA->code_size == flatB->code_size &&
+           flatA->codes.size() == flatB->codes.size() &&
+           std::memcmp(flatA->codes.data(), flatB->codes.data(), flatA->codes.size()) == 0;
 }
 
-// ==================== 向量操作 ====================
 
-int64_t FaissIndex::add(const std::vector<float>& vector, int64_t id) {
-    validateVector(vector);
+/**
+ * @brief 倒排索引各行所在的 (桶, 桶内偏移)；非倒排索引返回空表
+ *
+ * 未建立直接映射的 IVF 无法按行号 reconstruct，按桶内偏移解码不依赖直接映射
+ */
+std::vector<std::pair<int64_t, int64_t>> ivfRowOffsets(const faiss::Index* index, size_t rows) {
+    std::vector<std::pair<int64_t, int64_t>> offsets;
+    auto* ivf = dynamic_cast<const faiss::IndexIVF*>(index);
+    if (!ivf) {
+        return offsets;
+    }
+    offsets.assign(rows, std::make_pair(int64_t(-1), int64_t(-1)));
+    for (size_t list = 0; list < ivf->nlist; ++list) {
+        const size_t listSize = ivf->invlists->list_size(list);
+        if (listSize == 0) {
+            continue;
+        }
+        faiss::InvertedLists::ScopedIds listIds(ivf->invlists, list);
+        for (size_t e = 0; e < listSize; ++e) {
+            offsets[static_cast<size_t>(listIds[e])] =
+                std::make_pair(static_cast<int64_t>(list), static_cast<int64_t>(e));
+        }
+    }
+    return offsets;
+}
 
-    // 如果未指定ID，自动生成
-    if (id < 0) {
-        id = generateNewId();
+/**
+ * @brief 解码内部索引的一行（倒排索引需传入 ivfRowOffsets() 的结果）
+ * @throws std::exception 无法解码时
+ */
+void reconstructRow(const faiss::Index* index, size_t row,
+                    const std::vector<std::pair<int64_t, int64_t>>& offsets, float* out) {
+    if (offsets.empty()) {
+        index->reconstruct(static_cast<faiss::idx_t>(row), out);
+        return;
+    }
+    if (offsets[row].first < 0) {
+        throw std::runtime_error("row " + std::to_string(row) + " not found in inverted lists");
     }
+    static_cast<const faiss::IndexIVF*>(index)->reconstruct_from_offset(
+        offsets[row].first, offsets[row].second, out);
+}
 
-    // 添加到索引
-    index_->add_with_ids(1, vector.data(), &id);
-    idSet_.insert(id);
+} // namespace
 
-    return id;
+// ==================== 快照 ====================
+
+bool FaissIndex::DeletedRows::test(size_t row) const {
+    const size_t b = row / kBitmapBlockBits;
+    if (b >= blocks.size() || !blocks[b]) {
+        return false;
+    }
+    const size_t bit = row % kBitmapBlockBits;
+    return ((*blocks[b])[bit / 64] >> (bit % 64)) & 1;
 }
 
-void FaissIndex::addBatch(const std::vector<std::vector<float>>& vectors,
-                         std::vector<int64_t>& ids,
-                         const std::vector<int64_t>* inputIds) {
-    if (vectors.empty()) {
-        ids.clear();
-        return;
+bool FaissIndex::DeletedRows::set(size_t row) {
+    if (test(row)) {
+        return false;
     }
 
-    // 验证所有向量
-    for (const auto& vec : vectors) {
-        validateVector(vec);
+    const size_t b = row / kBitmapBlockBits;
+    if (b >= blocks.size()) {
+        blocks.resize(b + 1);
+    }
+    // 已发布的块被多个快照共享，写时复制；未发布的块独占，可直接修改
+    if (!blocks[b]) {
+        blocks[b] = std::make_shared<std::vector<uint64_t>>(kBitmapBlockBits / 64, 0);
+    } else if (blocks[b].use_count() > 1) {
+        blocks[b] = std::make_shared<std::vector<uint64_t>>(*blocks[b]);
     }
 
-    // 准备数据
-    const size_t n = vectors.size();
-    std::vector<float> flatVectors(n * dimension_);
+    const size_t bit = row % kBitmapBlockBits;
+    (*blocks[b])[bit / 64] |= uint64_t(1) << (bit % 64);
+    count++;
+    return true;
+}
 
-    for (size_t i = 0; i < n; ++i) {
-        std::copy(vectors[i].begin(), vectors[i].end(),
-                 flatVectors.begin() + i * dimension_);
+FaissIndex::DeltaChunk::DeltaChunk(int dimension)
+    : vectors(new float[kDeltaChunkRows * dimension])
+    , ids(new int64_t[kDeltaChunkRows])
+{
+}
+
+const float* FaissIndex::Snapshot::deltaVector(size_t row, int dimension) const {
+    return chunks[row / kDeltaChunkRows]->vectors.get() + (row % kDeltaChunkRows) * dimension;
+}
+
+int64_t FaissIndex::Snapshot::deltaId(size_t row) const {
+    return chunks[row / kDeltaChunkRows]->ids[row % kDeltaChunkRows];
+}
+
+size_t FaissIndex::Snapshot::size() const {
+    size_t total = deltaRows - deltaDeleted.count;
+    for (const auto& view : segments) {
+        total += view.liveRows();
     }
+    return total;
+}
 
-    // 准备ID
-    ids.resize(n);
-    if (inputIds && inputIds->size() == n) {
-        ids = *inputIds;
-    } else {
-        for (size_t i = 0; i < n; ++i) {
-            ids[i] = generateNewId();
+const FaissIndex::SegmentView* FaissIndex::Snapshot::findSegment(uint64_t seq) const {
+    for (const auto& view : segments) {
+        if (view.segment->seq == seq) {
+            return &view;
         }
     }
+    return nullptr;
+}
 
-    // 批量添加
-    index_->add_with_ids(n, flatVectors.data(), ids.data());
-    idSet_.insert(ids.begin(), ids.end());
+FaissIndex::FaissIndex(int dimension, bool useGPU)
+    : FaissIndex(dimension, IndexConfig(), useGPU)
+{
 }
 
-bool FaissIndex::remove(int64_t id) {
+FaissIndex::FaissIndex(int dimension, const IndexConfig& config, bool useGPU)
+    : dimension_(dimension)
+    , config_(config)
+    , useGPU_(useGPU)
+    , nextId_(0)
+    , recordingRebuild_(false)
+    , locationsReady_(true)
+    , replaying_(false)
+    , compactPending_(false)
+    , stopping_(false)
+{
+    resetSnapshot();
+}
+
+FaissIndex::~FaissIndex() {
+    // 通知后台合并线程退出（进行中的合并会先完成）
+    {
+        std::lock_guard<std::mutex> lock(compactMutex_);
+        stopping_ = true;
+    }
+    compactCv_.notify_all();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+}
+
+// ==================== 索引管理 ====================
+
+bool FaissIndex::load(const std::string& indexPath) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
     try {
-        faiss::IDSelectorBatch selector(1, &id);
-        size_t removedCount = index_->remove_ids(selector);
-        if (removedCount > 0) {
-            idSet_.erase(id);
+        // 检查点清单：各段分别加载
+        if (isCheckpointManifest(indexPath)) {
+            std::shared_ptr<Snapshot> next = loadCheckpoint(indexPath);
+            if (!next) {
+                return false;
+            }
+            return finishLoad(next);
         }
-        return removedCount > 0;
+
+        // 读取索引文件（mmap 模式下倒排表直接映射文件，不拷贝到堆内存）
+        const int ioFlags = config_.mmap ? (faiss::IO_FLAG_MMAP | faiss::IO_FLAG_READ_ONLY) : 0;
+        std::unique_ptr<faiss::IndexIDMap> index = readIndexFile(indexPath, ioFlags);
+        if (!index) {
+            return false;
+        }
+
+        auto next = std::make_shared<Snapshot>();
+        next->store = snapshot()->store;
+        next->innerProduct = index->metric_type == faiss::METRIC_INNER_PRODUCT;
+
+        // 更新nextId_（找到最大ID + 1）
+        nextId_ = 0;
+        if (!index->id_map.empty()) {
+            nextId_ = *std::max_element(index->id_map.begin(), index->id_map.end()) + 1;
+        }
+
+        // 训练前落盘的暂存向量以 Flat 形式保存，若配置要求训练则放回增量缓冲继续等待
+        if (dynamic_cast<faiss::IndexFlat*>(index->index) && config_.type != "Flat") {
+            std::unique_ptr<faiss::IndexIDMap> fresh = createIndex();
+            const size_t n = static_cast<size_t>(index->ntotal);
+            if (!fresh->is_trained && n < requiredTrainSize(fresh.get())) {
+                const float* xb = static_cast<faiss::IndexFlat*>(index->index)->get_xb();
+                appendDelta(*next, xb, index->id_map.data(), n);
+                next->innerProduct = fresh->metric_type == faiss::METRIC_INNER_PRODUCT;
+                next->trained = false;
+                next->emptyIndex = std::move(fresh);
+                index.reset();
+            }
+        }
+
+        if (index) {
+            // 空索引模板在首次封存时再由该段派生
+            auto segment = std::make_shared<Segment>();
+            segment->seq = allocateSegmentSeq();
+            // 仅倒排类索引支持映射，其余类型已完整读入内存
+            if (config_.mmap && dynamic_cast<faiss::IndexIVF*>(index->index)) {
+                segment->mappedPath = indexPath;
+            }
+            segment->index = std::move(index);
+
+            SegmentView view;
+            view.segment = std::move(segment);
+            next->segments.push_back(std::move(view));
+        }
+
+        return finishLoad(next);
+
     } catch (const std::exception& e) {
-        std::cerr << "Failed to remove ID " << id << ": " << e.what() << std::endl;
+        std::cerr << "Failed to load index: " << e.what() << std::endl;
         return false;
     }
 }
 
-size_t FaissIndex::removeBatch(const std::vector<int64_t>& ids) {
-    if (ids.empty()) {
-        return 0;
+bool FaissIndex::finishLoad(std::shared_ptr<Snapshot> next) {
+    publish(next);
+
+    // 位置表在首次 contains()/remove() 时再构建
+    {
+        std::unique_lock<std::shared_mutex> idLock(idMutex_);
+        locations_.clear();
+        locationsReady_ = false;
+    }
+
+    // 回放上次保存之后的增删
+    replayDeltaLog();
+
+    std::cout << "Loaded index (" << config_.type << ") with " << snapshot()->size()
+              << " vectors in " << snapshot()->segments.size() << " segment(s)"
+              << (isMapped() ? " (mmap)" : "") << std::endl;
+    return true;
+}
+
+bool FaissIndex::save(const std::string& indexPath) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    SnapshotPtr current = snapshot();
+    if (current->store) {
+        current->store->flush();
+        // 覆盖与删除留下的失效行超过有效行时重写存储，文件大小不超过有效数据的两倍
+        if (current->store->garbageRows() > current->store->size()) {
+            current->store->compact();
+        }
     }
 
     try {
-        faiss::IDSelectorBatch selector(ids.size(), ids.data());
-        size_t removed = index_->remove_ids(selector);
-        if (removed > 0) {
-            for (int64_t id : ids) {
-                idSet_.erase(id);
+        // 先写临时文件再替换：仍在使用旧快照的读线程可能映射着原文件
+        const std::string tmpPath = indexPath + ".tmp";
+
+        if (!current->trained) {
+            // 尚未训练：暂存向量以 Flat 形式落盘，加载时再放回增量缓冲
+            faiss::IndexFlat flat(dimension_, current->innerProduct ? faiss::METRIC_INNER_PRODUCT
+                                                                    : faiss::METRIC_L2);
+            faiss::IndexIDMap pending(&flat);
+            std::vector<float> vectors;
+            std::vector<int64_t> ids;
+            for (size_t row = 0; row < current->deltaRows; ++row) {
+                if (!current->deltaDeleted.test(row)) {
+                    const float* vec = current->deltaVector(row, dimension_);
+                    vectors.insert(vectors.end(), vec, vec + dimension_);
+                    ids.push_back(current->deltaId(row));
+                }
+            }
+            pending.add_with_ids(static_cast<faiss::idx_t>(ids.size()), vectors.data(), ids.data());
+            faiss::write_index(&pending, tmpPath.c_str());
+        } else {
+            // 增量缓冲够大（或没有日志可保留）时封存为段，各段作为检查点单独保存；
+            // 较小的增量缓冲留在日志中，加载时回放
+            if (current->deltaRows > 0 && (!deltaLog_ || current->deltaRows >= kSaveSealRows)) {
+                sealDelta();
+                current = snapshot();
+            }
+
+            if (!current->segments.empty()) {
+                return saveCheckpoint(indexPath, *current) && checkpointDeltaLog(*current);
+            }
+
+            // 没有段：保存空索引模板（保留训练结果）
+            faiss::write_index(current->emptyIndex.get(), tmpPath.c_str());
+        }
+
+        // 临时文件落盘后改名，崩溃时目标路径上总是完整的旧文件或新文件
+        if (!replaceFile(tmpPath, indexPath)) {
+            return false;
+        }
+
+        // 此前检查点留下的段文件不再引用；日志只保留未落入文件的增量缓冲
+        removeStaleSegmentFiles(indexPath, {});
+        if (current->trained) {
+            if (!checkpointDeltaLog(*current)) {
+                return false;
             }
+        } else if (deltaLog_) {
+            // 未训练时增量缓冲已整体写入文件
+            deltaLog_->truncate();
         }
-        return removed;
+        std::cout << "Saved index with " << current->size() << " vectors to "
+                 << indexPath << std::endl;
+        return true;
     } catch (const std::exception& e) {
-        std::cerr << "Failed to remove IDs: " << e.what() << std::endl;
-        return 0;
+        std::cerr << "Failed to save index: " << e.what() << std::endl;
+        return false;
     }
 }
 
-// ==================== 搜索 ====================
-
-std::vector<FaissIndex::SearchResult> FaissIndex::search(
-    const std::vector<float>& queryVector,
-    int topK,
-    float threshold) const {
+// ==================== 检查点 ====================
 
-    validateVector(queryVector);
+std::string FaissIndex::segmentFilePath(const std::string& indexPath, uint64_t seq) {
+    return indexPath + ".seg" + std::to_string(seq);
+}
 
-    if (empty()) {
-        return {};
+bool FaissIndex::isCheckpointManifest(const std::string& indexPath) {
+    std::FILE* file = std::fopen(indexPath.c_str(), "rb");
+    if (!file) {
+        return false;
     }
+    char magic[4] = {};
+    const bool isManifest = std::fread(magic, sizeof(magic), 1, file) == 1 &&
+                            std::memcmp(magic, kManifestMagic, sizeof(magic)) == 0;
+    std::fclose(file);
+    return isManifest;
+}
 
-    // 限制topK不超过索引大小
-    topK = std::min(topK, static_cast<int>(size()));
+bool FaissIndex::saveCheckpoint(const std::string& indexPath, const Snapshot& snap) {
+    const std::string tmpPath = indexPath + ".tmp";
+
+    // 只写出尚未保存到该路径的段（新封存或合并产生的段），其余段文件原样复用
+    std::unordered_set<std::string> referenced;
+    size_t written = 0;
+    for (const auto& view : snap.segments) {
+        const Segment& segment = *view.segment;
+        const std::string target = segmentFilePath(indexPath, segment.seq);
+        referenced.insert(fs::u8path(target).filename().u8string());
+        if (segment.checkpointPath == target) {
+            continue;
+        }
+
+        const std::string segmentTmp = target + ".tmp";
+        if (segment.mappedPath.empty()) {
+            faiss::write_index(segment.index.get(), segmentTmp.c_str());
+        } else {
+            // 映射的倒排表写出时只记录原文件引用，需先读入内存
+            faiss::write_index(copyIndex(*segment.index, segment.mappedPath).get(),
+                               segmentTmp.c_str());
+        }
+        if (!replaceFile(segmentTmp, target)) {
+            return false;
+        }
+        segment.checkpointPath = target;
+        written++;
+    }
 
-    // 执行搜索
-    std::vector<float> distances(topK);
-    std::vector<int64_t> labels(topK);
+    // 清单：段文件名与各段删除行（删除只改快照中的位图，不重写段文件）
+    std::FILE* file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to write index manifest: " << tmpPath << std::endl;
+        return false;
+    }
 
-    index_->search(1, queryVector.data(), topK,
-                  distances.data(), labels.data());
+    ManifestHeader header;
+    std::memcpy(header.magic, kManifestMagic, sizeof(kManifestMagic));
+    header.version = kManifestVersion;
+    header.dimension = static_cast<uint32_t>(dimension_);
+    header.segmentCount = static_cast<uint32_t>(snap.segments.size());
+    header.nextId = nextId_;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
 
-    // 构建结果
-    std::vector<SearchResult> results;
-    results.reserve(topK);
+    std::vector<uint64_t> deletedRows;
+    for (const auto& view : snap.segments) {
+        const std::string name = fs::u8path(segmentFilePath(indexPath, view.segment->seq))
+                                     .filename().u8string();
+        const uint64_t seq = view.segment->seq;
+        const uint32_t nameLength = static_cast<uint32_t>(name.size());
 
-    for (int i = 0; i < topK; ++i) {
-        // 跳过无效ID（-1表示未找到）
-        if (labels[i] < 0) {
-            continue;
+        deletedRows.clear();
+        for (size_t row = 0; view.deleted.count > 0 && row < view.rows(); ++row) {
+            if (view.deleted.test(row)) {
+                deletedRows.push_back(row);
+            }
         }
+        const uint64_t deletedCount = deletedRows.size();
 
-        SearchResult result(labels[i], distances[i]);
+        ok = ok && std::fwrite(&seq, sizeof(seq), 1, file) == 1 &&
+             std::fwrite(&nameLength, sizeof(nameLength), 1, file) == 1 &&
+             std::fwrite(name.data(), 1, name.size(), file) == name.size() &&
+             std::fwrite(&deletedCount, sizeof(deletedCount), 1, file) == 1 &&
+             std::fwrite(deletedRows.data(), sizeof(uint64_t), deletedRows.size(), file) ==
+                 deletedRows.size();
+    }
+    ok = std::fclose(file) == 0 && ok;
 
-        // 应用阈值过滤
-        if (result.score >= threshold) {
-            results.push_back(result);
-        }
+    if (!ok || !replaceFile(tmpPath, indexPath)) {
+        std::cerr << "Failed to write index manifest: " << indexPath << std::endl;
+        return false;
     }
 
-    return results;
-}
+    // 清单已提交：合并掉的旧段文件可以删除（日志由 save() 随后重写）
+    removeStaleSegmentFiles(indexPath, referenced);
 
-std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::searchBatch(
-    const std::vector<std::vector<float>>& queryVectors,
-    int topK,
-    float threshold) const {
+    std::cout << "Checkpointed index with " << snap.size() << " vectors to " << indexPath
+              << " (" << written << " of " << snap.segments.size() << " segment(s) written)"
+              << std::endl;
+    return true;
+}
 
-    if (queryVectors.empty() || empty()) {
-        return {};
+bool FaissIndex::checkpointDeltaLog(const Snapshot& snap) {
+    if (!deltaLog_) {
+        return true;
     }
 
-    // 验证向量
-    for (const auto& vec : queryVectors) {
-        validateVector(vec);
+    // 段中的写入已随检查点落盘，日志只需保留增量缓冲中的存活行
+    std::vector<float> vectors;
+    std::vector<int64_t> ids;
+    for (size_t row = 0; row < snap.deltaRows; ++row) {
+        if (!snap.deltaDeleted.test(row)) {
+            const float* vec = snap.deltaVector(row, dimension_);
+            vectors.insert(vectors.end(), vec, vec + dimension_);
+            ids.push_back(snap.deltaId(row));
+        }
+    }
+    if (!deltaLog_->rewrite(ids.data(), vectors.data(), ids.size())) {
+        std::cerr << "Failed to rewrite delta log after checkpoint" << std::endl;
+        return false;
     }
+    return true;
+}
 
-    const size_t nQueries = queryVectors.size();
-    topK = std::min(topK, static_cast<int>(size()));
+std::shared_ptr<FaissIndex::Snapshot> FaissIndex::loadCheckpoint(const std::string& indexPath) {
+    std::FILE* file = std::fopen(indexPath.c_str(), "rb");
+    if (!file) {
+        return nullptr;
+    }
 
-    // 准备查询数据
-    std::vector<float> flatQueries(nQueries * dimension_);
-    for (size_t i = 0; i < nQueries; ++i) {
-        std::copy(queryVectors[i].begin(), queryVectors[i].end(),
-                 flatQueries.begin() + i * dimension_);
+    ManifestHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+        header.version != kManifestVersion ||
+        header.dimension != static_cast<uint32_t>(dimension_)) {
+        std::cerr << "Invalid index manifest or dimension mismatch: " << indexPath << std::endl;
+        std::fclose(file);
+        return nullptr;
     }
 
-    // 执行批量搜索
-    std::vector<float> distances(nQueries * topK);
-    std::vector<int64_t> labels(nQueries * topK);
+    const fs::path dir = fs::u8path(indexPath).parent_path();
+    const int ioFlags = config_.mmap ? (faiss::IO_FLAG_MMAP | faiss::IO_FLAG_READ_ONLY) : 0;
 
-    index_->search(nQueries, flatQueries.data(), topK,
-                  distances.data(), labels.data());
+    auto next = std::make_shared<Snapshot>();
+    next->store = snapshot()->store;
+    uint64_t maxSeq = 0;
 
-    // 构建结果
-    std::vector<std::vector<SearchResult>> allResults(nQueries);
+    for (uint32_t i = 0; i < header.segmentCount; ++i) {
+        uint64_t seq = 0;
+        uint32_t nameLength = 0;
+        if (std::fread(&seq, sizeof(seq), 1, file) != 1 ||
+            std::fread(&nameLength, sizeof(nameLength), 1, file) != 1) {
+            break;
+        }
+        std::string name(nameLength, '\0');
+        uint64_t deletedCount = 0;
+        if (std::fread(&name[0], 1, nameLength, file) != nameLength ||
+            std::fread(&deletedCount, sizeof(deletedCount), 1, file) != 1) {
+            break;
+        }
+        std::vector<uint64_t> deletedRows(deletedCount);
+        if (std::fread(deletedRows.data(), sizeof(uint64_t), deletedCount, file) != deletedCount) {
+            break;
+        }
 
-    for (size_t i = 0; i < nQueries; ++i) {
-        std::vector<SearchResult> results;
-        results.reserve(topK);
+        const std::string segmentPath = (dir / fs::u8path(name)).u8string();
+        std::unique_ptr<faiss::IndexIDMap> index = readIndexFile(segmentPath, ioFlags);
+        if (!index) {
+            std::fclose(file);
+            return nullptr;
+        }
 
-        for (int j = 0; j < topK; ++j) {
-            int idx = i * topK + j;
-            if (labels[idx] < 0) {
-                continue;
-            }
+        auto segment = std::make_shared<Segment>();
+        segment->seq = seq;
+        segment->checkpointPath = segmentPath;
+        if (config_.mmap && dynamic_cast<faiss::IndexIVF*>(index->index)) {
+            segment->mappedPath = segmentPath;
+        }
+        next->innerProduct = index->metric_type == faiss::METRIC_INNER_PRODUCT;
+        segment->index = std::move(index);
 
-            SearchResult result(labels[idx], distances[idx]);
-            if (result.score >= threshold) {
-                results.push_back(result);
-            }
+        SegmentView view;
+        view.segment = std::move(segment);
+        for (uint64_t row : deletedRows) {
+            view.deleted.set(static_cast<size_t>(row));
         }
+        next->segments.push_back(std::move(view));
+        maxSeq = std::max(maxSeq, seq);
+    }
+    std::fclose(file);
 
-        allResults[i] = std::move(results);
+    if (next->segments.size() != header.segmentCount) {
+        std::cerr << "Truncated index manifest: " << indexPath << std::endl;
+        return nullptr;
     }
 
-    return allResults;
+    // 新段序号接在已保存的段之后，避免覆盖仍被清单引用的段文件
+    reserveSegmentSeq(maxSeq);
+    nextId_ = header.nextId;
+    return next;
 }
 
-// ==================== 信息获取 ====================
+void FaissIndex::removeStaleSegmentFiles(const std::string& indexPath,
+                                         const std::unordered_set<std::string>& referenced) {
+    const fs::path base = fs::u8path(indexPath);
+    const std::string prefix = base.filename().u8string() + ".seg";
 
-size_t FaissIndex::size() const {
-    return index_->ntotal;
+    std::error_code ec;
+    fs::path dir = base.parent_path();
+    if (dir.empty()) {
+        dir = ".";
+    }
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        const std::string name = entry.path().filename().u8string();
+        if (name.compare(0, prefix.size(), prefix) == 0 && referenced.count(name) == 0) {
+            // 读线程可能仍映射着旧段：POSIX 下删除不影响已有映射，Windows 下失败则留待下次
+            fs::remove(entry.path(), ec);
+        }
+    }
 }
 
-bool FaissIndex::contains(int64_t id) const {
-    return idSet_.find(id) != idSet_.end();
+void FaissIndex::clear() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    resetSnapshot();
 }
 
-// ==================== 私有方法 ====================
+bool FaissIndex::attachVectorStore(const std::string& path) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    auto store = std::make_shared<VectorStore>(dimension_);
+    if (!store->open(path)) {
+        return false;
+    }
+
+    auto next = std::make_shared<Snapshot>(*snapshot());
+    next->store = std::move(store);
+    publish(next);
+    return true;
+}
+
+std::shared_ptr<const VectorStore> FaissIndex::vectorStore() const {
+    return snapshot()->store;
+}
+
+bool FaissIndex::attachDeltaLog(const std::string& path) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    auto log = std::make_unique<DeltaLog>(dimension_);
+    if (!log->open(path)) {
+        return false;
+    }
+
+    deltaLog_ = std::move(log);
+    replayDeltaLog();
+    return true;
+}
+
+bool FaissIndex::syncDeltaLog() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    return deltaLog_ && deltaLog_->sync();
+}
+
+bool FaissIndex::adopt(FaissIndex& built, const float* vectors, const int64_t* ids, size_t n) {
+    if (&built == this) {
+        return true;
+    }
+    if (built.dimension_ != dimension_) {
+        std::cerr << "Cannot adopt index with dimension " << built.dimension_
+                  << " (expected " << dimension_ << ")" << std::endl;
+        return false;
+    }
+
+    std::scoped_lock lock(writeMutex_, built.writeMutex_);
+
+    SnapshotPtr current = snapshot();
+    auto next = std::make_shared<Snapshot>(*built.snapshot());
+    next->store = current->store;
+
+    // 先覆盖存储中的原始向量再发布：旧快照的搜索结果与新快照的ID集合一致，只是精排值更新
+    if (next->store && vectors && ids && n > 0) {
+        next->store->putBatch(ids, vectors, n);
+        next->store->flush();
+    }
+
+    // 段与增量缓冲只读，两个索引共享同一份数据，无需拷贝
+    {
+        std::lock_guard<std::mutex> configLock(configMutex_);
+        config_ = built.config_;
+    }
+    nextId_ = std::max(nextId_, built.nextId_);
+    publish(next);
+
+    {
+        std::unique_lock<std::shared_mutex> idLock(idMutex_);
+        locations_.clear();
+        locationsReady_ = false;
+    }
+
+    // 构建期间的增删按原顺序重放（已写入增量日志，不再追加）
+    const size_t replayed = rebuildWrites_.size();
+    for (const RebuildWrite& write : rebuildWrites_) {
+        if (write.vectors.empty()) {
+            removeInternal(write.ids.data(), write.ids.size());
+        } else {
+            addInternal(write.ids.size(), write.vectors.data(), write.ids.data());
+        }
+    }
+    recordingRebuild_ = false;
+    rebuildWrites_.clear();
+
+    // 新内容覆盖了全部ID：存储中被覆盖、删除的旧行一并回收
+    if (next->store && next->store->garbageRows() > 0) {
+        next->store->compact();
+    }
+
+    std::cout << "Adopted rebuilt index with " << snapshot()->size() << " vectors in "
+              << snapshot()->segments.size() << " segment(s), replayed " << replayed
+              << " write(s) made during the build" << std::endl;
+    notifyCompactor();
+    return true;
+}
+
+void FaissIndex::beginRebuild() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    recordingRebuild_ = true;
+    rebuildWrites_.clear();
+}
+
+void FaissIndex::endRebuild() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    recordingRebuild_ = false;
+    rebuildWrites_.clear();
+}
+
+bool FaissIndex::bulkLoad(const float* vectors, const int64_t* ids, size_t n, size_t chunkRows,
+                          const std::function<bool(size_t)>& onChunk) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    SnapshotPtr current = snapshot();
+    if (!current->segments.empty() || current->deltaRows > 0) {
+        std::cerr << "Bulk load requires an empty index" << std::endl;
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+
+    auto next = std::make_shared<Snapshot>(*current);
+    if (!next->trained) {
+        if (n < requiredTrainSize(next->emptyIndex.get())) {
+            // 样本不足无法训练：留在增量缓冲暴力检索
+            std::cerr << "Not enough vectors to train, keeping them in the pending buffer" << std::endl;
+            appendDelta(*next, vectors, ids, n);
+            publish(next);
+            nextId_ = std::max(nextId_, *std::max_element(ids, ids + n) + 1);
+            std::unique_lock<std::shared_mutex> idLock(idMutex_);
+            locations_.clear();
+            locationsReady_ = false;
+            return true;
+        }
+
+        std::unique_ptr<faiss::IndexIDMap> trained = copyIndex(*next->emptyIndex);
+        if (!trainWith(trained.get(), vectors, n)) {
+            return false;
+        }
+        next->emptyIndex = std::move(trained);
+        next->trained = true;
+    }
+
+    // 全部向量写入同一个段：分块只用于汇报进度与响应取消
+    auto segment = std::make_shared<Segment>();
+    try {
+        segment->index = copyIndex(*next->emptyIndex);
+        const size_t step = std::max<size_t>(chunkRows, 1);
+        for (size_t offset = 0; offset < n; offset += step) {
+            const size_t count = std::min(step, n - offset);
+            segment->index->add_with_ids(static_cast<faiss::idx_t>(count),
+                                         vectors + offset * dimension_, ids + offset);
+            if (onChunk && !onChunk(offset + count)) {
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to bulk load index: " << e.what() << std::endl;
+        return false;
+    }
+
+    segment->seq = allocateSegmentSeq();
+    SegmentView view;
+    view.segment = std::move(segment);
+    next->segments.push_back(std::move(view));
+    publish(next);
+    nextId_ = std::max(nextId_, *std::max_element(ids, ids + n) + 1);
+
+    // 位置表在首次 contains()/remove() 时再构建
+    std::unique_lock<std::shared_mutex> idLock(idMutex_);
+    locations_.clear();
+    locationsReady_ = false;
+    return true;
+}
+
+FaissIndex::IndexConfig FaissIndex::config() const {
+    std::lock_guard<std::mutex> lock(configMutex_);
+    return config_;
+}
+
+void FaissIndex::setConfig(const IndexConfig& config) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    {
+        std::lock_guard<std::mutex> configLock(configMutex_);
+        config_ = config;
+    }
+    publish(std::make_shared<Snapshot>(*snapshot()));
+}
+
+void FaissIndex::reset(const IndexConfig& config) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    {
+        std::lock_guard<std::mutex> configLock(configMutex_);
+        config_ = config;
+    }
+    resetSnapshot();
+}
+
+bool FaissIndex::train(const std::vector<std::vector<float>>& samples) {
+    if (isTrained()) {
+        return true;
+    }
+    if (samples.empty()) {
+        return false;
+    }
+
+    for (const auto& vec : samples) {
+        validateVector(vec);
+    }
+
+    std::vector<float> flatSamples(samples.size() * dimension_);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        std::copy(samples[i].begin(), samples[i].end(),
+                 flatSamples.begin() + i * dimension_);
+    }
+
+    return train(flatSamples.data(), samples.size());
+}
+
+bool FaissIndex::train(const float* samples, size_t n) {
+    if (isTrained()) {
+        return true;
+    }
+    if (!samples || n == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    return sealDelta(samples, n);
+}
+
+bool FaissIndex::isTrained() const {
+    return snapshot()->trained;
+}
+
+// ==================== 向量操作 ====================
+
+int64_t FaissIndex::add(const std::vector<float>& vector, int64_t id) {
+    validateVector(vector);
+
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    // 如果未指定ID，自动生成
+    if (id < 0) {
+        id = generateNewId();
+    }
+
+    // 先写日志再修改索引；日志写入失败时不修改索引，由调用方撤销元数据
+    if (deltaLog_ && !deltaLog_->appendAdd(&id, vector.data(), 1)) {
+        std::cerr << "Failed to log added vector " << id << std::endl;
+        return -1;
+    }
+    if (recordingRebuild_) {
+        rebuildWrites_.push_back(RebuildWrite{{id}, vector});
+    }
+    addInternal(1, vector.data(), &id);
+
+    return id;
+}
+
+bool FaissIndex::addBatch(const std::vector<std::vector<float>>& vectors,
+                         std::vector<int64_t>& ids,
+                         const std::vector<int64_t>* inputIds) {
+    if (vectors.empty()) {
+        ids.clear();
+        return true;
+    }
+
+    // 验证所有向量
+    for (const auto& vec : vectors) {
+        validateVector(vec);
+    }
+
+    // 准备数据
+    const size_t n = vectors.size();
+    std::vector<float> flatVectors(n * dimension_);
+
+    for (size_t i = 0; i < n; ++i) {
+        std::copy(vectors[i].begin(), vectors[i].end(),
+                 flatVectors.begin() + i * dimension_);
+    }
+
+    return addBatch(flatVectors.data(), n, ids,
+                    inputIds && inputIds->size() == n ? inputIds->data() : nullptr);
+}
+
+bool FaissIndex::addBatch(const float* vectors, size_t n,
+                         std::vector<int64_t>& ids,
+                         const int64_t* inputIds) {
+    if (n == 0) {
+        ids.clear();
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    // 准备ID
+    if (inputIds) {
+        ids.assign(inputIds, inputIds + n);
+    } else {
+        ids.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            ids[i] = generateNewId();
+        }
+    }
+
+    // 批量添加（数据直接追加到增量缓冲）
+    if (deltaLog_ && !deltaLog_->appendAdd(ids.data(), vectors, n)) {
+        std::cerr << "Failed to log " << n << " added vectors" << std::endl;
+        ids.clear();
+        return false;
+    }
+    if (recordingRebuild_) {
+        rebuildWrites_.push_back(RebuildWrite{ids, std::vector<float>(vectors, vectors + n * dimension_)});
+    }
+    addInternal(n, vectors, ids.data());
+    return true;
+}
+
+bool FaissIndex::remove(int64_t id) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (deltaLog_ && !deltaLog_->appendRemove(&id, 1)) {
+        std::cerr << "Failed to log removed vector " << id << std::endl;
+        return false;
+    }
+    if (recordingRebuild_) {
+        rebuildWrites_.push_back(RebuildWrite{{id}, {}});
+    }
+    return removeInternal(&id, 1) > 0;
+}
+
+size_t FaissIndex::removeBatch(const std::vector<int64_t>& ids) {
+    if (ids.empty()) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (deltaLog_ && !deltaLog_->appendRemove(ids.data(), ids.size())) {
+        std::cerr << "Failed to log " << ids.size() << " removed vectors" << std::endl;
+        return 0;
+    }
+    if (recordingRebuild_) {
+        rebuildWrites_.push_back(RebuildWrite{ids, {}});
+    }
+    return removeInternal(ids.data(), ids.size());
+}
+
+// ==================== 搜索 ====================
+
+std::vector<FaissIndex::SearchResult> FaissIndex::search(
+    const std::vector<float>& queryVector,
+    int topK,
+    float threshold,
+    const SearchParams& params) const {
+
+    validateVector(queryVector);
+
+    SnapshotPtr snap = snapshot();
+    if (snap->size() == 0 || topK <= 0) {
+        return {};
+    }
+
+    auto allResults = searchFlat(*snap, queryVector.data(), 1, topK, threshold, params);
+    return std::move(allResults[0]);
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::searchBatch(
+    const std::vector<std::vector<float>>& queryVectors,
+    int topK,
+    float threshold,
+    const SearchParams& params) const {
+
+    SnapshotPtr snap = snapshot();
+    if (queryVectors.empty() || snap->size() == 0 || topK <= 0) {
+        return {};
+    }
+
+    // 验证向量
+    for (const auto& vec : queryVectors) {
+        validateVector(vec);
+    }
+
+    const size_t nQueries = queryVectors.size();
+
+    // 准备查询数据
+    std::vector<float> flatQueries(nQueries * dimension_);
+    for (size_t i = 0; i < nQueries; ++i) {
+        std::copy(queryVectors[i].begin(), queryVectors[i].end(),
+                 flatQueries.begin() + i * dimension_);
+    }
+
+    return searchFlat(*snap, flatQueries.data(), nQueries, topK, threshold, params);
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::searchBatch(
+    const float* queries,
+    size_t nQueries,
+    int topK,
+    float threshold,
+    const SearchParams& params) const {
+
+    SnapshotPtr snap = snapshot();
+    if (nQueries == 0 || snap->size() == 0 || topK <= 0) {
+        return {};
+    }
+
+    return searchFlat(*snap, queries, nQueries, topK, threshold, params);
+}
+
+std::vector<FaissIndex::SearchResult> FaissIndex::rangeSearch(
+    const std::vector<float>& queryVector,
+    float minScore,
+    int maxResults,
+    const SearchParams& params) const {
+
+    validateVector(queryVector);
+
+    SnapshotPtr snap = snapshot();
+    if (snap->size() == 0) {
+        return {};
+    }
+
+    auto allResults = rangeSearchFlat(*snap, queryVector.data(), 1, minScore, maxResults, params);
+    return std::move(allResults[0]);
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::rangeSearchBatch(
+    const float* queries,
+    size_t nQueries,
+    float minScore,
+    int maxResults,
+    const SearchParams& params) const {
+
+    SnapshotPtr snap = snapshot();
+    if (nQueries == 0 || snap->size() == 0) {
+        return {};
+    }
+
+    return rangeSearchFlat(*snap, queries, nQueries, minScore, maxResults, params);
+}
+
+// ==================== 信息获取 ====================
+
+size_t FaissIndex::sampleVectors(size_t maxCount, std::vector<float>& vectors,
+                                 std::vector<int64_t>& ids) const {
+    SnapshotPtr snap = snapshot();
+    const bool useStore = snap->store && snap->store->isOpen();
+
+    // 候选行：(段下标, 行号)，段下标等于段数时表示增量缓冲
+    std::vector<std::pair<size_t, size_t>> rows;
+    rows.reserve(snap->size());
+    for (size_t s = 0; s < snap->segments.size(); ++s) {
+        const SegmentView& view = snap->segments[s];
+        for (size_t row = 0; row < view.rows(); ++row) {
+            if (!view.deleted.test(row)) {
+                rows.emplace_back(s, row);
+            }
+        }
+    }
+    for (size_t row = 0; row < snap->deltaRows; ++row) {
+        if (!snap->deltaDeleted.test(row)) {
+            rows.emplace_back(snap->segments.size(), row);
+        }
+    }
+
+    if (maxCount > 0 && rows.size() > maxCount) {
+        // 部分 Fisher-Yates 洗牌，固定种子保证可复现
+        std::mt19937_64 rng(kTrainSeed);
+        for (size_t i = 0; i < maxCount; ++i) {
+            std::uniform_int_distribution<size_t> pick(i, rows.size() - 1);
+            std::swap(rows[i], rows[pick(rng)]);
+        }
+        rows.resize(maxCount);
+    }
+
+    // 倒排段的行偏移表按需构建（向量存储中缺失时才需要解码）
+    std::vector<std::vector<std::pair<int64_t, int64_t>>> offsets(snap->segments.size());
+    std::vector<char> offsetsBuilt(snap->segments.size(), 0);
+
+    vectors.resize(rows.size() * dimension_);
+    ids.clear();
+    ids.reserve(rows.size());
+    size_t n = 0;
+    for (const auto& entry : rows) {
+        float* dst = vectors.data() + n * dimension_;
+        int64_t id = 0;
+        if (entry.first == snap->segments.size()) {
+            const float* vec = snap->deltaVector(entry.second, dimension_);
+            std::copy(vec, vec + dimension_, dst);
+            id = snap->deltaId(entry.second);
+        } else {
+            const faiss::IndexIDMap& index = *snap->segments[entry.first].segment->index;
+            id = index.id_map[entry.second];
+            if (!useStore || !snap->store->get(id, dst)) {
+                if (!offsetsBuilt[entry.first]) {
+                    offsets[entry.first] = ivfRowOffsets(index.index, index.index->ntotal);
+                    offsetsBuilt[entry.first] = 1;
+                }
+                try {
+                    reconstructRow(index.index, entry.second, offsets[entry.first], dst);
+                } catch (const std::exception&) {
+                    continue;
+                }
+            }
+        }
+        ids.push_back(id);
+        n++;
+    }
+    vectors.resize(n * dimension_);
+    return n;
+}
+
+bool FaissIndex::scanVectors(size_t batchRows, const VectorBatchCallback& visit) const {
+    SnapshotPtr snap = snapshot();
+    const bool useStore = snap->store && snap->store->isOpen();
+    batchRows = std::max<size_t>(batchRows, 1);
+
+    std::vector<float> batch;
+    std::vector<int64_t> batchIds;
+    batch.reserve(batchRows * dimension_);
+    batchIds.reserve(batchRows);
+    bool stopped = false;
+    auto flushBatch = [&]() {
+        if (!batchIds.empty() && !stopped) {
+            stopped = !visit(batch.data(), batchIds.data(), batchIds.size());
+        }
+        batch.clear();
+        batchIds.clear();
+    };
+
+    std::vector<float> vec(dimension_);
+    for (size_t s = 0; s < snap->segments.size() && !stopped; ++s) {
+        const SegmentView& view = snap->segments[s];
+        const faiss::IndexIDMap& index = *view.segment->index;
+        std::vector<std::pair<int64_t, int64_t>> offsets;
+        bool offsetsBuilt = false;
+
+        for (size_t row = 0; row < view.rows() && !stopped; ++row) {
+            if (view.deleted.test(row)) {
+                continue;
+            }
+            const int64_t id = index.id_map[row];
+            if (!useStore || !snap->store->get(id, vec.data())) {
+                if (!offsetsBuilt) {
+                    offsets = ivfRowOffsets(index.index, view.rows());
+                    offsetsBuilt = true;
+                }
+                try {
+                    reconstructRow(index.index, row, offsets, vec.data());
+                } catch (const std::exception& e) {
+                    std::cerr << "Failed to read vector " << id << " from segment "
+                              << view.segment->seq << ": " << e.what() << std::endl;
+                    return false;
+                }
+            }
+            batch.insert(batch.end(), vec.begin(), vec.end());
+            batchIds.push_back(id);
+            if (batchIds.size() >= batchRows) {
+                flushBatch();
+            }
+        }
+    }
+
+    for (size_t row = 0; row < snap->deltaRows && !stopped; ++row) {
+        if (snap->deltaDeleted.test(row)) {
+            continue;
+        }
+        const float* data = snap->deltaVector(row, dimension_);
+        batch.insert(batch.end(), data, data + dimension_);
+        batchIds.push_back(snap->deltaId(row));
+        if (batchIds.size() >= batchRows) {
+            flushBatch();
+        }
+    }
+    flushBatch();
+    return true;
+}
+
+FaissIndex::MemoryUsage FaissIndex::memoryUsage() const {
+    SnapshotPtr snap = snapshot();
+
+    MemoryUsage usage;
+    size_t mapped = 0;
+    size_t total = 0;
+    for (const auto& view : snap->segments) {
+        total += estimateIndexBytes(view.segment->index.get(),
+                                    !view.segment->mappedPath.empty(), mapped);
+        total += view.deleted.blocks.size() * kBitmapBlockBits / 8;
+    }
+    total += estimateIndexBytes(snap->emptyIndex.get(), false, mapped);
+    total += snap->chunks.size() * kDeltaChunkRows * (dimension_ * sizeof(float) + sizeof(int64_t));
+
+    usage.mappedBytes = mapped;
+    usage.heapBytes = total - mapped;
+    usage.storeBytes = snap->store ? snap->store->fileBytes() : 0;
+    usage.vectorCount = snap->size();
+    return usage;
+}
+
+bool FaissIndex::isMapped() const {
+    SnapshotPtr snap = snapshot();
+    return std::any_of(snap->segments.begin(), snap->segments.end(),
+                       [](const SegmentView& view) {
+                           return !view.segment->mappedPath.empty();
+                       });
+}
+
+FaissIndex::Metric FaissIndex::metric() const {
+    return snapshot()->innerProduct ? Metric::InnerProduct : Metric::L2;
+}
+
+size_t FaissIndex::size() const {
+    return snapshot()->size();
+}
+
+size_t FaissIndex::segmentCount() const {
+    return snapshot()->segments.size();
+}
+
+bool FaissIndex::contains(int64_t id) const {
+    ensureLocations();
+    std::shared_lock<std::shared_mutex> lock(idMutex_);
+    return locations_.find(id) != locations_.end();
+}
+
+std::vector<float> FaissIndex::getVector(int64_t id) const {
+    SnapshotPtr snap = snapshot();
+    std::vector<float> vector(dimension_);
+    if (!lookupVector(*snap, id, vector.data())) {
+        return {};
+    }
+    return vector;
+}
+
+size_t FaissIndex::getVectors(const std::vector<int64_t>& ids, std::vector<float>& vectors,
+                              std::vector<char>& found, bool storedOnly) const {
+    // 整批使用同一快照，结果彼此一致
+    SnapshotPtr snap = snapshot();
+    vectors.assign(ids.size() * dimension_, 0.0f);
+    found.assign(ids.size(), 0);
+
+    size_t count = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (lookupVector(*snap, ids[i], vectors.data() + i * dimension_, storedOnly)) {
+            found[i] = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+// ==================== 私有方法 ====================
+
+void FaissIndex::publish(std::shared_ptr<Snapshot> next) {
+    next->rerankFactor = config_.rerankFactor;
+    next->purgeRatio = config_.purgeRatio;
+    next->nprobe = config_.nprobe;
+    next->efSearch = config_.efSearch;
+    std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(std::move(next)));
+}
 
 void FaissIndex::validateVector(const std::vector<float>& vector) const {
     if (vector.size() != static_cast<size_t>(dimension_)) {
@@ -310,8 +1507,1342 @@ void FaissIndex::validateVector(const std::vector<float>& vector) const {
     }
 }
 
-int64_t FaissIndex::generateNewId() {
-    return nextId_++;
+int64_t FaissIndex::generateNewId() {
+    return nextId_++;
+}
+
+std::unique_ptr<faiss::IndexIDMap> FaissIndex::readIndexFile(const std::string& indexPath,
+                                                             int ioFlags) const {
+    std::unique_ptr<faiss::Index> loadedIndex(faiss::read_index(indexPath.c_str(), ioFlags));
+
+    // 检查是否是IDMap类型
+    auto* idMapIndex = dynamic_cast<faiss::IndexIDMap*>(loadedIndex.get());
+    if (!idMapIndex) {
+        std::cerr << "Error: Loaded index is not an IndexIDMap" << std::endl;
+        return nullptr;
+    }
+
+    // 检查维度是否匹配
+    if (idMapIndex->d != dimension_) {
+        std::cerr << "Error: Index dimension mismatch. Expected: "
+                 << dimension_ << ", Got: " << idMapIndex->d << std::endl;
+        return nullptr;
+    }
+
+    loadedIndex.release();
+    return std::unique_ptr<faiss::IndexIDMap>(idMapIndex);
+}
+
+std::unique_ptr<faiss::IndexIDMap> FaissIndex::createIndex() const {
+    std::string description = config_.type;
+    if (config_.refineFactor > 1.0f) {
+        description += ",RFlat";
+    }
+
+    std::unique_ptr<faiss::Index> base;
+    try {
+        base.reset(faiss::index_factory(dimension_, description.c_str(),
+                                        config_.metric == Metric::InnerProduct
+                                            ? faiss::METRIC_INNER_PRODUCT
+                                            : faiss::METRIC_L2));
+    } catch (const std::exception& e) {
+        throw std::invalid_argument("Invalid index type '" + description + "': " + e.what());
+    }
+
+    // 精排包装：压缩编码召回 refineFactor 倍候选，再用原始 float 向量重排
+    if (auto* refine = dynamic_cast<faiss::IndexRefine*>(base.get())) {
+        refine->k_factor = config_.refineFactor;
+    }
+
+    // 使用IDMap包装以支持自定义ID
+    auto index = std::make_unique<faiss::IndexIDMap>(base.release());
+    index->own_fields = true;
+    return index;
+}
+
+std::unique_ptr<faiss::IndexIDMap> FaissIndex::copyIndex(const faiss::IndexIDMap& index,
+                                                         const std::string& mappedPath) const {
+    if (!mappedPath.empty()) {
+        // 映射的倒排表只读：完整读入内存
+        std::unique_ptr<faiss::IndexIDMap> copy = readIndexFile(mappedPath, 0);
+        if (!copy) {
+            throw std::runtime_error("Failed to read mapped index: " + mappedPath);
+        }
+        return copy;
+    }
+
+    // 序列化往返：适用于所有可持久化的索引类型
+    faiss::VectorIOWriter writer;
+    faiss::write_index(&index, &writer);
+    faiss::VectorIOReader reader;
+    reader.data = std::move(writer.data);
+
+    std::unique_ptr<faiss::Index> copy(faiss::read_index(&reader));
+    auto* idMapIndex = dynamic_cast<faiss::IndexIDMap*>(copy.get());
+    if (!idMapIndex) {
+        throw std::runtime_error("Failed to copy index");
+    }
+    copy.release();
+    return std::unique_ptr<faiss::IndexIDMap>(idMapIndex);
+}
+
+void FaissIndex::ensureEmptyIndex(Snapshot& snap) const {
+    if (snap.emptyIndex || snap.segments.empty()) {
+        return;
+    }
+
+    // 加载的索引：拷贝后清空数据，保留训练结果（量化器、码本）
+    const Segment& first = *snap.segments.front().segment;
+    std::unique_ptr<faiss::IndexIDMap> empty;
+    if (auto* flat = dynamic_cast<const faiss::IndexFlat*>(first.index->index)) {
+        // Flat 无训练状态，直接新建，避免拷贝全部向量
+        empty = std::make_unique<faiss::IndexIDMap>(new faiss::IndexFlat(dimension_, flat->metric_type));
+        empty->own_fields = true;
+    } else if (!first.mappedPath.empty()) {
+        // 映射的倒排段：重新映射文件（不读入倒排数据），换上空倒排表即为模板，
+        // 避免首次封存时把整个映射索引读入内存
+        empty = readIndexFile(first.mappedPath, faiss::IO_FLAG_MMAP | faiss::IO_FLAG_READ_ONLY);
+        auto* ivf = empty ? dynamic_cast<faiss::IndexIVF*>(empty->index) : nullptr;
+        if (!ivf) {
+            throw std::runtime_error("Failed to read mapped index: " + first.mappedPath);
+        }
+        ivf->replace_invlists(new faiss::ArrayInvertedLists(ivf->nlist, ivf->code_size), true);
+        empty->reset();
+    } else {
+        empty = copyIndex(*first.index);
+        empty->reset();
+    }
+    snap.emptyIndex = std::move(empty);
+}
+
+void FaissIndex::resetSnapshot() {
+    SnapshotPtr current = snapshot();
+
+    auto next = std::make_shared<Snapshot>();
+    std::unique_ptr<faiss::IndexIDMap> empty = createIndex();
+    next->innerProduct = empty->metric_type == faiss::METRIC_INNER_PRODUCT;
+    next->trained = empty->is_trained;
+    next->emptyIndex = std::move(empty);
+    next->store = current ? current->store : nullptr;
+    publish(next);
+
+    if (next->store) {
+        next->store->clear();
+    }
+    if (deltaLog_) {
+        deltaLog_->truncate();
+    }
+    nextId_ = 0;
+
+    std::unique_lock<std::shared_mutex> idLock(idMutex_);
+    locations_.clear();
+    locationsReady_ = true;
+}
+
+void FaissIndex::replayDeltaLog() {
+    if (!deltaLog_) {
+        return;
+    }
+
+    // 回放只需日志涉及的ID的位置：先收集这些ID，再扫描各段只登记它们，
+    // 不构建全量位置表（其余ID在首次 contains()/remove() 时再登记）
+    std::unordered_set<int64_t> touched;
+    const auto collect = [&touched](const int64_t* ids, size_t n) {
+        touched.insert(ids, ids + n);
+    };
+    if (deltaLog_->replay([&collect](const int64_t* ids, const float*, size_t n) { collect(ids, n); },
+                          collect) <= 0) {
+        return;
+    }
+
+    SnapshotPtr snap = snapshot();
+    {
+        std::unique_lock<std::shared_mutex> idLock(idMutex_);
+        for (const auto& view : snap->segments) {
+            const auto& idMap = view.segment->index->id_map;
+            for (size_t row = 0; row < idMap.size(); ++row) {
+                if (!view.deleted.test(row) && touched.count(idMap[row]) > 0) {
+                    locations_[idMap[row]] = Location{view.segment->seq, row};
+                }
+            }
+        }
+        for (size_t row = 0; row < snap->deltaRows; ++row) {
+            if (!snap->deltaDeleted.test(row) && touched.count(snap->deltaId(row)) > 0) {
+                locations_[snap->deltaId(row)] = Location{0, row};
+            }
+        }
+    }
+
+    replaying_ = true;
+    const int64_t records = deltaLog_->replay(
+        [this](const int64_t* ids, const float* vectors, size_t n) {
+            addInternal(n, vectors, ids);
+            for (size_t i = 0; i < n; ++i) {
+                nextId_ = std::max(nextId_, ids[i] + 1);
+            }
+        },
+        [this](const int64_t* ids, size_t n) {
+            removeInternal(ids, n);
+        });
+    replaying_ = false;
+
+    if (records > 0) {
+        std::cout << "Replayed " << records << " delta log records from "
+                  << deltaLog_->path() << std::endl;
+    }
+}
+
+size_t FaissIndex::requiredTrainSize(const faiss::IndexIDMap* index) const {
+    if (config_.trainSize > 0) {
+        return config_.trainSize;
+    }
+
+    size_t centroids = kQuantizerCentroids;
+    if (auto* ivf = dynamic_cast<const faiss::IndexIVF*>(index->index)) {
+        centroids = std::max(centroids, ivf->nlist);
+    }
+    return centroids * kMinPointsPerCentroid;
+}
+
+bool FaissIndex::trainWith(faiss::IndexIDMap* index, const float* data, size_t n) const {
+    try {
+        const size_t limit = config_.trainSize;
+        if (limit > 0 && n > limit) {
+            // 随机采样 limit 个训练样本（部分 Fisher-Yates 洗牌）
+            std::vector<size_t> rows(n);
+            std::iota(rows.begin(), rows.end(), 0);
+            std::mt19937_64 rng(kTrainSeed);
+            for (size_t i = 0; i < limit; ++i) {
+                std::uniform_int_distribution<size_t> pick(i, n - 1);
+                std::swap(rows[i], rows[pick(rng)]);
+            }
+
+            std::vector<float> sample(limit * dimension_);
+            for (size_t i = 0; i < limit; ++i) {
+                std::copy(data + rows[i] * dimension_, data + (rows[i] + 1) * dimension_,
+                         sample.begin() + i * dimension_);
+            }
+            index->train(static_cast<faiss::idx_t>(limit), sample.data());
+        } else {
+            index->train(static_cast<faiss::idx_t>(n), data);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to train index: " << e.what() << std::endl;
+        return false;
+    }
+
+    std::cout << "Trained index (" << config_.type << ") with " << n
+              << " samples" << std::endl;
+    return true;
+}
+
+void FaissIndex::appendDelta(Snapshot& snap, const float* data, const int64_t* ids, size_t n) const {
+    // 只写入当前快照不可见的行，读线程不会观察到写入过程
+    size_t row = snap.deltaRows;
+    for (size_t i = 0; i < n; ++i, ++row) {
+        if (row / kDeltaChunkRows >= snap.chunks.size()) {
+            snap.chunks.push_back(std::make_shared<DeltaChunk>(dimension_));
+        }
+        DeltaChunk& chunk = *snap.chunks[row / kDeltaChunkRows];
+        std::copy(data + i * dimension_, data + (i + 1) * dimension_,
+                 chunk.vectors.get() + (row % kDeltaChunkRows) * dimension_);
+        chunk.ids[row % kDeltaChunkRows] = ids[i];
+    }
+    snap.deltaRows = row;
+}
+
+void FaissIndex::markDeleted(Snapshot& snap, const Location& location) {
+    if (location.seq == 0) {
+        snap.deltaDeleted.set(location.row);
+        return;
+    }
+    for (auto& view : snap.segments) {
+        if (view.segment->seq == location.seq) {
+            view.deleted.set(location.row);
+            return;
+        }
+    }
+}
+
+void FaissIndex::addInternal(size_t n, const float* data, const int64_t* ids) {
+    if (!replaying_) {
+        ensureLocations();
+    }
+
+    SnapshotPtr current = snapshot();
+    if (current->store) {
+        current->store->putBatch(ids, data, n);
+    }
+
+    auto next = std::make_shared<Snapshot>(*current);
+    const size_t firstRow = next->deltaRows;
+    appendDelta(*next, data, ids, n);
+
+    // 同ID覆盖：旧位置（含同一批次中较早的行）置删除位，再登记新位置
+    {
+        std::shared_lock<std::shared_mutex> idLock(idMutex_);
+        std::unordered_map<int64_t, size_t> batchRows;
+        for (size_t i = 0; i < n; ++i) {
+            auto it = locations_.find(ids[i]);
+            if (it != locations_.end()) {
+                markDeleted(*next, it->second);
+            }
+            if (n > 1) {
+                auto inserted = batchRows.emplace(ids[i], firstRow + i);
+                if (!inserted.second) {
+                    next->deltaDeleted.set(inserted.first->second);
+                    inserted.first->second = firstRow + i;
+                }
+            }
+        }
+    }
+    publish(next);
+
+    // 先发布再登记位置，保证并发构建位置表时不会遗漏
+    {
+        std::unique_lock<std::shared_mutex> idLock(idMutex_);
+        for (size_t i = 0; i < n; ++i) {
+            locations_[ids[i]] = Location{0, firstRow + i};
+        }
+    }
+
+    // 缓冲达到阈值时封存；未训练时等待足够的训练样本
+    const size_t limit = next->trained ? kDeltaSealRows : requiredTrainSize(next->emptyIndex.get());
+    if (next->deltaRows >= limit) {
+        sealDelta();
+    }
+}
+
+size_t FaissIndex::removeInternal(const int64_t* ids, size_t n) {
+    if (!replaying_) {
+        ensureLocations();
+    }
+
+    auto next = std::make_shared<Snapshot>(*snapshot());
+    std::vector<int64_t> removed;
+    {
+        std::unique_lock<std::shared_mutex> idLock(idMutex_);
+        for (size_t i = 0; i < n; ++i) {
+            auto it = locations_.find(ids[i]);
+            if (it == locations_.end()) {
+                continue;
+            }
+            markDeleted(*next, it->second);
+            locations_.erase(it);
+            removed.push_back(ids[i]);
+        }
+    }
+
+    if (removed.empty()) {
+        return 0;
+    }
+
+    if (next->store) {
+        for (int64_t id : removed) {
+            next->store->remove(id);
+        }
+    }
+    publish(next);
+
+    // 删除比例超过阈值的段由后台重写清理
+    for (const auto& view : next->segments) {
+        if (needsPurge(*next, view)) {
+            notifyCompactor();
+            break;
+        }
+    }
+    return removed.size();
+}
+
+bool FaissIndex::sealDelta(const float* samples, size_t nSamples) {
+    SnapshotPtr current = snapshot();
+
+    // 收集增量缓冲中未删除的行
+    std::vector<float> vectors;
+    std::vector<int64_t> ids;
+    std::vector<size_t> rows;
+    vectors.reserve((current->deltaRows - current->deltaDeleted.count) * dimension_);
+    for (size_t row = 0; row < current->deltaRows; ++row) {
+        if (current->deltaDeleted.test(row)) {
+            continue;
+        }
+        const float* vec = current->deltaVector(row, dimension_);
+        vectors.insert(vectors.end(), vec, vec + dimension_);
+        ids.push_back(current->deltaId(row));
+        rows.push_back(row);
+    }
+
+    auto next = std::make_shared<Snapshot>(*current);
+    next->chunks.clear();
+    next->deltaRows = 0;
+    next->deltaDeleted = DeletedRows();
+
+    if (!current->trained) {
+        if (!samples && ids.size() < requiredTrainSize(current->emptyIndex.get())) {
+            // 样本不足无法训练：只压缩缓冲，丢弃已删除的行
+            appendDelta(*next, vectors.data(), ids.data(), ids.size());
+            publish(next);
+
+            std::unique_lock<std::shared_mutex> idLock(idMutex_);
+            for (size_t i = 0; i < ids.size(); ++i) {
+                auto it = locations_.find(ids[i]);
+                if (it != locations_.end() && it->second.seq == 0 && it->second.row == rows[i]) {
+                    it->second.row = i;
+                }
+            }
+            return false;
+        }
+
+        std::unique_ptr<faiss::IndexIDMap> trained = copyIndex(*current->emptyIndex);
+        if (!trainWith(trained.get(), samples ? samples : vectors.data(),
+                       samples ? nSamples : ids.size())) {
+            return false;
+        }
+        next->emptyIndex = std::move(trained);
+        next->trained = true;
+    }
+
+    auto segment = std::make_shared<Segment>();
+    try {
+        ensureEmptyIndex(*next);
+        if (!ids.empty()) {
+            segment->index = copyIndex(*next->emptyIndex);
+            segment->index->add_with_ids(static_cast<faiss::idx_t>(ids.size()),
+                                         vectors.data(), ids.data());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to seal index segment: " << e.what() << std::endl;
+        return false;
+    }
+
+    if (segment->index) {
+        segment->seq = allocateSegmentSeq();
+        SegmentView view;
+        view.segment = segment;
+        next->segments.push_back(std::move(view));
+    }
+    publish(next);
+
+    // 缓冲行搬迁到新段
+    {
+        std::unique_lock<std::shared_mutex> idLock(idMutex_);
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto it = locations_.find(ids[i]);
+            if (it != locations_.end() && it->second.seq == 0 && it->second.row == rows[i]) {
+                it->second = Location{segment->seq, i};
+            }
+        }
+    }
+
+    notifyCompactor();
+    return true;
+}
+
+void FaissIndex::buildMerged(Compaction& compaction, const Snapshot& snap) const {
+    auto merged = std::make_shared<Segment>();
+    merged->index = copyIndex(*compaction.emptyIndex);
+    faiss::IndexIDMap& target = *merged->index;
+    compaction.rowMaps.assign(compaction.sources.size(), std::vector<int64_t>());
+
+    // 精排包装（RFlat）：倒排编码与精排向量分别搬运
+    auto* targetRefine = dynamic_cast<faiss::IndexRefine*>(target.index);
+    faiss::Index* targetBase = targetRefine ? targetRefine->base_index : target.index;
+    auto* targetFlat = dynamic_cast<faiss::IndexFlatCodes*>(target.index);
+    auto* targetIvf = dynamic_cast<faiss::IndexIVF*>(targetBase);
+    auto* targetRefineFlat = targetRefine
+        ? dynamic_cast<faiss::IndexFlatCodes*>(targetRefine->refine_index) : nullptr;
+
+    // 通用路径的批量缓冲（HNSW 等无法直接搬运编码的类型）
+    std::vector<float> batch;
+    std::vector<int64_t> batchIds;
+    auto flushBatch = [&]() {
+        if (!batchIds.empty()) {
+            target.add_with_ids(static_cast<faiss::idx_t>(batchIds.size()), batch.data(), batchIds.data());
+            batch.clear();
+            batchIds.clear();
+        }
+    };
+
+    for (size_t s = 0; s < compaction.sources.size(); ++s) {
+        const SegmentView& view = compaction.sources[s];
+        const faiss::IndexIDMap& source = *view.segment->index;
+        std::vector<int64_t>& rowMap = compaction.rowMaps[s];
+        rowMap.assign(view.rows(), -1);
+
+        auto* sourceRefine = dynamic_cast<const faiss::IndexRefine*>(source.index);
+        const faiss::Index* sourceBase = sourceRefine ? sourceRefine->base_index : source.index;
+        auto* sourceFlat = dynamic_cast<const faiss::IndexFlatCodes*>(source.index);
+        auto* sourceIvf = dynamic_cast<const faiss::IndexIVF*>(sourceBase);
+        auto* sourceRefineFlat = sourceRefine
+            ? dynamic_cast<const faiss::IndexFlatCodes*>(sourceRefine->refine_index) : nullptr;
+
+        const bool moveIvf = targetIvf && sourceIvf && targetIvf->nlist == sourceIvf->nlist &&
+                             targetIvf->code_size == sourceIvf->code_size &&
+                             sameQuantizer(targetIvf->quantizer, sourceIvf->quantizer) &&
+                             (!targetRefine || (targetRefineFlat && sourceRefineFlat &&
+                                                targetRefineFlat->code_size == sourceRefineFlat->code_size));
+
+        if (targetFlat && sourceFlat && targetFlat->code_size == sourceFlat->code_size) {
+            // 扁平编码：直接拷贝存活行的编码
+            const size_t codeSize = sourceFlat->code_size;
+            for (size_t row = 0; row < view.rows(); ++row) {
+                if (view.deleted.test(row)) {
+                    continue;
+                }
+                const size_t offset = targetFlat->codes.size();
+                targetFlat->codes.resize(offset + codeSize);
+                std::memcpy(targetFlat->codes.data() + offset,
+                            sourceFlat->codes.data() + row * codeSize, codeSize);
+                rowMap[row] = static_cast<int64_t>(target.id_map.size());
+                target.id_map.push_back(source.id_map[row]);
+            }
+            targetFlat->ntotal = static_cast<faiss::idx_t>(target.id_map.size());
+            target.ntotal = targetFlat->ntotal;
+        } else if (moveIvf) {
+            // 倒排：共享同一量化器，逐桶搬运存活条目的编码，不解码也不重新编码
+            for (size_t list = 0; list < sourceIvf->nlist; ++list) {
+                const size_t listSize = sourceIvf->invlists->list_size(list);
+                if (listSize == 0) {
+                    continue;
+                }
+                faiss::InvertedLists::ScopedIds listIds(sourceIvf->invlists, list);
+                faiss::InvertedLists::ScopedCodes listCodes(sourceIvf->invlists, list);
+                for (size_t e = 0; e < listSize; ++e) {
+                    const size_t row = static_cast<size_t>(listIds[e]);
+                    if (view.deleted.test(row)) {
+                        continue;
+                    }
+                    if (rowMap[row] < 0) {
+                        rowMap[row] = static_cast<int64_t>(target.id_map.size());
+                        target.id_map.push_back(source.id_map[row]);
+                    }
+                    targetIvf->invlists->add_entry(list, rowMap[row],
+                                                   listCodes.get() + e * sourceIvf->code_size);
+                }
+            }
+            const faiss::idx_t total = static_cast<faiss::idx_t>(target.id_map.size());
+            targetIvf->ntotal = total;
+
+            // 精排向量按新行号排列
+            if (targetRefine) {
+                const size_t codeSize = sourceRefineFlat->code_size;
+                targetRefineFlat->codes.resize(static_cast<size_t>(total) * codeSize);
+                for (size_t row = 0; row < rowMap.size(); ++row) {
+                    if (rowMap[row] >= 0) {
+                        std::memcpy(targetRefineFlat->codes.data() + rowMap[row] * codeSize,
+                                    sourceRefineFlat->codes.data() + row * codeSize, codeSize);
+                    }
+                }
+                targetRefineFlat->ntotal = total;
+                targetRefine->ntotal = total;
+            }
+            target.ntotal = total;
+        } else {
+            // 通用：取回原始向量后重新添加。优先向量存储；倒排段按桶内偏移解码，不依赖直接映射
+            const auto offsets = ivfRowOffsets(source.index, view.rows());
+
+            std::vector<float> vec(dimension_);
+            for (size_t row = 0; row < view.rows(); ++row) {
+                if (view.deleted.test(row)) {
+                    continue;
+                }
+                const int64_t id = source.id_map[row];
+                if (!snap.store || !snap.store->get(id, vec.data())) {
+                    reconstructRow(source.index, row, offsets, vec.data());
+                }
+                rowMap[row] = static_cast<int64_t>(target.ntotal + batchIds.size());
+                batch.insert(batch.end(), vec.begin(), vec.end());
+                batchIds.push_back(id);
+                if (batchIds.size() >= kMergeBatchRows) {
+                    flushBatch();
+                }
+            }
+            flushBatch();
+        }
+    }
+
+    compaction.merged = std::move(merged);
+}
+
+bool FaissIndex::installMerged(Compaction& compaction) {
+    SnapshotPtr current = snapshot();
+    auto next = std::make_shared<Snapshot>(*current);
+
+    // 源段必须仍在当前快照中（clear/load/save 可能已替换）
+    std::vector<const SegmentView*> latest;
+    for (const auto& source : compaction.sources) {
+        const SegmentView* view = current->findSegment(source.segment->seq);
+        if (!view || view->segment != source.segment) {
+            return false;
+        }
+        latest.push_back(view);
+    }
+
+    Segment& merged = *compaction.merged;
+    merged.seq = allocateSegmentSeq();
+    if (!next->emptyIndex) {
+        next->emptyIndex = compaction.emptyIndex;
+    }
+
+    // 合并期间新增的删除：映射到新段的行号
+    SegmentView mergedView;
+    for (size_t s = 0; s < compaction.sources.size(); ++s) {
+        const DeletedRows& before = compaction.sources[s].deleted;
+        const DeletedRows& after = latest[s]->deleted;
+        if (after.count == before.count) {
+            continue;
+        }
+        const auto& rowMap = compaction.rowMaps[s];
+        for (size_t row = 0; row < rowMap.size(); ++row) {
+            if (rowMap[row] >= 0 && after.test(row) && !before.test(row)) {
+                mergedView.deleted.set(static_cast<size_t>(rowMap[row]));
+            }
+        }
+    }
+
+    // 新段放在第一个源段的位置，其余源段移除
+    std::vector<SegmentView> segments;
+    bool inserted = false;
+    for (const auto& view : current->segments) {
+        bool isSource = std::any_of(compaction.sources.begin(), compaction.sources.end(),
+                                    [&view](const SegmentView& source) {
+                                        return source.segment == view.segment;
+                                    });
+        if (!isSource) {
+            segments.push_back(view);
+        } else if (!inserted) {
+            mergedView.segment = compaction.merged;
+            segments.push_back(mergedView);
+            inserted = true;
+        }
+    }
+    next->segments = std::move(segments);
+    publish(next);
+
+    // 存活行搬迁到新段（位置表未构建时由快照延迟重建）
+    std::unique_lock<std::shared_mutex> idLock(idMutex_);
+    if (locationsReady_) {
+        for (size_t s = 0; s < compaction.sources.size(); ++s) {
+            const uint64_t seq = compaction.sources[s].segment->seq;
+            const auto& idMap = compaction.sources[s].segment->index->id_map;
+            const auto& rowMap = compaction.rowMaps[s];
+            for (size_t row = 0; row < rowMap.size(); ++row) {
+                if (rowMap[row] < 0) {
+                    continue;
+                }
+                auto it = locations_.find(idMap[row]);
+                if (it != locations_.end() && it->second.seq == seq && it->second.row == row) {
+                    it->second = Location{merged.seq, static_cast<size_t>(rowMap[row])};
+                }
+            }
+        }
+    }
+    return true;
+}
+
+FaissIndex::Compaction FaissIndex::planCompaction(const Snapshot& snap,
+                                                  const std::vector<size_t>& picked) const {
+    Compaction compaction;
+    for (size_t i : picked) {
+        compaction.sources.push_back(snap.segments[i]);
+    }
+
+    compaction.emptyIndex = snap.emptyIndex;
+    if (!compaction.emptyIndex) {
+        Snapshot probe(snap);
+        ensureEmptyIndex(probe);
+        compaction.emptyIndex = probe.emptyIndex;
+    }
+    return compaction;
+}
+
+bool FaissIndex::needsPurge(const Snapshot& snap, const SegmentView& view) {
+    return view.deleted.count > 0 &&
+           static_cast<double>(view.deleted.count) >= snap.purgeRatio * view.rows();
+}
+
+std::vector<size_t> FaissIndex::pickCompaction(const Snapshot& snap) const {
+    // 删除比例超过阈值的段单独重写，回收空间并减少搜索时跳过的行
+    for (size_t i = 0; i < snap.segments.size(); ++i) {
+        if (needsPurge(snap, snap.segments[i]) && !unmergeable_.count(snap.segments[i].segment->seq)) {
+            return {i};
+        }
+    }
+
+    // 需要重建的类型（HNSW 等）每次合并都重新插入全部行：大段不再参与分层合并，限制重复重建
+    const faiss::Index* base = snap.emptyIndex ? snap.emptyIndex->index
+                             : snap.segments.empty() ? nullptr
+                             : snap.segments.front().segment->index->index;
+    const bool rebuilds = base && !mergesByCodes(base);
+
+    // 分层合并：按存活行数分层（每层 kCompactionFanIn 倍），同层积累 kCompactionFanIn 个段时合并
+    std::map<int, std::vector<size_t>> tiers;
+    for (size_t i = 0; i < snap.segments.size(); ++i) {
+        if (unmergeable_.count(snap.segments[i].segment->seq) ||
+            (rebuilds && snap.segments[i].liveRows() > kMaxRebuildMergeRows)) {
+            continue;
+        }
+        size_t capacity = kDeltaSealRows;
+        int tier = 0;
+        while (snap.segments[i].liveRows() > capacity) {
+            capacity *= kCompactionFanIn;
+            tier++;
+        }
+        auto& members = tiers[tier];
+        members.push_back(i);
+        if (members.size() >= kCompactionFanIn) {
+            return members;
+        }
+    }
+    return {};
+}
+
+void FaissIndex::notifyCompactor() {
+    {
+        std::lock_guard<std::mutex> lock(compactMutex_);
+        compactPending_ = true;
+        if (!compactor_.joinable()) {
+            compactor_ = std::thread(&FaissIndex::compactionLoop, this);
+        }
+    }
+    compactCv_.notify_one();
+}
+
+void FaissIndex::compactionLoop() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(compactMutex_);
+            compactCv_.wait(lock, [this] { return compactPending_ || stopping_; });
+            if (stopping_) {
+                return;
+            }
+            compactPending_ = false;
+        }
+
+        // 不持写锁构建合并段，读写操作照常进行；完成后持锁替换
+        while (!stopping_) {
+            SnapshotPtr snap = snapshot();
+            std::vector<size_t> picked = pickCompaction(*snap);
+            if (picked.empty()) {
+                break;
+            }
+
+            Compaction compaction;
+            try {
+                compaction = planCompaction(*snap, picked);
+                buildMerged(compaction, *snap);
+            } catch (const std::exception& e) {
+                // 同一组段下次仍会失败：标记后不再选取，避免每次唤醒都重试
+                std::cerr << "Failed to compact index segments, excluding them from compaction: "
+                          << e.what() << std::endl;
+                for (size_t i : picked) {
+                    unmergeable_.insert(snap->segments[i].segment->seq);
+                }
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(writeMutex_);
+            installMerged(compaction);
+        }
+    }
+}
+
+void FaissIndex::ensureLocations() const {
+    {
+        std::shared_lock<std::shared_mutex> lock(idMutex_);
+        if (locationsReady_) {
+            return;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(idMutex_);
+    if (locationsReady_) {
+        return;
+    }
+
+    // 加载时跳过了位置表构建：持锁读取最新快照，写线程在发布后才登记位置，不会遗漏
+    SnapshotPtr snap = snapshot();
+    locations_.reserve(snap->size());
+    for (const auto& view : snap->segments) {
+        const auto& idMap = view.segment->index->id_map;
+        for (size_t row = 0; row < idMap.size(); ++row) {
+            if (!view.deleted.test(row)) {
+                locations_[idMap[row]] = Location{view.segment->seq, row};
+            }
+        }
+    }
+    for (size_t row = 0; row < snap->deltaRows; ++row) {
+        if (!snap->deltaDeleted.test(row)) {
+            locations_[snap->deltaId(row)] = Location{0, row};
+        }
+    }
+    locationsReady_ = true;
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::searchFlat(
+    const Snapshot& snap, const float* queries, size_t nQueries, int topK, float threshold,
+    const SearchParams& params) const {
+
+    // 限制topK不超过索引大小
+    topK = std::min(topK, static_cast<int>(snap.size()));
+
+    const SearchParams resolved = resolveParams(snap, params);
+
+    // MMR 多样化：先取 mmrFetchFactor 倍候选，再从中选出 topK 个
+    const bool diversify = params.mmrLambda > 0.0f && params.mmrLambda < 1.0f;
+    const int candidateK = diversify
+        ? static_cast<int>(std::min<int64_t>(mmrCandidateCount(topK, params),
+                                             static_cast<int64_t>(snap.size())))
+        : topK;
+
+    // 两阶段搜索：压缩索引召回 rerankFactor 倍候选，再用全精度向量精排
+    const int rerankFactor = params.rerankFactor > 0 ? params.rerankFactor : snap.rerankFactor;
+    const bool rerank = rerankFactor > 1 && snap.store && snap.store->isOpen();
+    const int fetchK = rerank
+        ? static_cast<int>(std::min<int64_t>(static_cast<int64_t>(candidateK) * rerankFactor,
+                                             static_cast<int64_t>(snap.size())))
+        : candidateK;
+
+    // 阈值只截断 Top-K 结果：文本查询的相似度普遍偏低，下推为范围搜索会
+    // 收集阈值以上的几乎全部向量；需要全部结果时使用 rangeSearch
+    std::vector<std::vector<SearchResult>> allResults =
+        knnSearchInternal(snap, queries, nQueries, fetchK, resolved);
+
+    // 结果已按相似度降序排列，截掉低于阈值的部分（精排时由精排按全精度分数过滤）
+    if (!rerank) {
+        for (auto& results : allResults) {
+            auto firstBelow = std::find_if(results.begin(), results.end(),
+                                           [threshold](const SearchResult& r) {
+                                               return r.score < threshold;
+                                           });
+            results.erase(firstBelow, results.end());
+        }
+    }
+
+    if (rerank) {
+        for (size_t i = 0; i < nQueries; ++i) {
+            rerankWithStore(snap, queries + i * dimension_, allResults[i], candidateK, threshold);
+        }
+    }
+
+    if (diversify) {
+        for (auto& results : allResults) {
+            diversifyResults(snap, results, topK, params.mmrLambda);
+        }
+    }
+
+    return allResults;
+}
+
+bool FaissIndex::lookupVector(const Snapshot& snap, int64_t id, float* out,
+                              bool storedOnly) const {
+    if (snap.store && snap.store->isOpen() && snap.store->get(id, out)) {
+        return true;
+    }
+    if (storedOnly) {
+        return false;
+    }
+
+    ensureLocations();
+    Location location;
+    {
+        std::shared_lock<std::shared_mutex> idLock(idMutex_);
+        auto it = locations_.find(id);
+        if (it == locations_.end()) {
+            return false;
+        }
+        location = it->second;
+    }
+
+    // 位置表对应最新快照，需确认该位置在本快照中仍是同一ID
+    if (location.seq == 0) {
+        if (location.row >= snap.deltaRows || snap.deltaId(location.row) != id) {
+            return false;
+        }
+        const float* vec = snap.deltaVector(location.row, dimension_);
+        std::copy(vec, vec + dimension_, out);
+        return true;
+    }
+
+    const SegmentView* view = snap.findSegment(location.seq);
+    if (!view || location.row >= view->rows() ||
+        view->segment->index->id_map[location.row] != id) {
+        return false;
+    }
+    try {
+        // IVF 未建立直接映射时无法按行解码
+        view->segment->index->index->reconstruct(static_cast<faiss::idx_t>(location.row), out);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+void FaissIndex::diversifyResults(const Snapshot& snap, std::vector<SearchResult>& results,
+                                  int topK, float lambda) const {
+    if (results.size() <= 1) {
+        return;
+    }
+
+    std::vector<float> vectors(results.size() * dimension_);
+    std::vector<char> found(results.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        found[i] = lookupVector(snap, results[i].id, vectors.data() + i * dimension_);
+    }
+    selectDiverse(results, vectors.data(), found, dimension_, topK, lambda);
+}
+
+int FaissIndex::mmrCandidateCount(int topK, const SearchParams& params) {
+    const int factor = params.mmrFetchFactor > 0 ? params.mmrFetchFactor : kMmrFetchFactor;
+    return static_cast<int>(std::min<int64_t>(static_cast<int64_t>(topK) * factor,
+                                              std::numeric_limits<int>::max()));
+}
+
+void FaissIndex::selectDiverse(std::vector<SearchResult>& results, const float* vectors,
+                               const std::vector<char>& found, int dimension, int topK,
+                               float lambda) {
+    const size_t n = results.size();
+    const size_t keep = std::min(n, static_cast<size_t>(std::max(topK, 0)));
+    if (keep <= 1) {
+        results.erase(results.begin() + keep, results.end());
+        return;
+    }
+
+    const size_t missing = static_cast<size_t>(std::count(found.begin(), found.end(), 0));
+    if (missing == n) {
+        std::cerr << "MMR diversification skipped: no candidate vectors available" << std::endl;
+        results.erase(results.begin() + keep, results.end());
+        return;
+    }
+    if (missing > 0) {
+        std::cerr << "MMR diversification: " << missing << " of " << n
+                  << " candidates have no vector and are ranked by relevance only" << std::endl;
+    }
+
+    // 贪心选择；每选中一个只计算它与其余候选的相似度（内积，CLIP 特征已归一化即余弦），
+    // 共 keep 行，不构建 n x n 矩阵
+    std::vector<float> similarity(n);
+    std::vector<float> maxSimilarity(n, 0.0f);
+    std::vector<char> selected(n, 0);
+    std::vector<SearchResult> diversified;
+    diversified.reserve(keep);
+    for (size_t round = 0; round < keep; ++round) {
+        size_t best = n;
+        float bestValue = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < n; ++i) {
+            if (selected[i]) {
+                continue;
+            }
+            const float value = lambda * results[i].score - (1.0f - lambda) * maxSimilarity[i];
+            if (value > bestValue) {
+                bestValue = value;
+                best = i;
+            }
+        }
+
+        selected[best] = 1;
+        diversified.push_back(results[best]);
+        if (!found[best] || round + 1 == keep) {
+            continue;
+        }
+        faiss::fvec_inner_products_ny(similarity.data(), vectors + best * dimension, vectors,
+                                      dimension, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (!selected[i] && found[i]) {
+                maxSimilarity[i] = std::max(maxSimilarity[i], similarity[i]);
+            }
+        }
+    }
+
+    results = std::move(diversified);
+}
+
+FaissIndex::SearchParams FaissIndex::resolveParams(const Snapshot& snap,
+                                                  const SearchParams& params) {
+    // 未指定的探测参数取配置中的默认值
+    SearchParams resolved = params;
+    if (resolved.nprobe <= 0) {
+        resolved.nprobe = snap.nprobe;
+    }
+    if (resolved.efSearch <= 0) {
+        resolved.efSearch = snap.efSearch;
+    }
+    return resolved;
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::rangeSearchFlat(
+    const Snapshot& snap, const float* queries, size_t nQueries, float minScore, int maxResults,
+    const SearchParams& params) const {
+
+    const SearchParams resolved = resolveParams(snap, params);
+    const int all = static_cast<int>(
+        std::min<size_t>(snap.size(), static_cast<size_t>(std::numeric_limits<int>::max())));
+    const int limit = maxResults > 0 ? std::min(maxResults, all) : all;
+    const bool rerank = (params.rerankFactor > 0 ? params.rerankFactor : snap.rerankFactor) > 1 &&
+                        snap.store && snap.store->isOpen();
+
+    std::vector<std::vector<SearchResult>> allResults;
+    if (supportsRangeSearch(snap)) {
+        // 精排时先不截断，精排后的分数可能改变排序
+        allResults = rangeSearchInternal(snap, queries, nQueries, minScore,
+                                         rerank ? all : limit, resolved);
+    } else {
+        // 不支持范围搜索的类型：K 倍增，直到第 K 个结果低于阈值或取完
+        allResults.resize(nQueries);
+        for (size_t i = 0; i < nQueries; ++i) {
+            const float* query = queries + i * dimension_;
+            int k = std::min(kRangeSearchInitialK, limit);
+            for (;;) {
+                auto found = knnSearchInternal(snap, query, 1, k, resolved);
+                std::vector<SearchResult>& results = found[0];
+                const bool exhausted = results.size() < static_cast<size_t>(k) || k >= limit ||
+                                       results.back().score < minScore;
+                if (exhausted) {
+                    auto firstBelow = std::find_if(results.begin(), results.end(),
+                                                   [minScore](const SearchResult& r) {
+                                                       return r.score < minScore;
+                                                   });
+                    results.erase(firstBelow, results.end());
+                    allResults[i] = std::move(results);
+                    break;
+                }
+                k = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(k) * 2, limit));
+            }
+        }
+    }
+
+    if (rerank) {
+        for (size_t i = 0; i < nQueries; ++i) {
+            rerankWithStore(snap, queries + i * dimension_, allResults[i], limit, minScore);
+        }
+    }
+    return allResults;
+}
+
+void FaissIndex::rerankWithStore(const Snapshot& snap, const float* query,
+                                 std::vector<SearchResult>& results,
+                                 int topK, float threshold) const {
+    const bool innerProduct = snap.innerProduct;
+    std::vector<float> stored(dimension_);
+    for (auto& result : results) {
+        if (!snap.store->get(result.id, stored.data())) {
+            // 缺少原始向量时保留近似分数
+            continue;
+        }
+        result.distance = innerProduct
+            ? faiss::fvec_inner_product(query, stored.data(), dimension_)
+            : faiss::fvec_L2sqr(query, stored.data(), dimension_);
+        result.score = toScore(innerProduct, result.distance);
+    }
+
+    const size_t keep = std::min(results.size(), static_cast<size_t>(topK));
+    std::partial_sort(results.begin(), results.begin() + keep, results.end(),
+                      [](const SearchResult& a, const SearchResult& b) {
+                          return a.score > b.score;
+                      });
+    results.erase(results.begin() + keep, results.end());
+
+    auto firstBelow = std::find_if(results.begin(), results.end(),
+                                   [threshold](const SearchResult& r) {
+                                       return r.score < threshold;
+                                   });
+    results.erase(firstBelow, results.end());
+}
+
+void FaissIndex::searchSegments(
+    const Snapshot& snap,
+    const std::function<void(const SegmentView&, std::vector<std::vector<SearchResult>>&)>& searchOne,
+    std::vector<std::vector<SearchResult>>& allResults) const {
+
+    const size_t nSegments = snap.segments.size();
+    std::vector<std::vector<std::vector<SearchResult>>> parts(nSegments,
+        std::vector<std::vector<SearchResult>>(allResults.size()));
+
+    // 多个段时在共享线程池上并行搜索：当前线程与至多 nSegments-1 个工作线程轮流领取下一个段。
+    // 当前线程只等待已领取的段完成，不等待仍在线程池中排队的任务，线程池忙时独自完成剩余的段；
+    // 共享状态由排队的任务共同持有，迟到的任务领不到段即退出，不会访问本函数的局部变量
+    struct State {
+        std::atomic<size_t> nextSegment{0};
+        size_t completed = 0;                        // 已完成的段数（持 mutex）
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+        std::function<void(size_t)> searchSegment;   // 只在领到段（调用方仍在等待）时调用
+    };
+    auto state = std::make_shared<State>();
+    state->searchSegment = [&snap, &searchOne, &parts](size_t s) {
+        searchOne(snap.segments[s], parts[s]);
+    };
+
+    auto drain = [nSegments](const std::shared_ptr<State>& state) {
+        for (size_t s = state->nextSegment++; s < nSegments; s = state->nextSegment++) {
+            std::exception_ptr error;
+            try {
+                state->searchSegment(s);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (++state->completed == nSegments) {
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    SegmentWorkers& workers = segmentWorkers();
+    const size_t helpers = nSegments > 1 ? std::min(workers.size(), nSegments - 1) : 0;
+    for (size_t i = 0; i < helpers; ++i) {
+        workers.submit([state, drain] { drain(state); });
+    }
+    drain(state);
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->completed == nSegments; });
+    }
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+
+    for (auto& part : parts) {
+        for (size_t i = 0; i < allResults.size(); ++i) {
+            allResults[i].insert(allResults[i].end(), part[i].begin(), part[i].end());
+        }
+    }
+}
+
+bool FaissIndex::searchSubset(const Snapshot& snap, const SegmentView& view,
+                              const IdFilter& filter, const float* queries, size_t nQueries,
+                              std::vector<std::vector<SearchResult>>& out) const {
+    const faiss::IndexIDMap& index = *view.segment->index;
+    const bool useStore = snap.store && snap.store->isOpen();
+    if (!useStore && dynamic_cast<const faiss::IndexIVF*>(index.index)) {
+        return false;
+    }
+
+    // 扫描ID映射收集集合内的存活行（只做位图查询，不计算距离）
+    std::vector<size_t> rows;
+    for (size_t row = 0; row < index.id_map.size(); ++row) {
+        if (!view.deleted.test(row) && filter.contains(index.id_map[row])) {
+            rows.push_back(row);
+        }
+    }
+    if (rows.empty()) {
+        return true;
+    }
+
+    // 取回向量：优先用向量存储中的原始向量，否则由索引解码（Flat 为精确值）
+    std::vector<float> vectors(rows.size() * dimension_);
+    std::vector<int64_t> ids;
+    ids.reserve(rows.size());
+    size_t n = 0;
+    for (size_t row : rows) {
+        float* dst = vectors.data() + n * dimension_;
+        const int64_t id = index.id_map[row];
+        if (useStore) {
+            if (!snap.store->get(id, dst)) {
+                continue;
+            }
+        } else {
+            index.index->reconstruct(static_cast<faiss::idx_t>(row), dst);
+        }
+        ids.push_back(id);
+        n++;
+    }
+
+    const bool innerProduct = snap.innerProduct;
+    std::vector<float> distances(n);
+    for (size_t i = 0; i < nQueries; ++i) {
+        const float* query = queries + i * dimension_;
+        if (innerProduct) {
+            faiss::fvec_inner_products_ny(distances.data(), query, vectors.data(), dimension_, n);
+        } else {
+            faiss::fvec_L2sqr_ny(distances.data(), query, vectors.data(), dimension_, n);
+        }
+        auto& results = out[i];
+        results.reserve(n);
+        for (size_t j = 0; j < n; ++j) {
+            results.emplace_back(ids[j], distances[j], toScore(innerProduct, distances[j]));
+        }
+    }
+    return true;
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::knnSearchInternal(
+    const Snapshot& snap, const float* queries, size_t nQueries, int topK,
+    const SearchParams& params) const {
+
+    std::vector<std::vector<SearchResult>> allResults(nQueries);
+    const bool innerProduct = snap.innerProduct;
+    const IdFilter* filter = params.filter.get();
+    const bool bruteForce = filter && filter->size() <= kFilterBruteForceIds;
+
+    searchSegments(snap, [&](const SegmentView& view, std::vector<std::vector<SearchResult>>& out) {
+        SearchParams segmentParams = params;
+        if (bruteForce) {
+            if (searchSubset(snap, view, *filter, queries, nQueries, out)) {
+                return;
+            }
+            // IVF 无法按行取回向量：探测全部倒排桶（FAISS 截断为 nlist），由选择器限定为过滤集合
+            segmentParams.nprobe = std::numeric_limits<int>::max();
+        }
+
+        // 直接搜索内部索引，返回行号，用删除位图过滤后再映射为ID
+        const faiss::IndexIDMap& index = *view.segment->index;
+        LiveRowSelector<DeletedRows> selector(view.deleted, index.id_map.data(), filter);
+        FaissSearchParameters searchParams;
+        buildSearchParameters(index.index, segmentParams,
+                              view.deleted.count > 0 || filter ? &selector : nullptr, searchParams);
+
+        // 选择器无法下推时多取候选（按删除行数与过滤集合的选择性放大），过滤后尽量凑满 topK
+        size_t k = static_cast<size_t>(topK);
+        if (!searchParams.filtered) {
+            if (filter) {
+                k *= std::max<size_t>(1, view.rows() / std::max<size_t>(1, filter->size()));
+            }
+            k += view.deleted.count;
+        }
+        k = std::min(k, searchParams.filtered ? view.liveRows() : view.rows());
+        if (k == 0) {
+            return;
+        }
+
+        std::vector<float> distances(nQueries * k);
+        std::vector<faiss::idx_t> rows(nQueries * k);
+        index.index->search(static_cast<faiss::idx_t>(nQueries), queries, static_cast<faiss::idx_t>(k),
+                            distances.data(), rows.data(), searchParams.active);
+
+        for (size_t i = 0; i < nQueries; ++i) {
+            auto& results = out[i];
+            results.reserve(k);
+            for (size_t j = 0; j < k; ++j) {
+                const size_t idx = i * k + j;
+                // 跳过无效行（-1表示未找到）与被选择器排除的行（选择器未下推时）
+                if (rows[idx] < 0 || !selector.is_member(rows[idx])) {
+                    continue;
+                }
+                results.emplace_back(index.id_map[rows[idx]], distances[idx],
+                                     toScore(innerProduct, distances[idx]));
+            }
+        }
+    }, allResults);
+
+    if (snap.deltaRows > 0) {
+        // 增量缓冲暴力检索，与各段结果合并
+        std::vector<float> deltaDistances(snap.deltaRows);
+        for (size_t i = 0; i < nQueries; ++i) {
+            computeDeltaDistances(snap, queries + i * dimension_, deltaDistances.data());
+            for (size_t row = 0; row < snap.deltaRows; ++row) {
+                if (!snap.deltaDeleted.test(row) && (!filter || filter->contains(snap.deltaId(row)))) {
+                    allResults[i].emplace_back(snap.deltaId(row), deltaDistances[row],
+                                               toScore(innerProduct, deltaDistances[row]));
+                }
+            }
+        }
+    }
+
+    // 按分数降序截取前 topK 个
+    for (auto& results : allResults) {
+        const size_t keep = std::min(results.size(), static_cast<size_t>(topK));
+        std::partial_sort(results.begin(), results.begin() + keep, results.end(),
+                          [](const SearchResult& a, const SearchResult& b) {
+                              return a.score > b.score;
+                          });
+        results.erase(results.begin() + keep, results.end());
+    }
+
+    return allResults;
+}
+
+std::vector<std::vector<FaissIndex::SearchResult>> FaissIndex::rangeSearchInternal(
+    const Snapshot& snap, const float* queries, size_t nQueries, float minScore, int maxResults,
+    const SearchParams& params) const {
+
+    std::vector<std::vector<SearchResult>> allResults(nQueries);
+    const bool innerProduct = snap.innerProduct;
+
+    // 分数阈值换算为距离半径：内积即余弦；归一化向量的平方L2 = 2 - 2cos
+    const float radius = innerProduct ? minScore : 2.0f * (1.0f - minScore);
+    const IdFilter* filter = params.filter.get();
+
+    searchSegments(snap, [&](const SegmentView& view, std::vector<std::vector<SearchResult>>& out) {
+        if (view.rows() == 0) {
+            return;
+        }
+
+        const faiss::IndexIDMap& index = *view.segment->index;
+        LiveRowSelector<DeletedRows> selector(view.deleted, index.id_map.data(), filter);
+        FaissSearchParameters searchParams;
+        buildSearchParameters(index.index, params,
+                              view.deleted.count > 0 || filter ? &selector : nullptr, searchParams);
+
+        faiss::RangeSearchResult rangeResult(nQueries);
+        index.index->range_search(static_cast<faiss::idx_t>(nQueries), queries, radius,
+                                  &rangeResult, searchParams.active);
+
+        for (size_t i = 0; i < nQueries; ++i) {
+            for (size_t j = rangeResult.lims[i]; j < rangeResult.lims[i + 1]; ++j) {
+                const faiss::idx_t row = rangeResult.labels[j];
+                if (!selector.is_member(row)) {
+                    continue;
+                }
+                out[i].emplace_back(index.id_map[row], rangeResult.distances[j],
+                                    toScore(innerProduct, rangeResult.distances[j]));
+            }
+        }
+    }, allResults);
+
+    if (snap.deltaRows > 0) {
+        std::vector<float> deltaDistances(snap.deltaRows);
+        for (size_t i = 0; i < nQueries; ++i) {
+            computeDeltaDistances(snap, queries + i * dimension_, deltaDistances.data());
+            for (size_t row = 0; row < snap.deltaRows; ++row) {
+                float score = toScore(innerProduct, deltaDistances[row]);
+                if (score >= minScore && !snap.deltaDeleted.test(row) &&
+                    (!filter || filter->contains(snap.deltaId(row)))) {
+                    allResults[i].emplace_back(snap.deltaId(row), deltaDistances[row], score);
+                }
+            }
+        }
+    }
+
+    // 按分数降序截取前 maxResults 个
+    for (auto& results : allResults) {
+        const size_t keep = std::min(results.size(), static_cast<size_t>(std::max(maxResults, 0)));
+        std::partial_sort(results.begin(), results.begin() + keep, results.end(),
+                          [](const SearchResult& a, const SearchResult& b) {
+                              return a.score > b.score;
+                          });
+        results.erase(results.begin() + keep, results.end());
+    }
+
+    return allResults;
+}
+
+void FaissIndex::computeDeltaDistances(const Snapshot& snap, const float* query, float* out) const {
+    for (size_t row = 0; row < snap.deltaRows; row += kDeltaChunkRows) {
+        const DeltaChunk& chunk = *snap.chunks[row / kDeltaChunkRows];
+        const size_t n = std::min(kDeltaChunkRows, snap.deltaRows - row);
+        if (snap.innerProduct) {
+            faiss::fvec_inner_products_ny(out + row, query, chunk.vectors.get(), dimension_, n);
+        } else {
+            faiss::fvec_L2sqr_ny(out + row, query, chunk.vectors.get(), dimension_, n);
+        }
+    }
+}
+
+bool FaissIndex::supportsRangeSearch(const Snapshot& snap) {
+    const faiss::Index* base = nullptr;
+    if (snap.emptyIndex) {
+        base = snap.emptyIndex->index;
+    } else if (!snap.segments.empty()) {
+        base = snap.segments.front().segment->index->index;
+    }
+    return dynamic_cast<const faiss::IndexFlat*>(base) != nullptr ||
+           dynamic_cast<const faiss::IndexIVF*>(base) != nullptr;
 }
 
 } // namespace index
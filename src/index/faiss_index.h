@@ -1,13 +1,23 @@
 #pragma once
 
-#include <faiss/IndexFlat.h>
+#include <faiss/Index.h>
 #include <faiss/IndexIDMap.h>
 #include <faiss/index_io.h>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include "delta_log.h"
+#include "id_filter.h"
+#include "vector_store.h"
 
 namespace vindex {
 namespace index {
@@ -17,63 +27,280 @@ namespace index {
  *
  * 使用FAISS进行高效的相似度搜索
  * 支持：添加、删除、搜索、持久化
+ * 索引类型通过 index_factory 描述串配置（Flat / IVF-Flat / IVF-PQ / HNSW），
+ * 需要训练的类型在积累足够样本后自动训练，训练前的向量暂存并暴力检索。
+ *
+ * 存储结构（LSM 式分段）：
+ * - 新增向量追加到增量缓冲，达到阈值后封存为只读段
+ * - 删除只在所在段的删除位图中置位，不移动任何数据；搜索时位图经 IDSelector 下推跳过
+ * - 后台线程按层合并小段、清理删除比例过高的段，合并完成后原子替换
+ * - 搜索并行扫描各段与增量缓冲，合并 Top-K
+ *
+ * 线程模型：多读单写。
+ * - 读操作（search / size / contains 等）原子地取得当前快照后在其上执行，不等待写操作
+ * - 写操作（add / remove 等）由内部互斥锁串行化，只发布新快照，不修改已发布的数据
  */
 class FaissIndex {
 public:
+    /**
+     * @brief 距离度量
+     *
+     * CLIP 特征已做 L2 归一化，内积即余弦相似度，分数可直接取自索引内核
+     */
+    enum class Metric {
+        InnerProduct,   // 内积（默认）
+        L2              // 平方L2距离（兼容旧索引）
+    };
+
+    /**
+     * @brief 索引配置
+     *
+     * type 使用 FAISS index_factory 语法（不含 IDMap 前缀），例如：
+     *   "Flat"          暴力检索（默认）
+     *   "IVF1024,Flat"  倒排 + 原始向量
+     *   "IVF1024,PQ64"  倒排 + 乘积量化
+     *   "HNSW32"        HNSW 图索引
+     *   "SQ8"           8bit 标量量化（内存为 float32 的 1/4）
+     *   "SQfp16"        半精度存储（内存为 float32 的 1/2）
+     *   "IVF1024,SQ8"   倒排 + 标量量化
+     */
+    struct IndexConfig {
+        std::string type;     // index_factory 描述串
+        Metric metric;        // 距离度量
+        size_t trainSize;     // 训练采样数（0 = 按类型自动推算）
+        bool mmap;            // 加载时映射倒排表（IVF 类型），首次写入时再读入内存
+        float refineFactor;   // >1 时在内存中额外保存原始向量（RFlat），取 refineFactor*K 个候选精排
+        int rerankFactor;     // >1 时取 rerankFactor*K 个候选，用向量存储（磁盘映射）中的原始向量精排
+        float purgeRatio;     // 段内已删除行占比达到该值时由后台物理清除
+        int nprobe;           // 默认 IVF 探测桶数（0 = 索引自身的默认值），可由自动调优给出
+        int efSearch;         // 默认 HNSW 搜索队列长度（0 = 索引自身的默认值）
+
+        IndexConfig(const std::string& type_ = "Flat",
+                    Metric metric_ = Metric::InnerProduct,
+                    size_t trainSize_ = 0)
+            : type(type_), metric(metric_), trainSize(trainSize_), mmap(true)
+            , refineFactor(0.0f), rerankFactor(0), purgeRatio(0.2f), nprobe(0), efSearch(0) {}
+    };
+
+    /**
+     * @brief 单次搜索参数（0 表示使用索引默认值）
+     */
+    struct SearchParams {
+        int nprobe;           // IVF 探测的倒排桶数
+        int efSearch;         // HNSW 搜索队列长度
+        float refineFactor;   // RFlat 精排候选倍数（仅 refineFactor 配置的索引有效）
+        int rerankFactor;     // 向量存储精排候选倍数（需挂载向量存储）
+        float mmrLambda;      // 介于 0 和 1 之间时按 MMR 多样化结果：越小越偏向多样性（0 = 关闭）
+        int mmrFetchFactor;   // MMR 候选倍数（0 = 默认 4 倍 topK）
+        std::shared_ptr<const IdFilter> filter;   // 只在该ID集合内搜索（可选，下推到 FAISS）
+
+        SearchParams(int nprobe_ = 0, int efSearch_ = 0, float refineFactor_ = 0.0f,
+                     int rerankFactor_ = 0)
+            : nprobe(nprobe_), efSearch(efSearch_), refineFactor(refineFactor_)
+            , rerankFactor(rerankFactor_), mmrLambda(0.0f), mmrFetchFactor(0) {}
+    };
+
+    /**
+     * @brief 索引内存占用（估算值）
+     */
+    struct MemoryUsage {
+        size_t heapBytes;     // 堆内存：编码、ID映射、图结构、精排向量、暂存区
+        size_t mappedBytes;   // 文件映射：mmap 加载的倒排表
+        size_t storeBytes;    // 向量存储文件（按需映射，不计入每向量开销）
+        size_t vectorCount;   // 向量数量
+
+        MemoryUsage() : heapBytes(0), mappedBytes(0), storeBytes(0), vectorCount(0) {}
+
+        size_t bytesPerVector() const {
+            return vectorCount > 0 ? (heapBytes + mappedBytes) / vectorCount : 0;
+        }
+    };
+
     /**
      * @brief 搜索结果
      */
     struct SearchResult {
         int64_t id;           // 向量ID
-        float distance;       // L2距离
-        float score;          // 相似度分数 [0, 1]
-
-        SearchResult(int64_t id_, float dist)
-            : id(id_), distance(dist) {
-            // 将L2距离转换为相似度分数
-            // 对于归一化向量：L2距离 = sqrt(2 - 2*cosine_similarity)
-            // 因此：cosine_similarity = (2 - L2^2) / 2
-            float cosineSim = (2.0f - distance * distance) / 2.0f;
-            score = std::max(0.0f, std::min(1.0f, cosineSim));
-        }
+        float distance;       // 索引返回的原始距离（内积，或平方L2）
+        float score;          // 余弦相似度
+
+        SearchResult(int64_t id_, float distance_, float score_)
+            : id(id_), distance(distance_), score(score_) {}
     };
 
+    // 按批遍历向量的回调：(行主序向量, ID, 行数)，返回 false 时停止
+    using VectorBatchCallback = std::function<bool(const float*, const int64_t*, size_t)>;
+
     /**
      * @brief 构造函数
      * @param dimension 向量维度（CLIP默认768）
      * @param useGPU 是否使用GPU加速（暂不支持，预留接口）
      */
     explicit FaissIndex(int dimension = 768, bool useGPU = false);
+
+    /**
+     * @brief 按配置构造
+     * @param dimension 向量维度
+     * @param config 索引配置
+     * @param useGPU 是否使用GPU加速（预留）
+     */
+    FaissIndex(int dimension, const IndexConfig& config, bool useGPU = false);
     ~FaissIndex();
 
+    FaissIndex(const FaissIndex&) = delete;
+    FaissIndex& operator=(const FaissIndex&) = delete;
+
     // ==================== 索引管理 ====================
 
     /**
      * @brief 从文件加载索引
+     *
+     * 接受检查点清单，或任意 IndexIDMap 包装的单个索引文件，加载后以文件中的类型为准。
+     * config.mmap 为 true 时 IVF 倒排表以只读方式映射文件（IO_FLAG_MMAP），
+     * 启动时不拷贝数据，多个进程共享页缓存。
      * @param indexPath 索引文件路径
      * @return 是否加载成功
      */
     bool load(const std::string& indexPath);
 
     /**
-     * @brief 保存索引到文件
+     * @brief 保存索引（增量检查点）
+     *
+     * 只写出尚未保存的段（<indexPath>.seg<序号>），再原子替换 indexPath 处的清单；
+     * 清单记录段文件与各段删除行。增量缓冲达到一定行数（或未挂载增量日志）时
+     * 先封存为段，否则留在增量日志中，日志重写为只含增量缓冲，加载时回放。
+     * 训练前的暂存向量仍保存为单个 Flat 索引文件。
      * @param indexPath 索引文件路径
      * @return 是否保存成功
      */
-    bool save(const std::string& indexPath) const;
+    bool save(const std::string& indexPath);
 
     /**
      * @brief 清空索引
      */
     void clear();
 
+    /**
+     * @brief 使用指定配置重建空索引（丢弃现有向量）
+     */
+    void reset(const IndexConfig& config);
+
+    /**
+     * @brief 用样本训练索引（IVF/PQ 等类型需要）
+     *
+     * 训练后暂存的向量会写入索引。样本数超过 trainSize 时随机采样。
+     * @param samples 训练样本
+     * @return 是否训练成功
+     */
+    bool train(const std::vector<std::vector<float>>& samples);
+
+    /**
+     * @brief 用连续存储的样本训练索引
+     * @param samples n x dimension 行主序样本
+     * @param n 样本数量
+     */
+    bool train(const float* samples, size_t n);
+
+    /**
+     * @brief 索引是否已训练（Flat/HNSW 始终为 true）
+     */
+    bool isTrained() const;
+
+    /**
+     * @brief 挂载全精度向量存储
+     *
+     * 挂载后新增/删除的向量同步写入存储；配置 rerankFactor 时搜索结果用其精排
+     * @param path 存储文件路径
+     * @return 是否成功
+     */
+    bool attachVectorStore(const std::string& path);
+
+    /**
+     * @brief 获取向量存储（未挂载返回 nullptr）
+     */
+    std::shared_ptr<const VectorStore> vectorStore() const;
+
+    /**
+     * @brief 挂载增量日志（预写日志）并回放其中的记录
+     *
+     * 挂载后每次增删先追加到日志再修改索引；save() 成功后清空日志，
+     * load() 后自动回放，崩溃时不丢失上次保存之后的写入。
+     * 应在 load() 之后调用（日志记录的是相对已保存文件的增量）。
+     * @param path 日志文件路径
+     * @return 是否成功
+     */
+    bool attachDeltaLog(const std::string& path);
+
+    /**
+     * @brief 将增量日志刷到磁盘（fsync），批量导入结束时调用
+     */
+    bool syncDeltaLog();
+
+    /**
+     * @brief 换入另行构建的索引内容（后台重建完成时调用）
+     *
+     * 原子地发布 built 的段、增量缓冲与配置，换入前的搜索仍在旧快照上完成。
+     * 本索引的向量存储与增量日志保持挂载：提供原始向量时用其覆盖存储中的向量，
+     * 随后压缩存储回收失效行；日志不清空，换入后调用 save() 落盘。
+     * beginRebuild() 之后写入本索引的增删在换入后按原顺序重放到新内容上，不会丢失。
+     * @param built 已构建的索引（维度须一致，之后可直接销毁）
+     * @param vectors 需写入存储的原始向量（n x dimension，可选；存储中已有的向量不必再给出）
+     * @param ids 与 vectors 对应的ID
+     * @param n 向量数量
+     * @return 是否成功
+     */
+    bool adopt(FaissIndex& built, const float* vectors = nullptr,
+               const int64_t* ids = nullptr, size_t n = 0);
+
+    /**
+     * @brief 开始记录写入（后台重建读取数据之前调用）
+     *
+     * 之后的增删在照常生效的同时记入内存，adopt() 时重放到换入的内容上；
+     * 重建放弃时调用 endRebuild() 停止记录
+     */
+    void beginRebuild();
+
+    /**
+     * @brief 停止记录写入并丢弃记录（重建被取消或失败时调用）
+     */
+    void endRebuild();
+
+    /**
+     * @brief 向空索引批量装载向量，全部写入同一个段（离线构建用）
+     *
+     * 未训练时先用这些向量训练（样本不足时保持未训练，向量留在增量缓冲）；
+     * 按 chunkRows 分块添加，每块之后调用 onChunk(已添加数)，返回 false 时中止。
+     * 向量不经过增量日志与向量存储，也不触发后台合并。
+     * @return 成功返回 true；索引非空、训练失败或被中止时返回 false，索引保持为空
+     */
+    bool bulkLoad(const float* vectors, const int64_t* ids, size_t n, size_t chunkRows,
+                  const std::function<bool(size_t)>& onChunk = nullptr);
+
+    /**
+     * @brief 获取当前配置（返回副本，可与 setConfig()/adopt()/reset() 并发调用）
+     */
+    IndexConfig config() const;
+
+    /**
+     * @brief 更新配置而不丢弃向量
+     *
+     * 默认搜索参数、精排与清除比例立即生效；索引类型等结构参数在下次重建
+     * （DatabaseManager::rebuildIndex）后生效
+     */
+    void setConfig(const IndexConfig& config);
+
+    /**
+     * @brief 获取实际使用的距离度量（加载旧索引时以文件为准）
+     */
+    Metric metric() const;
+
     // ==================== 向量操作 ====================
 
     /**
-     * @brief 添加单个向量
+     * @brief 添加单个向量（ID已存在时覆盖旧向量）
      * @param vector 特征向量
      * @param id 向量ID（如果为-1，自动分配）
-     * @return 分配的ID
+     * @return 分配的ID；增量日志写入失败时返回 -1，索引不变
      */
     int64_t add(const std::vector<float>& vector, int64_t id = -1);
 
@@ -82,22 +309,35 @@ public:
      * @param vectors 特征向量列表
      * @param ids 输出：分配的ID列表
      * @param inputIds 输入：指定的ID列表（可选）
+     * @return 是否成功；增量日志写入失败时索引不变，ids 被清空
      */
-    void addBatch(const std::vector<std::vector<float>>& vectors,
+    bool addBatch(const std::vector<std::vector<float>>& vectors,
                   std::vector<int64_t>& ids,
                   const std::vector<int64_t>* inputIds = nullptr);
 
+    /**
+     * @brief 批量添加连续存储的向量（不做逐行拷贝）
+     * @param vectors n x dimension 行主序向量
+     * @param n 向量数量
+     * @param ids 输出：分配的ID列表
+     * @param inputIds 输入：n 个指定的ID（可选）
+     * @return 是否成功；增量日志写入失败时索引不变，ids 被清空
+     */
+    bool addBatch(const float* vectors, size_t n,
+                  std::vector<int64_t>& ids,
+                  const int64_t* inputIds = nullptr);
+
     /**
      * @brief 删除向量
      * @param id 向量ID
-     * @return 是否删除成功
+     * @return 是否删除成功（增量日志写入失败时不删除）
      */
     bool remove(int64_t id);
 
     /**
      * @brief 批量删除向量
      * @param ids 向量ID列表
-     * @return 成功删除的数量
+     * @return 成功删除的数量（增量日志写入失败时不删除，返回 0）
      */
     size_t removeBatch(const std::vector<int64_t>& ids);
 
@@ -108,28 +348,92 @@ public:
      * @param queryVector 查询向量
      * @param topK 返回Top-K个结果
      * @param threshold 相似度阈值（低于此值的结果会被过滤）
-     * @return 搜索结果列表（按相似度降序）
+     * @param params 搜索参数（nprobe / efSearch / ID过滤器 / MMR 多样化）
+     * @return 搜索结果列表（按相似度降序；启用 MMR 时按选取顺序）
      */
     std::vector<SearchResult> search(const std::vector<float>& queryVector,
                                     int topK = 10,
-                                    float threshold = 0.0f) const;
+                                    float threshold = 0.0f,
+                                    const SearchParams& params = SearchParams()) const;
 
     /**
      * @brief 批量搜索
      * @param queryVectors 查询向量列表
      * @param topK 每个查询返回Top-K个结果
      * @param threshold 相似度阈值
+     * @param params 搜索参数（nprobe / efSearch / ID过滤器）
      * @return 每个查询的搜索结果
      */
     std::vector<std::vector<SearchResult>> searchBatch(
         const std::vector<std::vector<float>>& queryVectors,
         int topK = 10,
-        float threshold = 0.0f) const;
+        float threshold = 0.0f,
+        const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief 批量搜索连续存储的查询向量（不做逐行拷贝）
+     * @param queries nQueries x dimension 行主序查询向量
+     * @param nQueries 查询数量
+     * @param topK 每个查询返回Top-K个结果
+     * @param threshold 相似度阈值
+     * @param params 搜索参数
+     * @return 每个查询的搜索结果
+     */
+    std::vector<std::vector<SearchResult>> searchBatch(
+        const float* queries,
+        size_t nQueries,
+        int topK = 10,
+        float threshold = 0.0f,
+        const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief 范围搜索：返回相似度不低于 minScore 的全部向量
+     *
+     * Flat / IVF 类型直接使用 FAISS 范围搜索，不需要预估 K；
+     * 其他类型（HNSW 等）以倍增的 K 做近邻搜索，直到结果低于阈值或达到上限
+     * @param queryVector 查询向量
+     * @param minScore 最低相似度
+     * @param maxResults 最多返回数量（0 = 不限）
+     * @param params 搜索参数（nprobe / ID过滤器等）
+     * @return 搜索结果列表（按相似度降序）
+     */
+    std::vector<SearchResult> rangeSearch(const std::vector<float>& queryVector,
+                                          float minScore,
+                                          int maxResults = 0,
+                                          const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief 批量范围搜索连续存储的查询向量
+     */
+    std::vector<std::vector<SearchResult>> rangeSearchBatch(
+        const float* queries,
+        size_t nQueries,
+        float minScore,
+        int maxResults = 0,
+        const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief MMR 多样化的候选数（topK 的 mmrFetchFactor 倍）
+     */
+    static int mmrCandidateCount(int topK, const SearchParams& params);
+
+    /**
+     * @brief MMR（最大边际相关）选取：逐个选取相关性高且与已选结果不相似的候选
+     *
+     * 得分 = lambda * 相关性 - (1 - lambda) * 与已选结果的最大相似度，保留前 topK 个。
+     * 缺少向量的候选只按相关性参与，并输出警告；全部缺少时只截断到 topK
+     * @param results 候选（按相关性降序），输出选取结果
+     * @param vectors results.size() x dimension 行主序候选向量
+     * @param found 每个候选是否有向量
+     */
+    static void selectDiverse(std::vector<SearchResult>& results, const float* vectors,
+                              const std::vector<char>& found, int dimension, int topK,
+                              float lambda);
 
     // ==================== 信息获取 ====================
 
     /**
-     * @brief 获取索引中的向量数量
+     * @brief 获取索引中的向量数量（含增量缓冲，不含已删除的向量）
      */
     size_t size() const;
 
@@ -148,7 +452,178 @@ public:
      */
     bool contains(int64_t id) const;
 
+    /**
+     * @brief 取回单个向量
+     *
+     * 优先取自向量存储（全精度），否则由索引解码（Flat 为精确值，量化索引为近似值）
+     * @param id 向量ID
+     * @return 向量，ID不存在或无法解码时返回空向量
+     */
+    std::vector<float> getVector(int64_t id) const;
+
+    /**
+     * @brief 批量取回向量
+     * @param ids 待取回的ID
+     * @param vectors 输出 ids.size() x dimension 行主序向量（未取回的行为 0）
+     * @param found 输出每个ID是否取回
+     * @param storedOnly 只取向量存储中的全精度向量，不解码索引
+     * @return 取回的向量数
+     */
+    size_t getVectors(const std::vector<int64_t>& ids, std::vector<float>& vectors,
+                      std::vector<char>& found, bool storedOnly = false) const;
+
+    /**
+     * @brief 随机采样存活向量（用于调优、评估）
+     *
+     * 向量优先取自向量存储，否则由索引解码（Flat 为精确值，量化索引为近似值；
+     * 倒排段按桶内偏移解码，不依赖直接映射）
+     * @param maxCount 最多采样数（0 = 全部）
+     * @param vectors 输出 n x dimension 行主序向量
+     * @param ids 输出向量ID
+     * @return 采样到的向量数 n
+     */
+    size_t sampleVectors(size_t maxCount, std::vector<float>& vectors,
+                         std::vector<int64_t>& ids) const;
+
+    /**
+     * @brief 按批遍历全部存活向量（同一快照），不一次性取出全部向量
+     *
+     * 向量来源与 sampleVectors() 相同；任一行无法读取时报错并返回 false
+     * @param batchRows 每批行数
+     * @param visit 每批回调 (向量, ID, 行数)，返回 false 时停止遍历
+     * @return 读取失败返回 false；遍历完成或被回调停止返回 true
+     */
+    bool scanVectors(size_t batchRows, const VectorBatchCallback& visit) const;
+
+    /**
+     * @brief 估算索引内存占用，用于部署容量规划
+     */
+    MemoryUsage memoryUsage() const;
+
+    /**
+     * @brief 索引数据是否仍映射自文件
+     */
+    bool isMapped() const;
+
+    /**
+     * @brief 封存段数量（不含增量缓冲）
+     */
+    size_t segmentCount() const;
+
 private:
+    /**
+     * @brief 删除位图：按行标记，分块写时复制（删除只复制被修改的块）
+     */
+    struct DeletedRows {
+        std::vector<std::shared_ptr<std::vector<uint64_t>>> blocks;  // 发布后只读
+        size_t count;                                                 // 已删除行数
+
+        DeletedRows() : count(0) {}
+
+        bool test(size_t row) const;
+        bool set(size_t row);
+    };
+
+    /**
+     * @brief 封存段：发布后只读，由合并产生的新段整体替换
+     */
+    struct Segment {
+        uint64_t seq;                               // 段序号（0 保留给增量缓冲）
+        std::unique_ptr<faiss::IndexIDMap> index;   // 拥有内部索引（own_fields）
+        std::string mappedPath;                     // 映射中的索引文件（空表示未映射）
+        mutable std::string checkpointPath;         // 已保存的段文件（仅写线程访问，空表示未保存）
+
+        Segment() : seq(0) {}
+    };
+
+    /**
+     * @brief 快照中的段：共享的段数据 + 本快照的删除位图
+     */
+    struct SegmentView {
+        std::shared_ptr<const Segment> segment;
+        DeletedRows deleted;
+
+        size_t rows() const { return static_cast<size_t>(segment->index->ntotal); }
+        size_t liveRows() const { return rows() - deleted.count; }
+    };
+
+    /**
+     * @brief 增量缓冲块：行只追加一次，发布后不再修改
+     */
+    struct DeltaChunk {
+        std::unique_ptr<float[]> vectors;           // kDeltaChunkRows x dimension
+        std::unique_ptr<int64_t[]> ids;             // kDeltaChunkRows
+
+        explicit DeltaChunk(int dimension);
+    };
+
+    /**
+     * @brief 读视图：封存段 + 增量缓冲前缀 + 删除位图
+     *
+     * 快照发布后不再修改，读线程原子地取得 shared_ptr 后无需加锁
+     */
+    struct Snapshot {
+        std::vector<SegmentView> segments;                         // 封存段（按封存顺序）
+        std::vector<std::shared_ptr<DeltaChunk>> chunks;           // 增量缓冲（未训练时即暂存区）
+        size_t deltaRows;                                          // 本快照可见的缓冲行数
+        DeletedRows deltaDeleted;                                  // 增量缓冲的删除位图
+        std::shared_ptr<const faiss::IndexIDMap> emptyIndex;       // 空索引模板（已训练时可直接封存）
+        std::shared_ptr<VectorStore> store;                        // 全精度向量存储（可选）
+        bool innerProduct;                                         // 是否为内积度量
+        bool trained;                                              // 是否已训练
+        int rerankFactor;                                          // 发布时的 config.rerankFactor
+        float purgeRatio;                                          // 发布时的 config.purgeRatio
+        int nprobe;                                                // 发布时的 config.nprobe
+        int efSearch;                                              // 发布时的 config.efSearch
+
+        Snapshot()
+            : deltaRows(0), innerProduct(true), trained(true), rerankFactor(0), purgeRatio(0.2f)
+            , nprobe(0), efSearch(0) {}
+
+        const float* deltaVector(size_t row, int dimension) const;
+        int64_t deltaId(size_t row) const;
+        size_t size() const;
+        const SegmentView* findSegment(uint64_t seq) const;
+    };
+
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+    /**
+     * @brief 重建期间的一次写入（vectors 为空表示删除）
+     */
+    struct RebuildWrite {
+        std::vector<int64_t> ids;
+        std::vector<float> vectors;
+    };
+
+    /**
+     * @brief 向量位置：段序号 + 行号（段序号 0 表示增量缓冲）
+     */
+    struct Location {
+        uint64_t seq;
+        size_t row;
+    };
+
+    /**
+     * @brief 合并任务：源段（含计划时的删除位图）、旧行号到新行号的映射（-1 表示已删除）、合并结果
+     */
+    struct Compaction {
+        std::shared_ptr<const faiss::IndexIDMap> emptyIndex;
+        std::vector<SegmentView> sources;
+        std::vector<std::vector<int64_t>> rowMaps;
+        std::shared_ptr<Segment> merged;
+    };
+
+    /**
+     * @brief 原子读取当前快照
+     */
+    SnapshotPtr snapshot() const { return std::atomic_load(&snapshot_); }
+
+    /**
+     * @brief 发布新快照（仅写线程，持有 writeMutex_）
+     */
+    void publish(std::shared_ptr<Snapshot> next);
+
     /**
      * @brief 验证向量维度
      */
@@ -159,13 +634,287 @@ private:
      */
     int64_t generateNewId();
 
+    /**
+     * @brief 读取并校验索引文件
+     * @return 失败返回 nullptr
+     */
+    std::unique_ptr<faiss::IndexIDMap> readIndexFile(const std::string& indexPath, int ioFlags) const;
+
+    /**
+     * @brief 按配置创建空索引
+     */
+    std::unique_ptr<faiss::IndexIDMap> createIndex() const;
+
+    /**
+     * @brief 深拷贝索引（映射的倒排表会读入内存）
+     */
+    std::unique_ptr<faiss::IndexIDMap> copyIndex(const faiss::IndexIDMap& index,
+                                                 const std::string& mappedPath = "") const;
+
+    /**
+     * @brief 确保快照带有空索引模板（加载后由第一个段派生）
+     */
+    void ensureEmptyIndex(Snapshot& snap) const;
+
+    /**
+     * @brief 以空索引替换当前快照，清空向量存储与位置表（持有 writeMutex_）
+     */
+    void resetSnapshot();
+
+    /**
+     * @brief 自动训练所需的样本数
+     */
+    size_t requiredTrainSize(const faiss::IndexIDMap* index) const;
+
+    /**
+     * @brief 训练索引（超过 trainSize 时随机采样）
+     */
+    bool trainWith(faiss::IndexIDMap* index, const float* data, size_t n) const;
+
+    /**
+     * @brief 向快照的增量缓冲追加向量（只写入读线程尚不可见的行）
+     */
+    void appendDelta(Snapshot& snap, const float* data, const int64_t* ids, size_t n) const;
+
+    /**
+     * @brief 在快照中标记某位置已删除
+     */
+    static void markDeleted(Snapshot& snap, const Location& location);
+
+    /**
+     * @brief 添加向量：追加到增量缓冲（同ID覆盖旧向量），缓冲达到阈值时封存
+     */
+    void addInternal(size_t n, const float* data, const int64_t* ids);
+
+    /**
+     * @brief 回放增量日志（持有 writeMutex_）
+     *
+     * 只为日志涉及的ID登记位置，不触发全量位置表构建
+     */
+    void replayDeltaLog();
+
+    // ==================== 检查点 ====================
+
+    /**
+     * @brief 段文件路径：<indexPath>.seg<序号>
+     */
+    static std::string segmentFilePath(const std::string& indexPath, uint64_t seq);
+
+    /**
+     * @brief 文件是否为检查点清单（否则为单个 FAISS 索引文件）
+     */
+    static bool isCheckpointManifest(const std::string& indexPath);
+
+    /**
+     * @brief 增量检查点：只写出新段，再原子替换清单（持有 writeMutex_）
+     */
+    bool saveCheckpoint(const std::string& indexPath, const Snapshot& snap);
+
+    /**
+     * @brief 检查点提交后重写增量日志，只保留增量缓冲中的存活行（持有 writeMutex_）
+     */
+    bool checkpointDeltaLog(const Snapshot& snap);
+
+    /**
+     * @brief 按清单加载各段及其删除行
+     * @return 失败返回 nullptr
+     */
+    std::shared_ptr<Snapshot> loadCheckpoint(const std::string& indexPath);
+
+    /**
+     * @brief 删除不再被清单引用的段文件
+     */
+    static void removeStaleSegmentFiles(const std::string& indexPath,
+                                        const std::unordered_set<std::string>& referenced);
+
+    /**
+     * @brief 发布加载结果、重置位置表并回放增量日志
+     */
+    bool finishLoad(std::shared_ptr<Snapshot> next);
+
+    /**
+     * @brief 删除向量：写入删除位图，删除比例超过 purgeRatio 的段交给后台清理
+     * @return 删除的数量
+     */
+    size_t removeInternal(const int64_t* ids, size_t n);
+
+    /**
+     * @brief 把增量缓冲封存为新段并发布（未训练时先训练）
+     * @param samples 显式训练样本（nullptr 表示用缓冲向量自动训练）
+     * @return 是否成功（未训练且样本不足时只压缩缓冲）
+     */
+    bool sealDelta(const float* samples = nullptr, size_t nSamples = 0);
+
+    /**
+     * @brief 准备合并任务：记录源段并取得空索引模板
+     */
+    Compaction planCompaction(const Snapshot& snap, const std::vector<size_t>& picked) const;
+
+    /**
+     * @brief 合并若干段的存活行为一个新段（不持锁，源段只读）
+     */
+    void buildMerged(Compaction& compaction, const Snapshot& snap) const;
+
+    /**
+     * @brief 用合并结果替换源段（持有 writeMutex_），补上合并期间新增的删除
+     * @return 源段已被替换（如 clear/load）时返回 false
+     */
+    bool installMerged(Compaction& compaction);
+
+    /**
+     * @brief 段内删除比例是否达到 purgeRatio，需要物理清除
+     */
+    static bool needsPurge(const Snapshot& snap, const SegmentView& view);
+
+    /**
+     * @brief 选择需要合并的段：删除比例超过阈值的段，或同一层积累了足够多的段
+     *
+     * 跳过合并失败过的段；需要重建的类型（HNSW 等）不再合并超过上限的大段
+     */
+    std::vector<size_t> pickCompaction(const Snapshot& snap) const;
+
+    /**
+     * @brief 唤醒后台合并线程（首次调用时启动）
+     */
+    void notifyCompactor();
+
+    /**
+     * @brief 后台合并线程主循环
+     */
+    void compactionLoop();
+
+    /**
+     * @brief 确保位置表已构建（加载后延迟构建）
+     */
+    void ensureLocations() const;
+
+    /**
+     * @brief 搜索入口：Top-K 搜索，阈值只用于截断结果（不走范围搜索）
+     */
+    std::vector<std::vector<SearchResult>> searchFlat(const Snapshot& snap,
+                                                      const float* queries,
+                                                      size_t nQueries,
+                                                      int topK,
+                                                      float threshold,
+                                                      const SearchParams& params) const;
+
+    /**
+     * @brief 用向量存储中的原始向量重新打分，保留前 topK 个并应用阈值
+     */
+    void rerankWithStore(const Snapshot& snap, const float* query,
+                         std::vector<SearchResult>& results,
+                         int topK, float threshold) const;
+
+    /**
+     * @brief 在共享的固定大小线程池上对每个封存段执行 search，结果追加到 allResults
+     */
+    void searchSegments(const Snapshot& snap,
+                        const std::function<void(const SegmentView&,
+                                                 std::vector<std::vector<SearchResult>>&)>& searchOne,
+                        std::vector<std::vector<SearchResult>>& allResults) const;
+
+    /**
+     * @brief 对段内属于过滤集合的行逐个计算距离（小集合时代替近似搜索）
+     * @return 该段无法取回向量（IVF 且未挂载向量存储）时返回 false
+     */
+    bool searchSubset(const Snapshot& snap, const SegmentView& view, const IdFilter& filter,
+                      const float* queries, size_t nQueries,
+                      std::vector<std::vector<SearchResult>>& out) const;
+
+    /**
+     * @brief Top-K 搜索核心实现（合并各段与增量缓冲，过滤删除行）
+     */
+    std::vector<std::vector<SearchResult>> knnSearchInternal(const Snapshot& snap,
+                                                             const float* queries,
+                                                             size_t nQueries,
+                                                             int topK,
+                                                             const SearchParams& params) const;
+
+    /**
+     * @brief 取回向量：优先向量存储，否则按位置表由段解码或从增量缓冲拷贝
+     * @param storedOnly 只查向量存储
+     * @return 找到并解码成功时返回 true
+     */
+    bool lookupVector(const Snapshot& snap, int64_t id, float* out,
+                      bool storedOnly = false) const;
+
+    /**
+     * @brief MMR 重排：取回候选向量后调用 selectDiverse()
+     */
+    void diversifyResults(const Snapshot& snap, std::vector<SearchResult>& results,
+                          int topK, float lambda) const;
+
+    /**
+     * @brief 补全未指定的搜索参数（取快照中的配置默认值）
+     */
+    static SearchParams resolveParams(const Snapshot& snap, const SearchParams& params);
+
+    /**
+     * @brief 范围搜索入口：选择 FAISS 范围搜索或倍增 K 的近邻搜索，并用向量存储精排
+     */
+    std::vector<std::vector<SearchResult>> rangeSearchFlat(const Snapshot& snap,
+                                                           const float* queries,
+                                                           size_t nQueries,
+                                                           float minScore,
+                                                           int maxResults,
+                                                           const SearchParams& params) const;
+
+    /**
+     * @brief 范围搜索核心实现：返回分数不低于 minScore 的结果（最多 maxResults 个）
+     */
+    std::vector<std::vector<SearchResult>> rangeSearchInternal(const Snapshot& snap,
+                                                               const float* queries,
+                                                               size_t nQueries,
+                                                               float minScore,
+                                                               int maxResults,
+                                                               const SearchParams& params) const;
+
+    /**
+     * @brief 计算查询与增量缓冲中所有向量的距离
+     */
+    void computeDeltaDistances(const Snapshot& snap, const float* query, float* out) const;
+
+    /**
+     * @brief 索引类型是否支持范围搜索
+     */
+    static bool supportsRangeSearch(const Snapshot& snap);
+
+    /**
+     * @brief 原始距离转换为余弦相似度（内积直接返回）
+     */
+    static float toScore(bool innerProduct, float distance) {
+        return innerProduct ? distance : 1.0f - 0.5f * distance;
+    }
+
 private:
     int dimension_;                                // 向量维度
-    std::unique_ptr<faiss::IndexFlatL2> baseIndex_;  // 基础L2索引
-    std::unique_ptr<faiss::IndexIDMap> index_;     // 支持自定义ID的索引
-    int64_t nextId_;                               // 下一个自动分配的ID
+    IndexConfig config_;                           // 索引配置
     bool useGPU_;                                  // 是否使用GPU
-    std::unordered_set<int64_t> idSet_;            // 已存在ID集合，O(1) contains
+
+    // 读路径：只通过 snapshot() 访问
+    std::shared_ptr<const Snapshot> snapshot_;     // 当前快照（atomic_load / atomic_store）
+
+    // 写路径：单写者，由 writeMutex_ 串行化
+    std::mutex writeMutex_;                        // 串行化 add/remove/load/save/clear 与合并结果替换
+    mutable std::mutex configMutex_;               // 保护 config_ 的修改与 config() 读取（内部读取持有 writeMutex_ 即可）
+    int64_t nextId_;                               // 下一个自动分配的ID
+    std::unique_ptr<DeltaLog> deltaLog_;           // 增量日志（可选）
+    bool recordingRebuild_;                        // beginRebuild() 之后记录写入
+    std::vector<RebuildWrite> rebuildWrites_;      // 重建期间的增删（adopt 时重放）
+
+    // 位置表：写者只在插入/删除/搬迁时短暂独占
+    mutable std::shared_mutex idMutex_;            // 保护 locations_ / locationsReady_
+    mutable std::unordered_map<int64_t, Location> locations_;  // ID -> 所在段与行号
+    mutable bool locationsReady_;                  // 加载后位置表延迟构建
+    bool replaying_;                               // 回放增量日志中（位置表只含日志涉及的ID，持有 writeMutex_）
+
+    // 后台合并
+    std::thread compactor_;                        // 合并线程（首次封存时启动）
+    std::mutex compactMutex_;                      // 保护 compactPending_
+    std::condition_variable compactCv_;            // 唤醒合并线程
+    bool compactPending_;                          // 有待检查的合并
+    std::unordered_set<uint64_t> unmergeable_;     // 合并失败的段序号（仅合并线程访问），不再选取
+    std::atomic<bool> stopping_;                   // 析构时通知合并线程退出
 };
 
 } // namespace index
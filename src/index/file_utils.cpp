@@ -0,0 +1,112 @@
+#include "file_utils.h"
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+/**
+ * @brief 同步目录项（改名后需同步目录，新文件名才能在掉电后保留）
+ */
+bool syncDirectory(const fs::path& dir) {
+#ifdef _WIN32
+    // NTFS 的改名由元数据日志保证，无需单独同步目录
+    (void)dir;
+    return true;
+#else
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+} // namespace
+
+std::FILE* openFile(const std::string& path, const char* mode) {
+#ifdef _WIN32
+    const std::wstring wideMode(mode, mode + std::char_traits<char>::length(mode));
+    return _wfopen(fs::u8path(path).c_str(), wideMode.c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+bool seekFile(std::FILE* file, size_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return ::fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool syncFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(fs::u8path(path).c_str(), GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    const bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool syncFile(std::FILE* file) {
+    if (!file || std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return ::fsync(::fileno(file)) == 0;
+#endif
+}
+
+bool replaceFile(const std::string& tmpPath, const std::string& targetPath) {
+    if (!syncFile(tmpPath)) {
+        std::cerr << "Failed to sync " << tmpPath << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    const fs::path target = fs::u8path(targetPath);
+    fs::rename(fs::u8path(tmpPath), target, ec);
+    if (ec) {
+        std::cerr << "Failed to replace " << targetPath << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    if (!syncDirectory(target.parent_path())) {
+        std::cerr << "Failed to sync directory of " << targetPath << std::endl;
+    }
+    return true;
+}
+
+} // namespace index
+} // namespace vindex
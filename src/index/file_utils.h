@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 打开文件（路径为 UTF-8，Windows 下经宽字符接口打开，支持非 ASCII 路径）
+ * @param path 文件路径
+ * @param mode fopen 模式串
+ * @return 失败返回 nullptr
+ */
+std::FILE* openFile(const std::string& path, const char* mode);
+
+/**
+ * @brief 定位到文件的绝对偏移（支持超过 2GB 的文件）
+ * @return 是否成功
+ */
+bool seekFile(std::FILE* file, size_t offset);
+
+/**
+ * @brief 将文件内容刷到磁盘（fsync）
+ * @param path 文件路径
+ * @return 是否成功
+ */
+bool syncFile(const std::string& path);
+
+/**
+ * @brief 将已打开文件的缓冲与内容刷到磁盘
+ */
+bool syncFile(std::FILE* file);
+
+/**
+ * @brief 原子替换文件：临时文件落盘后改名覆盖目标，再同步所在目录
+ *
+ * 崩溃时目标路径上要么是旧文件，要么是完整的新文件
+ * @param tmpPath 已写完的临时文件
+ * @param targetPath 目标路径
+ * @return 是否成功
+ */
+bool replaceFile(const std::string& tmpPath, const std::string& targetPath);
+
+} // namespace index
+} // namespace vindex
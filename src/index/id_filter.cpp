@@ -0,0 +1,49 @@
+#include "id_filter.h"
+#include <algorithm>
+#include <iterator>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+// 位图跨度不超过 ID 数量的该倍数时才建位图（每个ID最多占 64 字节）
+constexpr uint64_t kMaxBitmapSpanFactor = 512;
+
+} // namespace
+
+IdFilter::IdFilter(std::vector<int64_t> ids)
+    : ids_(std::move(ids))
+{
+    std::sort(ids_.begin(), ids_.end());
+    ids_.erase(std::unique(ids_.begin(), ids_.end()), ids_.end());
+
+    if (ids_.empty() || ids_.front() < 0) {
+        return;
+    }
+
+    const uint64_t span = static_cast<uint64_t>(ids_.back()) + 1;
+    if (span > kMaxBitmapSpanFactor * ids_.size()) {
+        return;
+    }
+
+    bits_.assign((span + 63) / 64, 0);
+    for (int64_t id : ids_) {
+        bits_[static_cast<uint64_t>(id) >> 6] |= uint64_t(1) << (id & 63);
+    }
+}
+
+IdFilter IdFilter::intersect(const IdFilter& other) const {
+    std::vector<int64_t> common;
+    common.reserve(std::min(ids_.size(), other.ids_.size()));
+    std::set_intersection(ids_.begin(), ids_.end(), other.ids_.begin(), other.ids_.end(),
+                          std::back_inserter(common));
+    return IdFilter(std::move(common));
+}
+
+bool IdFilter::containsSorted(int64_t id) const {
+    return std::binary_search(ids_.begin(), ids_.end(), id);
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief ID 过滤集合（元数据过滤编译结果）
+ *
+ * 保存有序去重的ID列表；ID 分布足够稠密时（SQLite 自增主键）
+ * 额外建立位图，搜索内核中每个候选的成员判断为 O(1)。
+ * 构造后不再修改，可在多个搜索间共享。
+ */
+class IdFilter {
+public:
+    IdFilter() = default;
+
+    /**
+     * @brief 由ID列表构造（顺序任意，可含重复）
+     */
+    explicit IdFilter(std::vector<int64_t> ids);
+
+    /**
+     * @brief 检查ID是否在集合中
+     */
+    bool contains(int64_t id) const {
+        if (!bits_.empty()) {
+            const uint64_t bit = static_cast<uint64_t>(id);
+            return bit < bits_.size() * 64 && (bits_[bit >> 6] >> (bit & 63)) & 1;
+        }
+        return containsSorted(id);
+    }
+
+    /**
+     * @brief 集合大小
+     */
+    size_t size() const { return ids_.size(); }
+
+    bool empty() const { return ids_.empty(); }
+
+    /**
+     * @brief 有序ID列表
+     */
+    const std::vector<int64_t>& ids() const { return ids_; }
+
+    /**
+     * @brief 与另一集合求交
+     */
+    IdFilter intersect(const IdFilter& other) const;
+
+private:
+    bool containsSorted(int64_t id) const;
+
+private:
+    std::vector<int64_t> ids_;     // 有序去重的ID
+    std::vector<uint64_t> bits_;   // ID位图（ID 过于稀疏或含负数时为空）
+};
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,278 @@
+#include "image_header.h"
+#include "file_utils.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+// 各格式识别尺寸所需的文件头长度上限
+constexpr size_t kHeaderBytes = 32;
+
+// TIFF / EXIF 标签
+constexpr uint16_t kTagImageWidth = 256;
+constexpr uint16_t kTagImageLength = 257;
+constexpr uint16_t kTagOrientation = 274;
+
+uint16_t readU16(const unsigned char* p, bool littleEndian) {
+    return littleEndian ? static_cast<uint16_t>(p[0] | (p[1] << 8))
+                        : static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t readU32(const unsigned char* p, bool littleEndian) {
+    return littleEndian
+        ? static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+          (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24)
+        : (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+          (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+/**
+ * @brief IFD 中的尺寸与方向字段（TIFF 文件与 JPEG 的 EXIF 段共用该结构）
+ */
+struct IfdFields {
+    int width;
+    int height;
+    int orientation;
+
+    IfdFields() : width(0), height(0), orientation(1) {}
+};
+
+/**
+ * @brief 解析一个 IFD（2 字节条目数 + 12 字节条目），data 指向条目数
+ */
+void parseIfd(const unsigned char* data, size_t size, bool littleEndian, IfdFields& fields) {
+    if (size < 2) {
+        return;
+    }
+    const size_t count = readU16(data, littleEndian);
+    for (size_t i = 0; i < count && 2 + (i + 1) * 12 <= size; ++i) {
+        const unsigned char* entry = data + 2 + i * 12;
+        const uint16_t tag = readU16(entry, littleEndian);
+        const uint16_t type = readU16(entry + 2, littleEndian);
+        // 只取 SHORT(3) / LONG(4) 类型，值左对齐存放在条目末 4 字节
+        uint32_t value = 0;
+        if (type == 3) {
+            value = readU16(entry + 8, littleEndian);
+        } else if (type == 4) {
+            value = readU32(entry + 8, littleEndian);
+        } else {
+            continue;
+        }
+
+        if (tag == kTagImageWidth) {
+            fields.width = static_cast<int>(value);
+        } else if (tag == kTagImageLength) {
+            fields.height = static_cast<int>(value);
+        } else if (tag == kTagOrientation) {
+            fields.orientation = static_cast<int>(value);
+        }
+    }
+}
+
+/**
+ * @brief 解析内存中的 TIFF 结构（JPEG APP1 段中的 EXIF 数据）
+ */
+void parseTiff(const unsigned char* data, size_t size, IfdFields& fields) {
+    if (size < 8) {
+        return;
+    }
+    bool littleEndian;
+    if (data[0] == 'I' && data[1] == 'I') {
+        littleEndian = true;
+    } else if (data[0] == 'M' && data[1] == 'M') {
+        littleEndian = false;
+    } else {
+        return;
+    }
+    const uint32_t offset = readU32(data + 4, littleEndian);
+    if (offset < size) {
+        parseIfd(data + offset, size - offset, littleEndian, fields);
+    }
+}
+
+bool readJpegSize(std::FILE* file, int& width, int& height) {
+    if (std::fseek(file, 2, SEEK_SET) != 0) {
+        return false;
+    }
+
+    int orientation = 1;
+    unsigned char buffer[5];
+    while (true) {
+        // 段标记：0xFF 之后可能有填充字节
+        int c = std::fgetc(file);
+        if (c != 0xFF) {
+            return false;
+        }
+        int marker;
+        do {
+            marker = std::fgetc(file);
+        } while (marker == 0xFF);
+        if (marker == EOF || marker == 0xD9 || marker == 0xDA) {
+            return false;
+        }
+        // 无长度的独立标记
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue;
+        }
+
+        if (std::fread(buffer, 1, 2, file) != 2) {
+            return false;
+        }
+        const size_t length = readU16(buffer, false);
+        if (length < 2) {
+            return false;
+        }
+
+        const bool isFrame = marker >= 0xC0 && marker <= 0xCF &&
+                             marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isFrame) {
+            // SOF：精度(1) 高(2) 宽(2)
+            if (std::fread(buffer, 1, 5, file) != 5) {
+                return false;
+            }
+            height = readU16(buffer + 1, false);
+            width = readU16(buffer + 3, false);
+            // 方向 5~8 需旋转 90 度
+            if (orientation >= 5 && orientation <= 8) {
+                std::swap(width, height);
+            }
+            return width > 0 && height > 0;
+        }
+
+        if (marker == 0xE1 && length > 8) {
+            std::vector<unsigned char> segment(length - 2);
+            if (std::fread(segment.data(), 1, segment.size(), file) != segment.size()) {
+                return false;
+            }
+            if (std::memcmp(segment.data(), "Exif\0\0", 6) == 0) {
+                IfdFields fields;
+                parseTiff(segment.data() + 6, segment.size() - 6, fields);
+                orientation = fields.orientation;
+            }
+            continue;
+        }
+
+        if (std::fseek(file, static_cast<long>(length - 2), SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+}
+
+bool readTiffSize(std::FILE* file, const unsigned char* header, int& width, int& height) {
+    const bool littleEndian = header[0] == 'I';
+    const uint32_t offset = readU32(header + 4, littleEndian);
+    unsigned char countBytes[2];
+    if (std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0 ||
+        std::fread(countBytes, 1, 2, file) != 2) {
+        return false;
+    }
+
+    // 条目数与条目一起交给 parseIfd
+    const size_t count = readU16(countBytes, littleEndian);
+    std::vector<unsigned char> ifd(2 + count * 12);
+    std::memcpy(ifd.data(), countBytes, 2);
+    if (std::fread(ifd.data() + 2, 1, count * 12, file) != count * 12) {
+        return false;
+    }
+
+    IfdFields fields;
+    parseIfd(ifd.data(), ifd.size(), littleEndian, fields);
+    width = fields.width;
+    height = fields.height;
+    return width > 0 && height > 0;
+}
+
+bool readWebpSize(const unsigned char* header, size_t size, int& width, int& height) {
+    if (size < 30) {
+        return false;
+    }
+    const unsigned char* chunk = header + 12;
+    if (std::memcmp(chunk, "VP8X", 4) == 0) {
+        // 扩展格式：画布宽高各 24 位（存储值为尺寸减一）
+        width = 1 + static_cast<int>(header[24] | (header[25] << 8) | (header[26] << 16));
+        height = 1 + static_cast<int>(header[27] | (header[28] << 8) | (header[29] << 16));
+        return true;
+    }
+    if (std::memcmp(chunk, "VP8 ", 4) == 0) {
+        // 有损格式：帧标记(3) + 起始码 9d 01 2a + 宽高各 14 位
+        if (header[23] != 0x9D || header[24] != 0x01 || header[25] != 0x2A) {
+            return false;
+        }
+        width = readU16(header + 26, true) & 0x3FFF;
+        height = readU16(header + 28, true) & 0x3FFF;
+        return width > 0 && height > 0;
+    }
+    if (std::memcmp(chunk, "VP8L", 4) == 0) {
+        // 无损格式：签名 0x2f + 宽高各 14 位（存储值为尺寸减一）
+        if (header[20] != 0x2F) {
+            return false;
+        }
+        const uint32_t bits = readU32(header + 21, true);
+        width = 1 + static_cast<int>(bits & 0x3FFF);
+        height = 1 + static_cast<int>((bits >> 14) & 0x3FFF);
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool readImageSize(const std::string& path, int& width, int& height) {
+    std::FILE* file = openFile(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    unsigned char header[kHeaderBytes] = {};
+    const size_t size = std::fread(header, 1, sizeof(header), file);
+    int w = 0;
+    int h = 0;
+    bool ok = false;
+
+    if (size >= 4 && header[0] == 0xFF && header[1] == 0xD8) {
+        ok = readJpegSize(file, w, h);
+    } else if (size >= 24 && std::memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0 &&
+               std::memcmp(header + 12, "IHDR", 4) == 0) {
+        w = static_cast<int>(readU32(header + 16, false));
+        h = static_cast<int>(readU32(header + 20, false));
+        ok = w > 0 && h > 0;
+    } else if (size >= 10 && (std::memcmp(header, "GIF87a", 6) == 0 ||
+                              std::memcmp(header, "GIF89a", 6) == 0)) {
+        w = readU16(header + 6, true);
+        h = readU16(header + 8, true);
+        ok = w > 0 && h > 0;
+    } else if (size >= 26 && header[0] == 'B' && header[1] == 'M') {
+        // OS/2 位图头为 16 位尺寸，其余为 32 位（高度为负表示自上而下存储）
+        if (readU32(header + 14, true) == 12) {
+            w = readU16(header + 18, true);
+            h = readU16(header + 20, true);
+        } else {
+            w = static_cast<int32_t>(readU32(header + 18, true));
+            h = std::abs(static_cast<int32_t>(readU32(header + 22, true)));
+        }
+        ok = w > 0 && h > 0;
+    } else if (size >= 16 && std::memcmp(header, "RIFF", 4) == 0 &&
+               std::memcmp(header + 8, "WEBP", 4) == 0) {
+        ok = readWebpSize(header, size, w, h);
+    } else if (size >= 8 && (std::memcmp(header, "II*\0", 4) == 0 ||
+                             std::memcmp(header, "MM\0*", 4) == 0)) {
+        ok = readTiffSize(file, header, w, h);
+    }
+
+    std::fclose(file);
+    if (ok) {
+        width = w;
+        height = h;
+    }
+    return ok;
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 只读文件头获取图像尺寸（不解码像素）
+ *
+ * 支持 JPEG（SOF 段）、PNG（IHDR）、BMP、GIF、WebP（VP8 / VP8L / VP8X）、TIFF（IFD0）；
+ * JPEG 会读取 EXIF 方向标记，需旋转 90 度的图像交换宽高，与 cv::imread 解码结果一致。
+ * @param path 图像路径（UTF-8）
+ * @param width 输出宽度
+ * @param height 输出高度
+ * @return 识别出格式并读到尺寸时返回 true（否则需解码获取）
+ */
+bool readImageSize(const std::string& path, int& width, int& height);
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,92 @@
+#include "index_builder.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+// 每次添加的行数（块之间汇报进度并检查取消，全部块写入同一个段）
+constexpr size_t kBuildChunkRows = 8192;
+
+#ifdef _OPENMP
+/**
+ * @brief 构建期间设置 OpenMP 线程数，结束时恢复原值（不影响进程内其他搜索与构建）
+ */
+class ScopedOmpThreads {
+public:
+    explicit ScopedOmpThreads(int numThreads) : previous_(omp_get_max_threads()) {
+        omp_set_num_threads(numThreads);
+    }
+    ~ScopedOmpThreads() { omp_set_num_threads(previous_); }
+
+    ScopedOmpThreads(const ScopedOmpThreads&) = delete;
+    ScopedOmpThreads& operator=(const ScopedOmpThreads&) = delete;
+
+private:
+    int previous_;
+};
+#endif
+
+} // namespace
+
+IndexBuilder::IndexBuilder(int dimension, const FaissIndex::IndexConfig& config)
+    : dimension_(dimension)
+    , config_(config)
+    , numThreads_(0)
+    , cancelled_(false)
+    , done_(0)
+    , total_(0)
+{
+}
+
+std::unique_ptr<FaissIndex> IndexBuilder::build(const float* vectors, const int64_t* ids, size_t n,
+                                                const ProgressCallback& progress) {
+    done_ = 0;
+    total_ = n;
+    if (cancelled_) {
+        return nullptr;
+    }
+
+#ifdef _OPENMP
+    // FAISS 的训练与添加内核按 OpenMP 线程数并行
+    ScopedOmpThreads threads(numThreads_ > 0 ? numThreads_ : omp_get_num_procs());
+#endif
+
+    const auto start = std::chrono::steady_clock::now();
+    auto index = std::make_unique<FaissIndex>(dimension_, config_);
+
+    // 训练后全部向量写入同一个段（训练由 FaissIndex 按 trainSize 采样；样本不足时保持未训练，暴力检索）
+    const bool loaded = index->bulkLoad(vectors, ids, n, kBuildChunkRows,
+        [this, n, &progress](size_t added) {
+            done_ = added;
+            if (progress) {
+                progress(added, n);
+            }
+            return !cancelled_;
+        });
+    if (cancelled_) {
+        std::cout << "Index build cancelled after " << done_ << " of " << n
+                  << " vectors" << std::endl;
+        return nullptr;
+    }
+    if (!loaded) {
+        return nullptr;
+    }
+
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "Built index (" << config_.type << ") with " << n << " vectors in "
+              << seconds << "s, " << index->segmentCount() << " segment(s)" << std::endl;
+    return index;
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "faiss_index.h"
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 离线索引构建器（纯 CPU，多线程）
+ *
+ * 在独立的 FaissIndex 上完成训练与添加，不影响正在服务的索引：
+ * - 训练：超过 trainSize 时随机采样，k-means / 码本训练由 FAISS 的 OpenMP 并行使用全部核心
+ * - 添加：全部向量写入同一个段，分块添加，每块的量化分配同样由 OpenMP 并行，块之间汇报进度并检查取消
+ * - OpenMP 线程数只在构建期间生效，结束后恢复
+ * 构建完成后由 FaissIndex::adopt() 原子换入。
+ *
+ * build() 可在后台线程调用；cancel() / done() / total() 可从任意线程调用。
+ */
+class IndexBuilder {
+public:
+    using ProgressCallback = std::function<void(size_t done, size_t total)>;
+
+    /**
+     * @brief 构造函数
+     * @param dimension 向量维度
+     * @param config 新索引的配置
+     */
+    IndexBuilder(int dimension, const FaissIndex::IndexConfig& config);
+
+    /**
+     * @brief 构建索引
+     * @param vectors n x dimension 行主序向量
+     * @param ids n 个向量ID
+     * @param n 向量数量
+     * @param progress 进度回调（每块添加完成后在构建线程上调用，可选）
+     * @return 构建好的索引（单个段），被取消或失败时返回 nullptr
+     */
+    std::unique_ptr<FaissIndex> build(const float* vectors, const int64_t* ids, size_t n,
+                                      const ProgressCallback& progress = nullptr);
+
+    /**
+     * @brief 请求取消（在下一个分块边界生效，训练中的调用在训练结束后生效）
+     */
+    void cancel() { cancelled_ = true; }
+
+    bool isCancelled() const { return cancelled_; }
+
+    /**
+     * @brief 已添加的向量数
+     */
+    size_t done() const { return done_; }
+
+    /**
+     * @brief 本次构建的向量总数
+     */
+    size_t total() const { return total_; }
+
+    /**
+     * @brief 设置训练与添加使用的线程数（0 = 全部核心，仅在 build() 期间生效）
+     */
+    void setNumThreads(int numThreads) { numThreads_ = numThreads; }
+
+private:
+    int dimension_;                      // 向量维度
+    FaissIndex::IndexConfig config_;     // 新索引的配置
+    int numThreads_;                     // OpenMP 线程数（0 = 全部核心）
+    std::atomic<bool> cancelled_;        // 取消请求
+    std::atomic<size_t> done_;           // 已添加的向量数
+    std::atomic<size_t> total_;          // 向量总数
+};
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,297 @@
+#include "index_tuner.h"
+#include "file_utils.h"
+#include "index_builder.h"
+#include <faiss/IndexFlat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <unordered_set>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+// 向量数达到该值时加入 HNSW 候选
+constexpr size_t kMinHnswVectors = 10000;
+// 向量数达到该值时加入 IVF 候选
+constexpr size_t kMinIvfVectors = 20000;
+// FAISS 建议每个聚类中心至少 39 个训练样本
+constexpr size_t kMinPointsPerCentroid = 39;
+// HNSW 搜索队列长度的扫描上限
+constexpr int kMaxEfSearch = 1024;
+
+/**
+ * @brief 解析 "IVF<nlist>,..." 中的聚类数，解析失败返回 0
+ */
+int parseNlist(const std::string& type) {
+    const size_t pos = type.find("IVF");
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    return std::atoi(type.c_str() + pos + 3);
+}
+
+} // namespace
+
+IndexTuner::IndexTuner(int dimension, const FaissIndex::IndexConfig& baseConfig,
+                       const Options& options)
+    : dimension_(dimension)
+    , baseConfig_(baseConfig)
+    , options_(options)
+    , cancelled_(false)
+{
+}
+
+IndexTuner::Result IndexTuner::tune(const float* vectors, size_t n, size_t librarySize,
+                                    const ProgressCallback& progress) {
+    Result result;
+    const int k = options_.k;
+
+    // 留出查询：样本已随机采样，取前 nQueries 行作为查询，其余作为库
+    const size_t nQueries = std::min(options_.numQueries, n / 10);
+    if (nQueries == 0 || k <= 0 || n - nQueries < static_cast<size_t>(k)) {
+        std::cerr << "Not enough vectors to tune index: " << n << std::endl;
+        return result;
+    }
+    const float* queries = vectors;
+    const float* base = vectors + nQueries * dimension_;
+    const size_t nBase = n - nQueries;
+    std::vector<int64_t> baseIds(nBase);
+    std::iota(baseIds.begin(), baseIds.end(), 0);
+
+    // 真值：暴力检索
+    const faiss::MetricType metric = baseConfig_.metric == FaissIndex::Metric::InnerProduct
+        ? faiss::METRIC_INNER_PRODUCT : faiss::METRIC_L2;
+    std::vector<int64_t> truth(nQueries * k);
+    {
+        faiss::IndexFlat exact(dimension_, metric);
+        exact.add(static_cast<faiss::idx_t>(nBase), base);
+        std::vector<float> distances(nQueries * k);
+        std::vector<faiss::idx_t> labels(nQueries * k);
+        exact.search(static_cast<faiss::idx_t>(nQueries), queries, k,
+                     distances.data(), labels.data());
+        std::copy(labels.begin(), labels.end(), truth.begin());
+    }
+
+    const std::vector<std::string> candidates = options_.candidates.empty()
+        ? defaultCandidates(librarySize > 0 ? librarySize : n, nBase)
+        : options_.candidates;
+
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (cancelled_) {
+            std::cout << "Index tuning cancelled" << std::endl;
+            return Result();
+        }
+
+        const std::string& type = candidates[c];
+        FaissIndex::IndexConfig config = baseConfig_;
+        config.type = type;
+        config.nprobe = 0;
+        config.efSearch = 0;
+
+        std::unique_ptr<FaissIndex> built;
+        try {
+            IndexBuilder builder(dimension_, config);
+            built = builder.build(base, baseIds.data(), nBase);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to build candidate " << type << ": " << e.what() << std::endl;
+        }
+        if (!built || !built->isTrained() || built->segmentCount() != 1) {
+            // 未训练的索引退化为暴力检索，多段索引逐段检索再合并，测得的数据都没有代表性。
+            // bulkLoad 只写一个段且不唤醒后台合并，计时期间也不会有合并线程争抢 CPU
+            std::cerr << "Skipping candidate " << type
+                      << " (not a single trained segment)" << std::endl;
+            if (progress) {
+                progress(c + 1, candidates.size());
+            }
+            continue;
+        }
+
+        // 由小到大扫描搜索参数，召回率达标即停止（参数越大越慢）
+        const int nlist = parseNlist(type);
+        if (nlist > 0) {
+            for (int nprobe = 1; ; nprobe = std::min(nprobe * 2, nlist)) {
+                Trial trial = measure(*built, type, queries, nQueries, truth,
+                                      FaissIndex::SearchParams(nprobe));
+                result.trials.push_back(trial);
+                if (trial.recall >= options_.recallTarget || nprobe >= nlist || cancelled_) {
+                    break;
+                }
+            }
+        } else if (type.compare(0, 4, "HNSW") == 0) {
+            for (int efSearch = std::max(16, k); efSearch <= kMaxEfSearch; efSearch *= 2) {
+                Trial trial = measure(*built, type, queries, nQueries, truth,
+                                      FaissIndex::SearchParams(0, efSearch));
+                result.trials.push_back(trial);
+                if (trial.recall >= options_.recallTarget || cancelled_) {
+                    break;
+                }
+            }
+        } else {
+            result.trials.push_back(measure(*built, type, queries, nQueries, truth,
+                                            FaissIndex::SearchParams()));
+        }
+
+        if (progress) {
+            progress(c + 1, candidates.size());
+        }
+    }
+
+    // 达标的配置中取最快的；都不达标时取召回率最高的
+    const Trial* best = nullptr;
+    for (const auto& trial : result.trials) {
+        const bool meets = trial.recall >= options_.recallTarget;
+        if (!best) {
+            best = &trial;
+            result.meetsTarget = meets;
+        } else if (meets && (!result.meetsTarget || trial.queryMicros < best->queryMicros)) {
+            best = &trial;
+            result.meetsTarget = true;
+        } else if (!meets && !result.meetsTarget && trial.recall > best->recall) {
+            best = &trial;
+        }
+    }
+    if (!best) {
+        return result;
+    }
+
+    result.config = baseConfig_;
+    result.config.type = best->type;
+    result.config.nprobe = best->nprobe;
+    result.config.efSearch = best->efSearch;
+    result.recall = best->recall;
+    result.queryMicros = best->queryMicros;
+    result.sampleSize = nBase;
+
+    std::cout << "Tuned index: " << best->type << " (nprobe=" << best->nprobe
+              << ", efSearch=" << best->efSearch << "), recall@" << k << "="
+              << best->recall << ", " << best->queryMicros << " us/query on "
+              << nBase << " sampled vectors"
+              << (result.meetsTarget ? "" : " [target not met]") << std::endl;
+    return result;
+}
+
+std::vector<std::string> IndexTuner::defaultCandidates(size_t librarySize, size_t trainable) {
+    std::vector<std::string> candidates = {"Flat"};
+    if (librarySize >= kMinHnswVectors) {
+        candidates.push_back("HNSW32");
+    }
+    if (librarySize >= kMinIvfVectors) {
+        // 聚类数约为 4·sqrt(N)，取 2 的幂，且每个聚类中心至少有 39 个训练样本
+        const size_t samples = trainable > 0 ? trainable : librarySize;
+        const double target = 4.0 * std::sqrt(static_cast<double>(librarySize));
+        size_t nlist = 64;
+        while (nlist * 2 <= target && nlist * 2 * kMinPointsPerCentroid <= samples) {
+            nlist *= 2;
+        }
+        candidates.push_back("IVF" + std::to_string(nlist) + ",Flat");
+        candidates.push_back("IVF" + std::to_string(nlist) + ",SQ8");
+    }
+    return candidates;
+}
+
+bool IndexTuner::saveResult(const std::string& path, const Result& result) {
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to write tuning result: " << tmpPath << std::endl;
+            return false;
+        }
+        out << "# vindex index tuning result\n"
+            << "type=" << result.config.type << "\n"
+            << "nprobe=" << result.config.nprobe << "\n"
+            << "efSearch=" << result.config.efSearch << "\n"
+            << "recall=" << result.recall << "\n"
+            << "queryMicros=" << result.queryMicros << "\n"
+            << "sampleSize=" << result.sampleSize << "\n"
+            << "meetsTarget=" << (result.meetsTarget ? 1 : 0) << "\n";
+        if (!out.flush()) {
+            std::cerr << "Failed to write tuning result: " << tmpPath << std::endl;
+            return false;
+        }
+    }
+    return replaceFile(tmpPath, path);
+}
+
+bool IndexTuner::loadConfig(const std::string& path, FaissIndex::IndexConfig& config) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    FaissIndex::IndexConfig loaded = config;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        const size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        const std::string key = line.substr(0, eq);
+        const std::string value = line.substr(eq + 1);
+        if (key == "type" && !value.empty()) {
+            loaded.type = value;
+        } else if (key == "nprobe") {
+            loaded.nprobe = std::atoi(value.c_str());
+        } else if (key == "efSearch") {
+            loaded.efSearch = std::atoi(value.c_str());
+        }
+    }
+
+    config = loaded;
+    return true;
+}
+
+// ==================== 私有方法 ====================
+
+float IndexTuner::recallAt(const std::vector<std::vector<FaissIndex::SearchResult>>& results,
+                           const std::vector<int64_t>& truth) const {
+    const size_t k = static_cast<size_t>(options_.k);
+    size_t hits = 0;
+    for (size_t q = 0; q < results.size(); ++q) {
+        std::unordered_set<int64_t> expected(truth.begin() + q * k, truth.begin() + (q + 1) * k);
+        for (const auto& r : results[q]) {
+            hits += expected.count(r.id);
+        }
+    }
+    return results.empty() ? 0.0f
+                           : static_cast<float>(hits) / static_cast<float>(results.size() * k);
+}
+
+IndexTuner::Trial IndexTuner::measure(const FaissIndex& index, const std::string& type,
+                                      const float* queries, size_t nQueries,
+                                      const std::vector<int64_t>& truth,
+                                      const FaissIndex::SearchParams& params) const {
+    // 逐条查询计时，与交互式搜索的调用方式一致
+    std::vector<std::vector<FaissIndex::SearchResult>> results(nQueries);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < nQueries; ++q) {
+        auto batch = index.searchBatch(queries + q * dimension_, 1, options_.k, 0.0f, params);
+        results[q] = std::move(batch.front());
+    }
+    const double micros = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+
+    Trial trial;
+    trial.type = type;
+    trial.nprobe = params.nprobe;
+    trial.efSearch = params.efSearch;
+    trial.recall = recallAt(results, truth);
+    trial.queryMicros = micros / static_cast<double>(nQueries);
+
+    std::cout << "  " << type << " nprobe=" << trial.nprobe << " efSearch=" << trial.efSearch
+              << ": recall=" << trial.recall << ", " << trial.queryMicros << " us/query"
+              << std::endl;
+    return trial;
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include "faiss_index.h"
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 索引类型与搜索参数自动调优
+ *
+ * 从样本向量中留出一组查询，以暴力检索结果为真值，依次构建候选索引类型并
+ * 由小到大扫描 nprobe / efSearch，记录达到目标 recall@k 的最小参数及其单查询延迟，
+ * 最终选出满足目标且最快的配置（Flat 恒为精确检索，作为兜底）。
+ * 每个候选都由 IndexBuilder 构建为单个段、不触发后台合并；延迟在至多 maxVectors 个
+ * 采样向量构成的索引上测得，只用于候选间比较，不代表全量库上的绝对延迟。
+ * 调优结果以文本形式保存在索引文件旁（<indexPath>.tune），初始化时读取。
+ */
+class IndexTuner {
+public:
+    using ProgressCallback = std::function<void(size_t done, size_t total)>;
+
+    /**
+     * @brief 调优选项
+     */
+    struct Options {
+        float recallTarget;                  // 目标 recall@k
+        int k;                               // 评估的 Top-K
+        size_t numQueries;                   // 留出的查询数
+        size_t maxVectors;                   // 参与调优的最大向量数（超出时由调用方采样）
+        std::vector<std::string> candidates; // 候选索引类型（空 = 按向量数自动生成）
+
+        Options(float recallTarget_ = 0.95f, int k_ = 10)
+            : recallTarget(recallTarget_), k(k_), numQueries(200), maxVectors(200000) {}
+    };
+
+    /**
+     * @brief 单次试验（一种索引类型 + 一组搜索参数）
+     */
+    struct Trial {
+        std::string type;       // 索引类型
+        int nprobe;             // IVF 探测桶数（0 = 不适用）
+        int efSearch;           // HNSW 搜索队列长度（0 = 不适用）
+        float recall;           // recall@k
+        double queryMicros;     // 平均单查询延迟（微秒，样本索引上测得）
+
+        Trial() : nprobe(0), efSearch(0), recall(0.0f), queryMicros(0.0) {}
+    };
+
+    /**
+     * @brief 调优结果
+     */
+    struct Result {
+        FaissIndex::IndexConfig config;   // 选中的配置（含默认搜索参数）
+        float recall;                     // 选中配置的 recall@k
+        double queryMicros;               // 选中配置的单查询延迟（微秒，样本索引上测得）
+        size_t sampleSize;                // 构建候选索引的样本向量数
+        bool meetsTarget;                 // 是否达到目标（否则为召回率最高的配置）
+        std::vector<Trial> trials;        // 全部试验记录
+
+        Result() : recall(0.0f), queryMicros(0.0), sampleSize(0), meetsTarget(false) {}
+    };
+
+    /**
+     * @brief 构造函数
+     * @param dimension 向量维度
+     * @param baseConfig 基础配置（度量、精排等设置沿用，只替换类型与搜索参数）
+     * @param options 调优选项
+     */
+    IndexTuner(int dimension, const FaissIndex::IndexConfig& baseConfig,
+               const Options& options = Options());
+
+    /**
+     * @brief 执行调优
+     * @param vectors n x dimension 行主序样本向量（其中 numQueries 个留作查询）
+     * @param n 样本数量
+     * @param librarySize 实际库大小（用于推算候选的聚类数，0 = 取 n）
+     * @param progress 进度回调（每个候选类型完成后调用，可选）
+     * @return 调优结果；样本不足或被取消时 trials 为空
+     */
+    Result tune(const float* vectors, size_t n, size_t librarySize = 0,
+                const ProgressCallback& progress = nullptr);
+
+    /**
+     * @brief 请求取消（在当前试验结束后生效）
+     */
+    void cancel() { cancelled_ = true; }
+
+    /**
+     * @brief 按向量数生成候选索引类型
+     * @param librarySize 库大小（决定候选类型与 IVF 聚类数）
+     * @param trainable 可用的训练样本数（限制聚类数，0 = 取 librarySize）
+     */
+    static std::vector<std::string> defaultCandidates(size_t librarySize, size_t trainable = 0);
+
+    /**
+     * @brief 调优结果文件路径
+     */
+    static std::string tuningPath(const std::string& indexPath) { return indexPath + ".tune"; }
+
+    /**
+     * @brief 保存配置（临时文件写完后原子替换）
+     * @param path 结果文件路径
+     * @param result 调优结果
+     * @return 是否成功
+     */
+    static bool saveResult(const std::string& path, const Result& result);
+
+    /**
+     * @brief 读取保存的配置，文件中未出现的字段保持 config 原值
+     * @param path 结果文件路径
+     * @param config 输入基础配置，输出调优后的配置
+     * @return 文件存在且可解析时返回 true
+     */
+    static bool loadConfig(const std::string& path, FaissIndex::IndexConfig& config);
+
+private:
+    /**
+     * @brief 计算 recall@k：每个查询的结果与真值的交集占 k 的比例，取平均
+     */
+    float recallAt(const std::vector<std::vector<FaissIndex::SearchResult>>& results,
+                   const std::vector<int64_t>& truth) const;
+
+    /**
+     * @brief 在已构建的索引上测量一组搜索参数
+     */
+    Trial measure(const FaissIndex& index, const std::string& type,
+                  const float* queries, size_t nQueries,
+                  const std::vector<int64_t>& truth,
+                  const FaissIndex::SearchParams& params) const;
+
+private:
+    int dimension_;                       // 向量维度
+    FaissIndex::IndexConfig baseConfig_;  // 基础配置
+    Options options_;                     // 调优选项
+    std::atomic<bool> cancelled_;         // 取消请求
+};
+
+} // namespace index
+} // namespace vindex
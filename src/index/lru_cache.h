@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 有界 LRU 缓存（线程安全）
+ *
+ * 链表按最近使用排序（表头最新），哈希表从键定位链表节点；
+ * 超出容量时淘汰表尾。同时统计命中、未命中与淘汰次数。
+ *
+ * 读者未命中后先取 version()，读完数据源再以该版本 put()；期间该键被 erase()
+ * 过（写者已改数据源）时放弃写入，避免把读到的旧值放回缓存。
+ */
+template <typename Key, typename Value>
+class LruCache {
+public:
+    /**
+     * @brief 缓存统计
+     */
+    struct Stats {
+        uint64_t hits;          // 命中次数
+        uint64_t misses;        // 未命中次数
+        uint64_t evictions;     // 淘汰次数
+        size_t size;            // 当前条目数
+        size_t capacity;        // 容量
+
+        Stats() : hits(0), misses(0), evictions(0), size(0), capacity(0) {}
+
+        double hitRate() const {
+            const uint64_t lookups = hits + misses;
+            return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+        }
+    };
+
+    explicit LruCache(size_t capacity)
+        : capacity_(capacity)
+        , hits_(0)
+        , misses_(0)
+        , evictions_(0)
+        , version_(0)
+        , floorVersion_(0)
+    {
+    }
+
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    /**
+     * @brief 查找并标记为最近使用
+     * @return 命中时返回 true 并拷贝到 value
+     */
+    bool get(const Key& key, Value& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            misses_++;
+            return false;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        value = it->second->second;
+        hits_++;
+        return true;
+    }
+
+    /**
+     * @brief 当前失效版本（未命中后、读取数据源之前取得，传给 put）
+     */
+    uint64_t version() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return version_;
+    }
+
+    /**
+     * @brief 插入或覆盖，超出容量时淘汰最久未使用的条目
+     * @param version 读取数据源之前取得的 version()；该键之后失效过时不写入
+     */
+    void put(const Key& key, const Value& value, uint64_t version) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ == 0 || version < floorVersion_) {
+            return;
+        }
+        auto invalidated = invalidated_.find(key);
+        if (invalidated != invalidated_.end() && invalidated->second > version) {
+            return;
+        }
+
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->second = value;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+
+        entries_.emplace_front(key, value);
+        index_[key] = entries_.begin();
+        evictLocked();
+    }
+
+    /**
+     * @brief 删除条目（数据源变更之后调用），并使进行中的读者的 put 失效
+     */
+    void erase(const Key& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+
+        // 失效记录有界：超出时整体清掉，并让此前取得的版本全部作废
+        if (invalidated_.size() >= std::max<size_t>(capacity_, kMinInvalidations)) {
+            invalidated_.clear();
+            floorVersion_ = version_ + 1;
+        }
+        invalidated_[key] = ++version_;
+    }
+
+    /**
+     * @brief 清空全部条目（统计保留），进行中的读者的 put 全部失效
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        index_.clear();
+        invalidated_.clear();
+        floorVersion_ = ++version_;
+    }
+
+    /**
+     * @brief 调整容量（0 = 关闭缓存），超出部分立即淘汰
+     */
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        evictLocked();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats stats;
+        stats.hits = hits_;
+        stats.misses = misses_;
+        stats.evictions = evictions_;
+        stats.size = entries_.size();
+        stats.capacity = capacity_;
+        return stats;
+    }
+
+    /**
+     * @brief 统计清零
+     */
+    void resetStats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hits_ = 0;
+        misses_ = 0;
+        evictions_ = 0;
+    }
+
+private:
+    void evictLocked() {
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+            evictions_++;
+        }
+    }
+
+private:
+    using Entry = std::pair<Key, Value>;
+
+    static constexpr size_t kMinInvalidations = 1024;
+
+    mutable std::mutex mutex_;
+    size_t capacity_;                                                    // 容量上限
+    std::list<Entry> entries_;                                           // 表头为最近使用
+    std::unordered_map<Key, typename std::list<Entry>::iterator> index_; // 键 -> 链表节点
+    uint64_t hits_;                                                      // 命中次数
+    uint64_t misses_;                                                    // 未命中次数
+    uint64_t evictions_;                                                 // 淘汰次数
+    uint64_t version_;                                                   // 失效版本（每次 erase / clear 递增）
+    uint64_t floorVersion_;                                              // 早于该版本取得的 put 一律放弃
+    std::unordered_map<Key, uint64_t> invalidated_;                      // 键 -> 最近失效的版本
+};
+
+} // namespace index
+} // namespace vindex
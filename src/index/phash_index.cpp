@@ -0,0 +1,94 @@
+#include "phash_index.h"
+#include "content_hash.h"
+#include <algorithm>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+constexpr int kHashBits = 64;
+
+} // namespace
+
+PerceptualHashIndex::PerceptualHashIndex(int maxDistance) {
+    reset(maxDistance);
+}
+
+void PerceptualHashIndex::reset(int maxDistance) {
+    // 段数为 maxDistance + 1，每段至少 1 位
+    const int bands = std::min(std::max(maxDistance, 0) + 1, kHashBits);
+    bands_.assign(static_cast<size_t>(bands), std::unordered_map<uint64_t, Bucket>());
+    hashes_.clear();
+}
+
+uint64_t PerceptualHashIndex::bandKey(uint64_t hash, size_t band) const {
+    // 各段位宽尽量均匀：第 band 段覆盖 [band*64/n, (band+1)*64/n)
+    const size_t n = bands_.size();
+    const size_t begin = band * kHashBits / n;
+    const size_t end = (band + 1) * kHashBits / n;
+    const size_t width = end - begin;
+    const uint64_t mask = width >= 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    return (hash >> begin) & mask;
+}
+
+void PerceptualHashIndex::insert(int64_t id, uint64_t hash) {
+    erase(id);
+    hashes_[id] = hash;
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        bands_[band][bandKey(hash, band)].emplace_back(id, hash);
+    }
+}
+
+void PerceptualHashIndex::erase(int64_t id) {
+    auto it = hashes_.find(id);
+    if (it == hashes_.end()) {
+        return;
+    }
+
+    const uint64_t hash = it->second;
+    hashes_.erase(it);
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        auto bucket = bands_[band].find(bandKey(hash, band));
+        if (bucket == bands_[band].end()) {
+            continue;
+        }
+        Bucket& entries = bucket->second;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [id](const std::pair<int64_t, uint64_t>& entry) {
+                                         return entry.first == id;
+                                     }),
+                      entries.end());
+        if (entries.empty()) {
+            bands_[band].erase(bucket);
+        }
+    }
+}
+
+int64_t PerceptualHashIndex::findNearest(uint64_t hash, int maxDistance) const {
+    if (maxDistance < 0 || hashes_.empty()) {
+        return -1;
+    }
+    // 分段只保证 maxDistance() 以内的近邻至少有一段相同
+    maxDistance = std::min(maxDistance, this->maxDistance());
+
+    int bestDistance = maxDistance + 1;
+    int64_t bestId = -1;
+    for (size_t band = 0; band < bands_.size() && bestDistance > 0; ++band) {
+        auto bucket = bands_[band].find(bandKey(hash, band));
+        if (bucket == bands_[band].end()) {
+            continue;
+        }
+        for (const auto& entry : bucket->second) {
+            const int distance = hammingDistance(entry.second, hash);
+            if (distance < bestDistance || (distance == bestDistance && entry.first < bestId)) {
+                bestDistance = distance;
+                bestId = entry.first;
+            }
+        }
+    }
+    return bestDistance <= maxDistance ? bestId : -1;
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 感知哈希近邻索引（多段哈希，multi-index hashing）
+ *
+ * 64 位哈希按位切成 maxDistance + 1 段，每段各建一张精确查找表。
+ * 汉明距离不超过 maxDistance 的两个哈希至少有一段完全相同（抽屉原理），
+ * 查询只需比较各段命中的候选，不再逐个扫描全部哈希。
+ */
+class PerceptualHashIndex {
+public:
+    /**
+     * @brief 构造函数
+     * @param maxDistance 支持的最大汉明距离（决定分段数）
+     */
+    explicit PerceptualHashIndex(int maxDistance = 0);
+
+    /**
+     * @brief 清空并按新的最大距离重新分段
+     */
+    void reset(int maxDistance);
+
+    /**
+     * @brief 插入或覆盖
+     */
+    void insert(int64_t id, uint64_t hash);
+
+    /**
+     * @brief 删除
+     */
+    void erase(int64_t id);
+
+    /**
+     * @brief 查找汉明距离最小且不超过 maxDistance 的哈希
+     * @param maxDistance 最大距离（不超过构造时给出的值）
+     * @return 对应的ID，没有时返回 -1
+     */
+    int64_t findNearest(uint64_t hash, int maxDistance) const;
+
+    size_t size() const { return hashes_.size(); }
+
+    bool empty() const { return hashes_.empty(); }
+
+    /**
+     * @brief 支持的最大汉明距离
+     */
+    int maxDistance() const { return static_cast<int>(bands_.size()) - 1; }
+
+private:
+    using Bucket = std::vector<std::pair<int64_t, uint64_t>>;   // (ID, 完整哈希)
+
+    /**
+     * @brief 第 band 段的取值
+     */
+    uint64_t bandKey(uint64_t hash, size_t band) const;
+
+private:
+    std::vector<std::unordered_map<uint64_t, Bucket>> bands_;   // 每段：段取值 -> 候选
+    std::unordered_map<int64_t, uint64_t> hashes_;              // ID -> 哈希
+};
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,569 @@
+#include "sharded_faiss_index.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+/**
+ * @brief 64位整数混洗（splitmix64 终结函数），使连续的自增ID均匀分布到各分片
+ */
+uint64_t mixId(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+} // namespace
+
+// ==================== 线程池 ====================
+
+struct ShardedFaissIndex::Workers {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    explicit Workers(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            threads.emplace_back([this] { loop(); });
+        }
+    }
+
+    ~Workers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    void loop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// ==================== ShardedFaissIndex ====================
+
+ShardedFaissIndex::ShardedFaissIndex(int dimension, size_t numShards, const IndexConfig& config)
+    : dimension_(dimension)
+{
+    if (numShards == 0) {
+        throw std::invalid_argument("ShardedFaissIndex requires at least one shard");
+    }
+
+    shards_.reserve(numShards);
+    for (size_t i = 0; i < numShards; ++i) {
+        shards_.push_back(std::make_unique<FaissIndex>(dimension, config));
+    }
+
+    // 分片 0 由调用线程执行，其余分片各占一个工作线程
+    workers_ = std::make_unique<Workers>(numShards - 1);
+}
+
+ShardedFaissIndex::~ShardedFaissIndex() = default;
+
+// ==================== 索引管理 ====================
+
+bool ShardedFaissIndex::load(const std::string& indexPath) {
+    std::vector<char> loaded(shards_.size(), 0);
+    forEachShard([&](size_t i) {
+        loaded[i] = shards_[i]->load(shardPath(indexPath, i));
+    });
+
+    bool allLoaded = true;
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        if (!loaded[i]) {
+            std::cerr << "Failed to load shard " << i << " from " << shardPath(indexPath, i)
+                      << std::endl;
+            allLoaded = false;
+        }
+    }
+    return allLoaded;
+}
+
+bool ShardedFaissIndex::save(const std::string& indexPath) {
+    std::vector<char> saved(shards_.size(), 0);
+    forEachShard([&](size_t i) {
+        saved[i] = shards_[i]->save(shardPath(indexPath, i));
+    });
+
+    for (char ok : saved) {
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ShardedFaissIndex::shardPath(const std::string& indexPath, size_t shard) {
+    return indexPath + ".shard" + std::to_string(shard);
+}
+
+void ShardedFaissIndex::clear() {
+    for (auto& shard : shards_) {
+        shard->clear();
+    }
+}
+
+void ShardedFaissIndex::reset(const IndexConfig& config) {
+    for (auto& shard : shards_) {
+        shard->reset(config);
+    }
+}
+
+bool ShardedFaissIndex::train(const std::vector<std::vector<float>>& samples) {
+    std::vector<char> trained(shards_.size(), 0);
+    forEachShard([&](size_t i) {
+        trained[i] = shards_[i]->train(samples);
+    });
+
+    for (char ok : trained) {
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==================== 向量操作 ====================
+
+bool ShardedFaissIndex::add(const std::vector<float>& vector, int64_t id) {
+    validateId(id);
+    return shards_[shardOf(id)]->add(vector, id) >= 0;
+}
+
+bool ShardedFaissIndex::addBatch(const std::vector<std::vector<float>>& vectors,
+                                 const std::vector<int64_t>& ids) {
+    if (vectors.size() != ids.size()) {
+        throw std::invalid_argument("Vectors and IDs size mismatch");
+    }
+
+    const size_t n = vectors.size();
+    std::vector<float> flatVectors(n * dimension_);
+    for (size_t i = 0; i < n; ++i) {
+        if (vectors[i].size() != static_cast<size_t>(dimension_)) {
+            throw std::invalid_argument(
+                "Vector dimension mismatch. Expected: " + std::to_string(dimension_) +
+                ", Got: " + std::to_string(vectors[i].size()));
+        }
+        std::copy(vectors[i].begin(), vectors[i].end(), flatVectors.begin() + i * dimension_);
+    }
+
+    return addBatch(flatVectors.data(), n, ids.data());
+}
+
+bool ShardedFaissIndex::addBatch(const float* vectors, size_t n, const int64_t* ids) {
+    if (n == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        validateId(ids[i]);
+    }
+
+    // 单分片无需拆分
+    if (shards_.size() == 1) {
+        std::vector<int64_t> assigned;
+        return shards_[0]->addBatch(vectors, n, assigned, ids);
+    }
+
+    // 按分片拆分为连续缓冲
+    std::vector<std::vector<float>> shardVectors(shards_.size());
+    std::vector<std::vector<int64_t>> shardIds(shards_.size());
+    for (size_t i = 0; i < n; ++i) {
+        const size_t s = shardOf(ids[i]);
+        const float* row = vectors + i * dimension_;
+        shardVectors[s].insert(shardVectors[s].end(), row, row + dimension_);
+        shardIds[s].push_back(ids[i]);
+    }
+
+    std::vector<char> ok(shards_.size(), 1);
+    forEachShard([&](size_t i) {
+        if (shardIds[i].empty()) {
+            return;
+        }
+        std::vector<int64_t> assigned;
+        ok[i] = shards_[i]->addBatch(shardVectors[i].data(), shardIds[i].size(), assigned,
+                                     shardIds[i].data());
+    });
+    return std::all_of(ok.begin(), ok.end(), [](char shardOk) { return shardOk != 0; });
+}
+
+bool ShardedFaissIndex::remove(int64_t id) {
+    if (id < 0) {
+        return false;
+    }
+    return shards_[shardOf(id)]->remove(id);
+}
+
+size_t ShardedFaissIndex::removeBatch(const std::vector<int64_t>& ids) {
+    std::vector<std::vector<int64_t>> shardIds(shards_.size());
+    for (int64_t id : ids) {
+        if (id >= 0) {
+            shardIds[shardOf(id)].push_back(id);
+        }
+    }
+
+    std::vector<size_t> removed(shards_.size(), 0);
+    forEachShard([&](size_t i) {
+        if (!shardIds[i].empty()) {
+            removed[i] = shards_[i]->removeBatch(shardIds[i]);
+        }
+    });
+
+    size_t total = 0;
+    for (size_t count : removed) {
+        total += count;
+    }
+    return total;
+}
+
+// ==================== 搜索 ====================
+
+std::vector<ShardedFaissIndex::SearchResult> ShardedFaissIndex::search(
+    const std::vector<float>& queryVector,
+    int topK,
+    float threshold,
+    const SearchParams& params) const {
+
+    if (topK <= 0) {
+        return {};
+    }
+
+    // MMR 在合并后的候选上整体执行一次：分片各自多样化后再按原始分数合并会打乱选取结果
+    const bool diversify = params.mmrLambda > 0.0f && params.mmrLambda < 1.0f;
+    const int fetchK = diversify ? FaissIndex::mmrCandidateCount(topK, params) : topK;
+    SearchParams shardParams = params;
+    shardParams.mmrLambda = 0.0f;
+
+    std::vector<std::vector<SearchResult>> shardResults(shards_.size());
+    forEachShard([&](size_t i) {
+        shardResults[i] = shards_[i]->search(queryVector, fetchK, threshold, shardParams);
+    });
+
+    std::vector<std::vector<SearchResult>*> parts;
+    parts.reserve(shardResults.size());
+    for (auto& results : shardResults) {
+        parts.push_back(&results);
+    }
+    auto merged = mergeTopK(parts, fetchK);
+    if (diversify) {
+        diversifyResults(merged, topK, params.mmrLambda);
+    }
+    return merged;
+}
+
+std::vector<std::vector<ShardedFaissIndex::SearchResult>> ShardedFaissIndex::searchBatch(
+    const std::vector<std::vector<float>>& queryVectors,
+    int topK,
+    float threshold,
+    const SearchParams& params) const {
+
+    if (queryVectors.empty() || topK <= 0) {
+        return {};
+    }
+
+    // 只拼接一次，各分片共享
+    const size_t nQueries = queryVectors.size();
+    std::vector<float> flatQueries(nQueries * dimension_);
+    for (size_t i = 0; i < nQueries; ++i) {
+        if (queryVectors[i].size() != static_cast<size_t>(dimension_)) {
+            throw std::invalid_argument(
+                "Vector dimension mismatch. Expected: " + std::to_string(dimension_) +
+                ", Got: " + std::to_string(queryVectors[i].size()));
+        }
+        std::copy(queryVectors[i].begin(), queryVectors[i].end(),
+                  flatQueries.begin() + i * dimension_);
+    }
+
+    return searchBatch(flatQueries.data(), nQueries, topK, threshold, params);
+}
+
+std::vector<std::vector<ShardedFaissIndex::SearchResult>> ShardedFaissIndex::searchBatch(
+    const float* queries,
+    size_t nQueries,
+    int topK,
+    float threshold,
+    const SearchParams& params) const {
+
+    if (nQueries == 0 || topK <= 0) {
+        return {};
+    }
+
+    const bool diversify = params.mmrLambda > 0.0f && params.mmrLambda < 1.0f;
+    const int fetchK = diversify ? FaissIndex::mmrCandidateCount(topK, params) : topK;
+    SearchParams shardParams = params;
+    shardParams.mmrLambda = 0.0f;
+
+    std::vector<std::vector<std::vector<SearchResult>>> shardResults(shards_.size());
+    forEachShard([&](size_t i) {
+        shardResults[i] = shards_[i]->searchBatch(queries, nQueries, fetchK, threshold,
+                                                  shardParams);
+    });
+
+    std::vector<std::vector<SearchResult>> allResults(nQueries);
+    std::vector<std::vector<SearchResult>*> parts;
+    for (size_t q = 0; q < nQueries; ++q) {
+        // 空分片返回空列表，跳过
+        parts.clear();
+        for (auto& results : shardResults) {
+            if (q < results.size()) {
+                parts.push_back(&results[q]);
+            }
+        }
+        allResults[q] = mergeTopK(parts, fetchK);
+        if (diversify) {
+            diversifyResults(allResults[q], topK, params.mmrLambda);
+        }
+    }
+    return allResults;
+}
+
+void ShardedFaissIndex::diversifyResults(std::vector<SearchResult>& results, int topK,
+                                         float lambda) const {
+    if (results.size() <= 1) {
+        return;
+    }
+
+    // 候选向量按所在分片批量取回
+    std::vector<std::vector<int64_t>> shardIds(shards_.size());
+    std::vector<std::vector<size_t>> shardRows(shards_.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const size_t s = shardOf(results[i].id);
+        shardIds[s].push_back(results[i].id);
+        shardRows[s].push_back(i);
+    }
+
+    std::vector<float> vectors(results.size() * dimension_, 0.0f);
+    std::vector<char> found(results.size(), 0);
+    forEachShard([&](size_t s) {
+        if (shardIds[s].empty()) {
+            return;
+        }
+        std::vector<float> shardVectors;
+        std::vector<char> shardFound;
+        shards_[s]->getVectors(shardIds[s], shardVectors, shardFound);
+        for (size_t k = 0; k < shardRows[s].size(); ++k) {
+            const size_t row = shardRows[s][k];
+            std::copy(shardVectors.begin() + k * dimension_,
+                      shardVectors.begin() + (k + 1) * dimension_,
+                      vectors.begin() + row * dimension_);
+            found[row] = shardFound[k];
+        }
+    });
+
+    FaissIndex::selectDiverse(results, vectors.data(), found, dimension_, topK, lambda);
+}
+
+std::vector<ShardedFaissIndex::SearchResult> ShardedFaissIndex::rangeSearch(
+    const std::vector<float>& queryVector,
+    float minScore,
+    int maxResults,
+    const SearchParams& params) const {
+
+    std::vector<std::vector<SearchResult>> shardResults(shards_.size());
+    forEachShard([&](size_t i) {
+        shardResults[i] = shards_[i]->rangeSearch(queryVector, minScore, maxResults, params);
+    });
+
+    std::vector<std::vector<SearchResult>*> parts;
+    size_t total = 0;
+    for (auto& results : shardResults) {
+        parts.push_back(&results);
+        total += results.size();
+    }
+    const size_t limit = maxResults > 0 ? std::min(total, static_cast<size_t>(maxResults)) : total;
+    return mergeTopK(parts, static_cast<int>(limit));
+}
+
+// ==================== 信息获取 ====================
+
+size_t ShardedFaissIndex::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard->size();
+    }
+    return total;
+}
+
+bool ShardedFaissIndex::contains(int64_t id) const {
+    return id >= 0 && shards_[shardOf(id)]->contains(id);
+}
+
+std::vector<float> ShardedFaissIndex::getVector(int64_t id) const {
+    if (id < 0) {
+        return {};
+    }
+    return shards_[shardOf(id)]->getVector(id);
+}
+
+size_t ShardedFaissIndex::getVectors(const std::vector<int64_t>& ids,
+                                     std::vector<float>& vectors,
+                                     std::vector<char>& found,
+                                     bool storedOnly) const {
+    vectors.assign(ids.size() * dimension_, 0.0f);
+    found.assign(ids.size(), 0);
+
+    std::vector<std::vector<int64_t>> shardIds(shards_.size());
+    std::vector<std::vector<size_t>> shardSlots(shards_.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] < 0) {
+            continue;
+        }
+        const size_t s = shardOf(ids[i]);
+        shardIds[s].push_back(ids[i]);
+        shardSlots[s].push_back(i);
+    }
+
+    // 各分片写入互不重叠的行
+    forEachShard([&](size_t s) {
+        if (shardIds[s].empty()) {
+            return;
+        }
+        std::vector<float> shardVectors;
+        std::vector<char> shardFound;
+        shards_[s]->getVectors(shardIds[s], shardVectors, shardFound, storedOnly);
+        for (size_t j = 0; j < shardSlots[s].size(); ++j) {
+            if (!shardFound[j]) {
+                continue;
+            }
+            const size_t slot = shardSlots[s][j];
+            std::copy(shardVectors.begin() + j * dimension_,
+                      shardVectors.begin() + (j + 1) * dimension_,
+                      vectors.begin() + slot * dimension_);
+            found[slot] = 1;
+        }
+    });
+
+    return static_cast<size_t>(std::count(found.begin(), found.end(), 1));
+}
+
+ShardedFaissIndex::MemoryUsage ShardedFaissIndex::memoryUsage() const {
+    MemoryUsage total;
+    for (const auto& shard : shards_) {
+        MemoryUsage usage = shard->memoryUsage();
+        total.heapBytes += usage.heapBytes;
+        total.mappedBytes += usage.mappedBytes;
+        total.storeBytes += usage.storeBytes;
+        total.vectorCount += usage.vectorCount;
+    }
+    return total;
+}
+
+size_t ShardedFaissIndex::shardOf(int64_t id) const {
+    return static_cast<size_t>(mixId(static_cast<uint64_t>(id)) % shards_.size());
+}
+
+// ==================== 私有方法 ====================
+
+void ShardedFaissIndex::forEachShard(const std::function<void(size_t)>& fn) const {
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    size_t remaining = shards_.size() - 1;
+    std::exception_ptr error;
+
+    auto runOne = [&](size_t i) {
+        try {
+            fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    for (size_t i = 1; i < shards_.size(); ++i) {
+        workers_->submit([&, i] {
+            runOne(i);
+            // 持锁通知：等待方返回后局部的条件变量即被销毁
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remaining == 0) {
+                doneCv.notify_one();
+            }
+        });
+    }
+    runOne(0);
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCv.wait(lock, [&] { return remaining == 0; });
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+std::vector<ShardedFaissIndex::SearchResult> ShardedFaissIndex::mergeTopK(
+    const std::vector<std::vector<SearchResult>*>& parts, int topK) {
+
+    // 各分片结果已按分数降序排列：堆中保存每个分片当前的首个候选
+    using Cursor = std::tuple<float, size_t, size_t>;   // (分数, 分片, 位置)
+    std::priority_queue<Cursor> heap;
+    for (size_t p = 0; p < parts.size(); ++p) {
+        if (!parts[p]->empty()) {
+            heap.emplace(parts[p]->front().score, p, 0);
+        }
+    }
+
+    std::vector<SearchResult> merged;
+    merged.reserve(static_cast<size_t>(topK));
+    while (!heap.empty() && merged.size() < static_cast<size_t>(topK)) {
+        const size_t p = std::get<1>(heap.top());
+        const size_t pos = std::get<2>(heap.top());
+        heap.pop();
+
+        merged.push_back((*parts[p])[pos]);
+        if (pos + 1 < parts[p]->size()) {
+            heap.emplace((*parts[p])[pos + 1].score, p, pos + 1);
+        }
+    }
+    return merged;
+}
+
+void ShardedFaissIndex::validateId(int64_t id) const {
+    if (id < 0) {
+        throw std::invalid_argument("ShardedFaissIndex requires explicit non-negative IDs");
+    }
+}
+
+} // namespace index
+} // namespace vindex
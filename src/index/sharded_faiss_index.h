@@ -0,0 +1,232 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "faiss_index.h"
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 分片向量索引
+ *
+ * 按ID哈希将向量分布到 N 个独立的 FaissIndex 分片：
+ * - 搜索在线程池上并发扫描各分片，各分片 Top-K 经堆合并为全局 Top-K
+ * - 写入按分片拆分后并行执行，各分片内部仍为多读单写
+ * - 每个分片单独保存为 <path>.shard<i>，可并行加载，也可单独重建
+ *
+ * 分片数在构造时确定，加载时须与保存时一致。
+ */
+class ShardedFaissIndex {
+public:
+    using IndexConfig = FaissIndex::IndexConfig;
+    using SearchParams = FaissIndex::SearchParams;
+    using SearchResult = FaissIndex::SearchResult;
+    using MemoryUsage = FaissIndex::MemoryUsage;
+
+    /**
+     * @brief 构造函数
+     * @param dimension 向量维度
+     * @param numShards 分片数（至少为1）
+     * @param config 各分片的索引配置
+     */
+    ShardedFaissIndex(int dimension, size_t numShards, const IndexConfig& config = IndexConfig());
+    ~ShardedFaissIndex();
+
+    ShardedFaissIndex(const ShardedFaissIndex&) = delete;
+    ShardedFaissIndex& operator=(const ShardedFaissIndex&) = delete;
+
+    // ==================== 索引管理 ====================
+
+    /**
+     * @brief 并行加载全部分片
+     * @param indexPath 索引路径前缀（分片文件为 <indexPath>.shard<i>）
+     * @return 全部分片加载成功时返回 true
+     */
+    bool load(const std::string& indexPath);
+
+    /**
+     * @brief 并行保存全部分片
+     * @param indexPath 索引路径前缀
+     * @return 全部分片保存成功时返回 true
+     */
+    bool save(const std::string& indexPath);
+
+    /**
+     * @brief 分片文件路径
+     */
+    static std::string shardPath(const std::string& indexPath, size_t shard);
+
+    /**
+     * @brief 清空全部分片
+     */
+    void clear();
+
+    /**
+     * @brief 使用指定配置重建全部分片（丢弃现有向量）
+     */
+    void reset(const IndexConfig& config);
+
+    /**
+     * @brief 用同一组样本并行训练全部分片
+     */
+    bool train(const std::vector<std::vector<float>>& samples);
+
+    // ==================== 向量操作 ====================
+
+    /**
+     * @brief 添加向量（ID已存在时覆盖）
+     * @param vector 特征向量
+     * @param id 向量ID（必须 >= 0，用于确定分片）
+     * @return 是否成功（分片的增量日志写入失败时返回 false）
+     */
+    bool add(const std::vector<float>& vector, int64_t id);
+
+    /**
+     * @brief 批量添加向量（按分片拆分后并行写入）
+     * @param vectors 特征向量列表
+     * @param ids 向量ID列表（与 vectors 等长）
+     * @return 是否全部成功（失败的分片不写入，其他分片照常写入）
+     */
+    bool addBatch(const std::vector<std::vector<float>>& vectors,
+                  const std::vector<int64_t>& ids);
+
+    /**
+     * @brief 批量添加连续存储的向量
+     * @param vectors n x dimension 行主序向量
+     * @param n 向量数量
+     * @param ids n 个向量ID
+     * @return 是否全部成功（失败的分片不写入，其他分片照常写入）
+     */
+    bool addBatch(const float* vectors, size_t n, const int64_t* ids);
+
+    /**
+     * @brief 删除向量
+     */
+    bool remove(int64_t id);
+
+    /**
+     * @brief 批量删除向量
+     * @return 成功删除的数量
+     */
+    size_t removeBatch(const std::vector<int64_t>& ids);
+
+    // ==================== 搜索 ====================
+
+    /**
+     * @brief 搜索最相似的向量（各分片并发搜索后合并；启用 MMR 时合并后整体多样化）
+     */
+    std::vector<SearchResult> search(const std::vector<float>& queryVector,
+                                    int topK = 10,
+                                    float threshold = 0.0f,
+                                    const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief 批量搜索
+     */
+    std::vector<std::vector<SearchResult>> searchBatch(
+        const std::vector<std::vector<float>>& queryVectors,
+        int topK = 10,
+        float threshold = 0.0f,
+        const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief 批量搜索连续存储的查询向量（各分片共享同一查询缓冲）
+     */
+    std::vector<std::vector<SearchResult>> searchBatch(
+        const float* queries,
+        size_t nQueries,
+        int topK = 10,
+        float threshold = 0.0f,
+        const SearchParams& params = SearchParams()) const;
+
+    /**
+     * @brief 范围搜索：各分片返回相似度不低于 minScore 的结果后合并
+     * @param maxResults 最多返回数量（0 = 不限）
+     */
+    std::vector<SearchResult> rangeSearch(const std::vector<float>& queryVector,
+                                          float minScore,
+                                          int maxResults = 0,
+                                          const SearchParams& params = SearchParams()) const;
+
+    // ==================== 信息获取 ====================
+
+    /**
+     * @brief 向量总数
+     */
+    size_t size() const;
+
+    int dimension() const { return dimension_; }
+
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief 检查ID是否存在
+     */
+    bool contains(int64_t id) const;
+
+    /**
+     * @brief 取回单个向量（由ID所在分片取回）
+     */
+    std::vector<float> getVector(int64_t id) const;
+
+    /**
+     * @brief 批量取回向量（按分片分组，各分片并行）
+     */
+    size_t getVectors(const std::vector<int64_t>& ids, std::vector<float>& vectors,
+                      std::vector<char>& found, bool storedOnly = false) const;
+
+    /**
+     * @brief 各分片内存占用之和
+     */
+    MemoryUsage memoryUsage() const;
+
+    /**
+     * @brief 分片数
+     */
+    size_t shardCount() const { return shards_.size(); }
+
+    /**
+     * @brief ID 所在的分片
+     */
+    size_t shardOf(int64_t id) const;
+
+    /**
+     * @brief 获取分片（用于单独重建或保存）
+     */
+    FaissIndex& shard(size_t i) { return *shards_.at(i); }
+    const FaissIndex& shard(size_t i) const { return *shards_.at(i); }
+
+private:
+    struct Workers;
+
+    /**
+     * @brief 在线程池上对每个分片执行 fn(i)，当前线程执行分片 0，全部完成后返回
+     *
+     * 任一任务抛出的异常在全部任务结束后重新抛出
+     */
+    void forEachShard(const std::function<void(size_t)>& fn) const;
+
+    /**
+     * @brief 对合并后的候选执行一次 MMR 多样化（候选向量从各自分片批量取回）
+     */
+    void diversifyResults(std::vector<SearchResult>& results, int topK, float lambda) const;
+
+    /**
+     * @brief 合并各分片的有序结果，按分数降序取前 topK 个
+     */
+    static std::vector<SearchResult> mergeTopK(
+        const std::vector<std::vector<SearchResult>*>& parts, int topK);
+
+    void validateId(int64_t id) const;
+
+private:
+    int dimension_;                                   // 向量维度
+    std::vector<std::unique_ptr<FaissIndex>> shards_; // 分片
+    std::unique_ptr<Workers> workers_;                // 分片任务线程池
+};
+
+} // namespace index
+} // namespace vindex
@@ -34,8 +34,8 @@ bool TextCorpusIndex::loadFromFile(const std::string& filePath, core::ClipEncode
     }
 
     // 编码文本（需要文本模型）
-    std::vector<std::vector<float>> features = encoder.encodeTextBatch(texts);
-    if (features.empty() || features[0].size() != static_cast<size_t>(dimension_)) {
+    std::vector<float> features = encoder.encodeTextBatchFlat(texts);
+    if (features.size() != texts.size() * static_cast<size_t>(dimension_)) {
         return false;
     }
 
@@ -50,7 +50,8 @@ bool TextCorpusIndex::loadFromFile(const std::string& filePath, core::ClipEncode
         ids.push_back(id);
         entryMap_.emplace(id, Entry{id, texts[i]});
     }
-    index_.addBatch(features, ids, nullptr);
+    std::vector<int64_t> assigned;
+    index_.addBatch(features.data(), texts.size(), assigned, ids.data());
 
     ready_ = true;
     return true;
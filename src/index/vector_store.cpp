@@ -0,0 +1,562 @@
+#include "vector_store.h"
+#include "file_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace vindex {
+namespace index {
+
+namespace {
+
+constexpr char kMagic[4] = {'V', 'X', 'V', 'S'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+// 尾部缓冲达到该行数时重新映射，不等到 save()
+constexpr size_t kMaxTailRows = 16384;
+// ID日志首条记录的ID为该值时记录的是代号（压缩后与数据文件头部的代号对应）
+constexpr int64_t kGenerationMarker = INT64_MIN;
+
+struct StoreHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t generation;   // 压缩次数，与ID日志中的代号不一致时ID日志作废
+};
+static_assert(sizeof(StoreHeader) == kHeaderSize, "unexpected header size");
+
+struct IdEntry {
+    int64_t id;
+    int64_t row;   // -1 表示删除
+};
+
+std::string idsPathOf(const std::string& path) {
+    return path + ".ids";
+}
+
+/**
+ * @brief 关闭文件、截回 bytes 字节后重新打开（去掉写失败残留的半截数据）
+ * @return 重新打开的文件，失败返回 nullptr
+ */
+std::FILE* reopenTruncated(std::FILE* file, const std::string& path, size_t bytes) {
+    if (file) {
+        std::fclose(file);   // 关闭时残留的缓冲可能再写出一部分，随后一并截掉
+    }
+    std::error_code ec;
+    fs::resize_file(fs::u8path(path), bytes, ec);
+    return ec ? nullptr : openFile(path, "r+b");
+}
+
+} // namespace
+
+// ==================== 文件映射 ====================
+
+struct VectorStore::Mapping {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+
+    ~Mapping() { unmap(); }
+
+    bool map(const std::string& path, size_t bytes) {
+        unmap();
+        if (bytes == 0) {
+            return true;
+        }
+#ifdef _WIN32
+        HANDLE file = CreateFileW(fs::u8path(path).c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) {
+            return false;
+        }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, bytes));
+        if (!data) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+            return false;
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        void* ptr = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        // 精排按ID随机访问，关闭预读
+        ::madvise(ptr, bytes, MADV_RANDOM);
+        data = static_cast<const char*>(ptr);
+#endif
+        size = bytes;
+        return true;
+    }
+
+    void unmap() {
+        if (!data) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        ::munmap(const_cast<char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+// ==================== VectorStore ====================
+
+VectorStore::VectorStore(int dimension)
+    : dimension_(dimension)
+    , dataFile_(nullptr)
+    , idsFile_(nullptr)
+    , mapping_(std::make_unique<Mapping>())
+    , mappedRows_(0)
+    , totalRows_(0)
+    , idsBytes_(0)
+{
+}
+
+VectorStore::~VectorStore() {
+    closeLocked();
+}
+
+bool VectorStore::open(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return openLocked(path);
+}
+
+void VectorStore::close() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    closeLocked();
+}
+
+bool VectorStore::isOpen() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return dataFile_ != nullptr;
+}
+
+bool VectorStore::openLocked(const std::string& path) {
+    closeLocked();
+    path_ = path;
+
+    const size_t rowBytes = dimension_ * sizeof(float);
+    const fs::path dataPath = fs::u8path(path);
+    std::error_code ec;
+    uint32_t generation = 0;
+
+    if (fs::exists(dataPath, ec)) {
+        // 截掉崩溃时可能残留的半行，保证追加位置按行对齐
+        size_t fileSize = static_cast<size_t>(fs::file_size(dataPath, ec));
+        if (fileSize > kHeaderSize && (fileSize - kHeaderSize) % rowBytes != 0) {
+            fs::resize_file(dataPath, kHeaderSize + (fileSize - kHeaderSize) / rowBytes * rowBytes, ec);
+        }
+
+        dataFile_ = openFile(path, "r+b");
+        if (!dataFile_) {
+            std::cerr << "Failed to open vector store: " << path << std::endl;
+            return false;
+        }
+
+        StoreHeader header;
+        if (std::fread(&header, sizeof(header), 1, dataFile_) != 1 ||
+            std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+            header.dimension != static_cast<uint32_t>(dimension_)) {
+            std::cerr << "Invalid vector store or dimension mismatch: " << path << std::endl;
+            closeLocked();
+            return false;
+        }
+        generation = header.generation;
+
+        fileSize = static_cast<size_t>(fs::file_size(dataPath, ec));
+        totalRows_ = fileSize > kHeaderSize ? (fileSize - kHeaderSize) / rowBytes : 0;
+    } else {
+        dataFile_ = openFile(path, "w+b");
+        if (!dataFile_) {
+            std::cerr << "Failed to create vector store: " << path << std::endl;
+            return false;
+        }
+        if (!writeHeader(dataFile_, 0)) {
+            closeLocked();
+            return false;
+        }
+        totalRows_ = 0;
+    }
+
+    // 回放ID日志，重建 id -> 行号（先截掉崩溃时可能残留的半条记录）
+    const std::string idsPath = idsPathOf(path);
+    const fs::path idsFsPath = fs::u8path(idsPath);
+    const bool idsExist = fs::exists(idsFsPath, ec);
+    if (idsExist) {
+        const size_t idsSize = static_cast<size_t>(fs::file_size(idsFsPath, ec));
+        if (idsSize % sizeof(IdEntry) != 0) {
+            fs::resize_file(idsFsPath, idsSize / sizeof(IdEntry) * sizeof(IdEntry), ec);
+        }
+    }
+    idsFile_ = openFile(idsPath, idsExist ? "r+b" : "w+b");
+    if (!idsFile_) {
+        std::cerr << "Failed to open vector store ids: " << idsPath << std::endl;
+        closeLocked();
+        return false;
+    }
+
+    std::vector<IdEntry> entries(4096);
+    size_t count = 0;
+    bool first = true;
+    bool stale = false;
+    while ((count = std::fread(entries.data(), sizeof(IdEntry), entries.size(), idsFile_)) > 0) {
+        size_t i = 0;
+        if (first) {
+            // 代号记录：压缩时数据文件已替换而ID日志未替换（崩溃），行号不再可信
+            const uint32_t idsGeneration = entries[0].id == kGenerationMarker
+                ? static_cast<uint32_t>(entries[0].row) : 0;
+            if (idsGeneration != generation) {
+                std::cerr << "Vector store ids do not match " << path
+                          << " (interrupted compaction), ignoring stored vectors" << std::endl;
+                stale = true;
+                break;
+            }
+            i = entries[0].id == kGenerationMarker ? 1 : 0;
+            first = false;
+        }
+        for (; i < count; ++i) {
+            const IdEntry& entry = entries[i];
+            if (entry.row < 0) {
+                rows_.erase(entry.id);
+            } else if (static_cast<size_t>(entry.row) < totalRows_) {
+                rows_[entry.id] = entry.row;
+            }
+        }
+    }
+    if (first && generation != 0) {
+        std::cerr << "Vector store ids missing for " << path
+                  << " (interrupted compaction), ignoring stored vectors" << std::endl;
+        stale = true;
+    }
+
+    if (stale) {
+        // 作废的ID日志清空后以当前代号开头，之后追加的记录在下次打开时仍然有效；
+        // 旧数据行全部视为失效，由 compact() 回收
+        rows_.clear();
+        std::fclose(idsFile_);
+        idsFile_ = openFile(idsPath, "w+b");
+        IdEntry marker;
+        marker.id = kGenerationMarker;
+        marker.row = generation;
+        if (!idsFile_ || std::fwrite(&marker, sizeof(marker), 1, idsFile_) != 1 ||
+            std::fflush(idsFile_) != 0) {
+            std::cerr << "Failed to reset vector store ids: " << idsPath << std::endl;
+            closeLocked();
+            return false;
+        }
+        idsBytes_ = sizeof(IdEntry);
+    } else {
+        idsBytes_ = static_cast<size_t>(fs::file_size(idsFsPath, ec));
+    }
+
+    return remap();
+}
+
+void VectorStore::closeLocked() {
+    mapping_->unmap();
+    if (dataFile_) {
+        std::fclose(dataFile_);
+        dataFile_ = nullptr;
+    }
+    if (idsFile_) {
+        std::fclose(idsFile_);
+        idsFile_ = nullptr;
+    }
+    mappedRows_ = 0;
+    totalRows_ = 0;
+    idsBytes_ = 0;
+    tail_.clear();
+    rows_.clear();
+}
+
+// ==================== 读写 ====================
+
+bool VectorStore::put(int64_t id, const float* vector) {
+    return putBatch(&id, vector, 1);
+}
+
+bool VectorStore::putBatch(const int64_t* ids, const float* vectors, size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!dataFile_) {
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+
+    std::vector<int64_t> rows(n);
+    for (size_t i = 0; i < n; ++i) {
+        rows[i] = static_cast<int64_t>(totalRows_ + i);
+    }
+
+    // 写在第 totalRows_ 行处而不是文件尾：行号与写入位置必须一致
+    const size_t rowBytes = dimension_ * sizeof(float);
+    if (!seekFile(dataFile_, kHeaderSize + totalRows_ * rowBytes) ||
+        std::fwrite(vectors, rowBytes, n, dataFile_) != n ||
+        !appendIds(ids, rows.data(), n)) {
+        std::cerr << "Failed to append vectors to " << path_ << std::endl;
+        discardTail();
+        return false;
+    }
+
+    tail_.insert(tail_.end(), vectors, vectors + n * dimension_);
+    for (size_t i = 0; i < n; ++i) {
+        rows_[ids[i]] = rows[i];
+    }
+    totalRows_ += n;
+
+    // 尾部缓冲有界：积累到阈值即重新映射，大批量导入时内存不随导入量增长
+    if (totalRows_ - mappedRows_ >= kMaxTailRows) {
+        std::fflush(idsFile_);
+        return remap();
+    }
+    return true;
+}
+
+bool VectorStore::remove(int64_t id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!dataFile_ || rows_.find(id) == rows_.end()) {
+        return false;
+    }
+
+    const int64_t deleted = -1;
+    if (!appendIds(&id, &deleted, 1)) {
+        std::cerr << "Failed to remove vector from " << path_ << std::endl;
+        discardTail();
+        return false;
+    }
+    rows_.erase(id);
+    return true;
+}
+
+bool VectorStore::get(int64_t id, float* out) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = rows_.find(id);
+    if (it == rows_.end()) {
+        return false;
+    }
+    std::memcpy(out, rowData(it->second), dimension_ * sizeof(float));
+    return true;
+}
+
+bool VectorStore::contains(int64_t id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return rows_.find(id) != rows_.end();
+}
+
+size_t VectorStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return rows_.size();
+}
+
+size_t VectorStore::garbageRows() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return totalRows_ - rows_.size();
+}
+
+size_t VectorStore::fileBytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return dataFile_ ? kHeaderSize + totalRows_ * dimension_ * sizeof(float) : 0;
+}
+
+bool VectorStore::flush() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!dataFile_) {
+        return false;
+    }
+
+    std::fflush(idsFile_);
+    return remap();
+}
+
+bool VectorStore::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!dataFile_) {
+        return false;
+    }
+
+    const std::string path = path_;
+    closeLocked();
+
+    std::error_code ec;
+    fs::remove(fs::u8path(path), ec);
+    fs::remove(fs::u8path(idsPathOf(path)), ec);
+    return openLocked(path);
+}
+
+bool VectorStore::compact() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!dataFile_) {
+        return false;
+    }
+    if (rows_.size() == totalRows_) {
+        return true;
+    }
+
+    const size_t before = totalRows_;
+    const std::string path = path_;
+    const std::string idsPath = idsPathOf(path);
+    const std::string tmpPath = path + ".tmp";
+    const std::string tmpIdsPath = idsPath + ".tmp";
+
+    // 读取旧文件前让所有行都在映射中
+    std::fflush(idsFile_);
+    if (!remap()) {
+        return false;
+    }
+
+    // 读取代号，新文件使用下一代号
+    StoreHeader header;
+    std::fseek(dataFile_, 0, SEEK_SET);
+    if (std::fread(&header, sizeof(header), 1, dataFile_) != 1) {
+        std::cerr << "Failed to read vector store header: " << path << std::endl;
+        return false;
+    }
+    const uint32_t generation = header.generation + 1;
+
+    // 存活行按旧行号顺序写出（顺序读取映射），ID日志以代号记录开头
+    std::vector<std::pair<int64_t, int64_t>> live(rows_.begin(), rows_.end());
+    std::sort(live.begin(), live.end(),
+              [](const std::pair<int64_t, int64_t>& a, const std::pair<int64_t, int64_t>& b) {
+                  return a.second < b.second;
+              });
+
+    std::FILE* data = openFile(tmpPath, "wb");
+    std::FILE* ids = openFile(tmpIdsPath, "wb");
+    bool ok = data && ids && writeHeader(data, generation);
+
+    const size_t rowBytes = dimension_ * sizeof(float);
+    IdEntry marker;
+    marker.id = kGenerationMarker;
+    marker.row = generation;
+    ok = ok && std::fwrite(&marker, sizeof(marker), 1, ids) == 1;
+    for (size_t i = 0; ok && i < live.size(); ++i) {
+        IdEntry entry;
+        entry.id = live[i].first;
+        entry.row = static_cast<int64_t>(i);
+        ok = std::fwrite(rowData(live[i].second), rowBytes, 1, data) == 1 &&
+             std::fwrite(&entry, sizeof(entry), 1, ids) == 1;
+    }
+    if (data) {
+        ok = std::fclose(data) == 0 && ok;
+    }
+    if (ids) {
+        ok = std::fclose(ids) == 0 && ok;
+    }
+
+    std::error_code ec;
+    if (!ok) {
+        std::cerr << "Failed to compact vector store: " << path << std::endl;
+        fs::remove(fs::u8path(tmpPath), ec);
+        fs::remove(fs::u8path(tmpIdsPath), ec);
+        return false;
+    }
+
+    // 先替换数据文件再替换ID日志：中途崩溃时代号不一致，打开时丢弃ID日志而不是读错行
+    closeLocked();
+    const bool replaced = replaceFile(tmpPath, path) && replaceFile(tmpIdsPath, idsPath);
+    if (!openLocked(path) || !replaced) {
+        return false;
+    }
+
+    std::cout << "Compacted vector store " << path << ": " << before << " -> " << totalRows_
+              << " rows" << std::endl;
+    return true;
+}
+
+// ==================== 私有方法 ====================
+
+bool VectorStore::writeHeader(std::FILE* file, uint32_t generation) {
+    StoreHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.dimension = static_cast<uint32_t>(dimension_);
+    header.generation = generation;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fflush(file) != 0) {
+        std::cerr << "Failed to write vector store header: " << path_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool VectorStore::appendIds(const int64_t* ids, const int64_t* rows, size_t n) {
+    std::vector<IdEntry> entries(n);
+    for (size_t i = 0; i < n; ++i) {
+        entries[i].id = ids[i];
+        entries[i].row = rows[i];
+    }
+
+    if (!seekFile(idsFile_, idsBytes_) ||
+        std::fwrite(entries.data(), sizeof(IdEntry), n, idsFile_) != n) {
+        return false;
+    }
+    idsBytes_ += n * sizeof(IdEntry);
+    return true;
+}
+
+bool VectorStore::discardTail() {
+    // 数据文件截回 totalRows_ 行、ID日志截回 idsBytes_，后续写入的行号与位置保持一致
+    dataFile_ = reopenTruncated(dataFile_, path_, kHeaderSize + totalRows_ * dimension_ * sizeof(float));
+    idsFile_ = reopenTruncated(idsFile_, idsPathOf(path_), idsBytes_);
+    if (!dataFile_ || !idsFile_) {
+        std::cerr << "Failed to restore vector store, closing it: " << path_ << std::endl;
+        closeLocked();
+        return false;
+    }
+    return true;
+}
+
+bool VectorStore::remap() {
+    std::fflush(dataFile_);
+
+    const size_t bytes = kHeaderSize + totalRows_ * dimension_ * sizeof(float);
+    if (!mapping_->map(path_, totalRows_ > 0 ? bytes : 0)) {
+        std::cerr << "Failed to map vector store: " << path_ << std::endl;
+        closeLocked();
+        return false;
+    }
+
+    mappedRows_ = totalRows_;
+    std::vector<float>().swap(tail_);
+    return true;
+}
+
+const float* VectorStore::rowData(int64_t row) const {
+    const size_t r = static_cast<size_t>(row);
+    if (r < mappedRows_) {
+        return reinterpret_cast<const float*>(mapping_->data + kHeaderSize) + r * dimension_;
+    }
+    return tail_.data() + (r - mappedRows_) * dimension_;
+}
+
+} // namespace index
+} // namespace vindex
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vindex {
+namespace index {
+
+/**
+ * @brief 全精度向量存储（追加写入 + 内存映射读取）
+ *
+ * 为压缩索引（PQ/SQ）保存原始 float 向量，用于精排与向量取回。
+ * 文件布局：
+ *   <path>      16字节头部 + 连续的 float 向量行
+ *   <path>.ids  (id, 行号) 追加日志，行号为 -1 表示删除
+ * 打开时只读取 ID 日志，向量数据通过 mmap 按需换入，多进程共享页缓存。
+ * 覆盖与删除留下的失效行由 compact() 回收；路径按 UTF-8 处理。
+ * 线程安全：读取持共享锁，写入与重新映射持独占锁。
+ */
+class VectorStore {
+public:
+    /**
+     * @brief 构造函数
+     * @param dimension 向量维度
+     */
+    explicit VectorStore(int dimension);
+    ~VectorStore();
+
+    VectorStore(const VectorStore&) = delete;
+    VectorStore& operator=(const VectorStore&) = delete;
+
+    /**
+     * @brief 打开存储文件（不存在时创建）
+     * @param path 数据文件路径
+     * @return 是否成功
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief 关闭存储
+     */
+    void close();
+
+    /**
+     * @brief 是否已打开
+     */
+    bool isOpen() const;
+
+    // ==================== 读写 ====================
+
+    /**
+     * @brief 写入单个向量（已存在的ID会被覆盖）
+     */
+    bool put(int64_t id, const float* vector);
+
+    /**
+     * @brief 批量写入向量
+     * @param ids ID数组
+     * @param vectors n x dimension 行主序向量
+     * @param n 数量
+     */
+    bool putBatch(const int64_t* ids, const float* vectors, size_t n);
+
+    /**
+     * @brief 删除向量（写入删除标记，空间在 compact / clear 后回收）
+     */
+    bool remove(int64_t id);
+
+    /**
+     * @brief 获取向量（拷贝，避免并发重新映射后指针失效）
+     * @param id 向量ID
+     * @param out 输出：dimension 个 float
+     * @return 是否存在
+     */
+    bool get(int64_t id, float* out) const;
+
+    /**
+     * @brief 检查ID是否存在
+     */
+    bool contains(int64_t id) const;
+
+    /**
+     * @brief 有效向量数量
+     */
+    size_t size() const;
+
+    /**
+     * @brief 数据文件字节数（含已删除的行）
+     */
+    size_t fileBytes() const;
+
+    /**
+     * @brief 已失效的行数（被覆盖或删除，compact 后回收）
+     */
+    size_t garbageRows() const;
+
+    /**
+     * @brief 刷新缓冲并重新映射文件（尾部缓冲达到上限时 putBatch 也会自动重新映射）
+     */
+    bool flush();
+
+    /**
+     * @brief 压缩：只保留有效行，重写数据文件与ID日志后原子替换
+     *
+     * 持独占锁执行，期间读取阻塞；逐行写出，不额外占用内存
+     */
+    bool compact();
+
+    /**
+     * @brief 清空并截断文件
+     */
+    bool clear();
+
+    int dimension() const { return dimension_; }
+    const std::string& path() const { return path_; }
+
+private:
+    struct Mapping;
+
+    /**
+     * @brief 打开/关闭的无锁实现（调用方持有独占锁）
+     */
+    bool openLocked(const std::string& path);
+    void closeLocked();
+
+    /**
+     * @brief 写入数据文件头部
+     */
+    bool writeHeader(std::FILE* file, uint32_t generation);
+
+    /**
+     * @brief 追加ID日志
+     */
+    bool appendIds(const int64_t* ids, const int64_t* rows, size_t n);
+
+    /**
+     * @brief 写入失败后把两个文件截回最后一条完整记录之后
+     * @return 失败时存储已关闭，之后的读写全部失败
+     */
+    bool discardTail();
+
+    /**
+     * @brief 重新映射数据文件，清空尾部缓冲
+     */
+    bool remap();
+
+    /**
+     * @brief 行号对应的向量数据
+     */
+    const float* rowData(int64_t row) const;
+
+private:
+    mutable std::shared_mutex mutex_;            // 读共享，写独占
+    int dimension_;                              // 向量维度
+    std::string path_;                           // 数据文件路径
+    std::FILE* dataFile_;                        // 数据文件（追加写）
+    std::FILE* idsFile_;                         // ID日志（追加写）
+    std::unique_ptr<Mapping> mapping_;           // 数据文件映射
+    size_t mappedRows_;                          // 已映射的行数
+    size_t totalRows_;                           // 文件中的总行数
+    size_t idsBytes_;                            // ID日志字节数（最后一条完整记录之后）
+    std::vector<float> tail_;                    // 映射之后追加的行（下次 flush 前在内存中）
+    std::unordered_map<int64_t, int64_t> rows_;  // id -> 行号
+};
+
+} // namespace index
+} // namespace vindex